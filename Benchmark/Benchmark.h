@@ -0,0 +1,35 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_BENCHMARK_BENCHMARK_H_
+#define RDEBUGGER_BENCHMARK_BENCHMARK_H_
+
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Times parsing a mix of IDE commands with the RDIP command tokenizer and
+// with the std::regex chain it replaced. Returns the process exit code.
+int RunCommandBenchmark(const std::vector<std::string>& args);
+
+// Connects to a running debugger like an IDE does and times command round
+// trips. Returns the process exit code.
+int RunRoundTripBenchmark(const std::vector<std::string>& args);
+
+// Runs Ruby in the process and times reading its stack at a stop, with
+// StackCapture and with the debug inspector alone. Returns the process exit
+// code.
+int RunStackBenchmark(const std::vector<std::string>& args);
+
+// Returns args[index] as a number, or default_value if it is missing or not
+// a number.
+size_t GetCountArgument(const std::vector<std::string>& args, size_t index,
+                        size_t default_value);
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_BENCHMARK_BENCHMARK_H_
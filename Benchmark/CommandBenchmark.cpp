@@ -0,0 +1,257 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Benchmark.h"
+
+#include <DebugServer/Clock.h>
+#include <DebugServer/UI/RDIP/CommandTable.h>
+#include <DebugServer/UI/RDIP/CommandTokenizer.h>
+#include <Common/BreakPoint.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// What an IDE sends during a typical session: setting breakpoints, then
+// stepping and reading the stack and variables at every stop. All of these
+// are understood by both parsers.
+const char* const kCommandLines[] = {
+  "b C:/Users/me/AppData/Roaming/SketchUp/Plugins/my_plugin/tool.rb:42\n",
+  "b my_plugin/main.rb:7\n",
+  "start\n",
+  "w;v l;v g\n",
+  "v i 3ff1a2b4\n",
+  "v inspect model.entities.length\n",
+  "n\n",
+  "w;v l\n",
+  "s\n",
+  "th l\n",
+  "f 2\n",
+  "finish\n",
+  "del 1\n",
+  "cont\n",
+};
+
+// Both parsers sum up the command and its parsed arguments, so the checksums
+// show that they did the same work.
+size_t GetChecksum(RdipCommand command, const BreakPoint& bp, size_t number,
+                   const std::string& text) {
+  return command + 1 + bp.file.size() + bp.line + number + text.size();
+}
+
+// The parsing RDIP did before the command table: the line is copied out of
+// the read buffer, split into copies, and every command is matched against
+// the expressions in turn until one fits. The arguments are then converted
+// the way the handlers of that time did.
+size_t EvaluateWithRegex(const std::string& cmd) {
+  struct Pattern {
+    std::regex expression;
+    bool search;
+    RdipCommand command;
+  };
+  static const Pattern patterns[] = {
+    { std::regex("^\\s*b(?:reak)?\\s+(?:(.+):)?([^.:]+)$"), false, RDIP_BREAK },
+    { std::regex("^\\s*del(?:ete)?(?:\\s+(\\d+))?$"), false, RDIP_DELETE },
+    { std::regex("^\\s*start$"), false, RDIP_START },
+    { std::regex("^\\s*c(?:ont)?$"), false, RDIP_CONT },
+    { std::regex("^\\s*exit?$"), false, RDIP_EXIT },
+    { std::regex("^\\s*w(?:here)?$"), false, RDIP_WHERE },
+    { std::regex("^\\s*th(?:read)? l(?:ist)?$"), false, RDIP_THREAD },
+    { std::regex("^\\s*f(?:rame)? ([0-9]+)$"), false, RDIP_FRAME },
+    { std::regex("^\\s*s(?:tep)?\\s?"), false, RDIP_STEP },
+    { std::regex("^\\s*finish?$"), false, RDIP_FINISH },
+    { std::regex("^\\s*n(?:ext)?$"), false, RDIP_NEXT },
+    { std::regex("v inspect\\s+"), true, RDIP_VAR },
+    { std::regex("^\\s*v(?:ar)? l(?:ocal)?$"), false, RDIP_VAR },
+    { std::regex("^\\s*v(?:ar)? g(?:lobal)?$"), false, RDIP_VAR },
+    { std::regex("^\\s*v(?:ar)? i(?:nstance)? (.+)$"), false, RDIP_VAR },
+  };
+
+  std::smatch what;
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+    const Pattern& pattern = patterns[i];
+    bool matched = pattern.search ?
+        std::regex_search(cmd, what, pattern.expression) :
+        std::regex_match(cmd, what, pattern.expression);
+    if (!matched)
+      continue;
+    BreakPoint bp;
+    size_t number = 0;
+    std::string text;
+    if (pattern.command == RDIP_BREAK) {
+      bp.file = what[1];
+      boost::replace_all(bp.file, "\\", "/");
+      std::string line = what[2];
+      bp.line = std::atoi(line.c_str());
+    } else if (pattern.command == RDIP_DELETE ||
+               pattern.command == RDIP_FRAME) {
+      number = boost::lexical_cast<size_t>(what[1]);
+    } else if (pattern.search) {
+      text = what.suffix();
+    } else if (what.size() == 2) {
+      std::string id = what[1];
+      unsigned object_id = 0;
+      sscanf(id.c_str(), "%x", &object_id);
+      number = object_id;
+    }
+    return GetChecksum(pattern.command, bp, number, text);
+  }
+  return 0;
+}
+
+size_t ParseWithRegex(boost::asio::streambuf& buffer) {
+  std::ostringstream out;
+  out << &buffer;
+  std::string str = out.str();
+  std::vector<std::string> commands;
+  boost::split(commands, str, boost::is_any_of(";"));
+  size_t result = 0;
+  for (const auto& cmd : commands)
+    result += EvaluateWithRegex(boost::trim_copy(cmd));
+  return result;
+}
+
+// The parsing RDIP does now: the command is looked up in the command table
+// RDIP dispatches on, and the arguments are read the way its handlers read
+// them, all on views of the read buffer. Only what the handlers keep is
+// copied.
+size_t EvaluateWithTokenizer(boost::string_ref cmd) {
+  CommandTokenizer args(cmd);
+  RdipCommand command = FindRdipCommand(args.Next());
+  BreakPoint bp;
+  size_t number = 0;
+  std::string text;
+  switch (command) {
+  case RDIP_BREAK:
+    if (!ParseRdipLocation(args.Rest(), bp))
+      return 0;
+    break;
+  case RDIP_DELETE:
+    if (!CommandTokenizer::ParseUnsigned(args.Next(), number) ||
+        !args.AtEnd())
+      return 0;
+    break;
+  case RDIP_FRAME:
+    if (!CommandTokenizer::ParseUnsigned(args.Next(), number))
+      return 0;
+    break;
+  case RDIP_THREAD:
+    if (!CommandTokenizer::IsKeyword(args.Next(), "list", "l"))
+      return 0;
+    break;
+  case RDIP_VAR: {
+    boost::string_ref what = args.Next();
+    if (CommandTokenizer::IsKeyword(what, "inspect", nullptr)) {
+      boost::string_ref expr = args.Rest();
+      text.assign(expr.begin(), expr.end());
+    } else if (CommandTokenizer::IsKeyword(what, "instance", "i")) {
+      if (!CommandTokenizer::ParseUnsigned(args.Rest(), number, 16))
+        return 0;
+    } else if (!CommandTokenizer::IsKeyword(what, "local", "l") &&
+               !CommandTokenizer::IsKeyword(what, "global", "g")) {
+      return 0;
+    }
+    break;
+  }
+  case RDIP_UNKNOWN:
+    return 0;
+  default:
+    // The other commands in the mix take no arguments.
+    break;
+  }
+  return GetChecksum(command, bp, number, text);
+}
+
+size_t ParseWithTokenizer(boost::asio::streambuf& buffer, size_t bytes) {
+  const char* line = boost::asio::buffer_cast<const char*>(buffer.data());
+  boost::string_ref str(line, bytes);
+  size_t result = 0;
+  while (!str.empty()) {
+    size_t sep = str.find(';');
+    boost::string_ref cmd = str.substr(0, sep);
+    result += EvaluateWithTokenizer(CommandTokenizer::Trim(cmd));
+    if (sep == boost::string_ref::npos)
+      break;
+    str.remove_prefix(sep + 1);
+  }
+  buffer.consume(bytes);
+  return result;
+}
+
+size_t CountCommands() {
+  size_t count = 0;
+  for (const char* line : kCommandLines)
+    count += std::count(line, line + strlen(line), ';') + 1;
+  return count;
+}
+
+// Runs the command lines through the parser the given number of times, as if
+// each had just been read from the connection, and returns the nanoseconds
+// taken per command.
+template <typename Parse>
+double TimeParser(size_t iterations, Parse parse, size_t& checksum) {
+  boost::asio::streambuf buffer;
+  std::ostream stream(&buffer);
+  long long start = Clock::NowNanoseconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    for (const char* line : kCommandLines) {
+      stream << line;
+      checksum += parse(buffer);
+    }
+  }
+  long long elapsed = Clock::NowNanoseconds() - start;
+  return static_cast<double>(elapsed) / (iterations * CountCommands());
+}
+
+} // end anonymous namespace
+
+int RunCommandBenchmark(const std::vector<std::string>& args) {
+  size_t iterations = std::max<size_t>(1, GetCountArgument(args, 1, 100000));
+
+  size_t regex_checksum = 0;
+  double regex_ns = TimeParser(iterations,
+      [](boost::asio::streambuf& buffer) {
+        return ParseWithRegex(buffer);
+      }, regex_checksum);
+
+  size_t tokenizer_checksum = 0;
+  double tokenizer_ns = TimeParser(iterations,
+      [](boost::asio::streambuf& buffer) {
+        return ParseWithTokenizer(buffer, buffer.size());
+      }, tokenizer_checksum);
+
+  std::cout << "Commands: " << CountCommands() << " in "
+            << sizeof(kCommandLines) / sizeof(kCommandLines[0])
+            << " lines, " << iterations << " iterations\n"
+            << std::fixed << std::setprecision(1)
+            << "std::regex: " << regex_ns << " ns per command\n"
+            << "Tokenizer:  " << tokenizer_ns << " ns per command\n"
+            << "Speedup:    " << regex_ns / tokenizer_ns << "x\n";
+  // Also keeps the compiler from dropping the parsing.
+  if (regex_checksum != tokenizer_checksum) {
+    std::cout << "The parsers did not agree on the commands\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
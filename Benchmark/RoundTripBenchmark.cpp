@@ -0,0 +1,134 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Benchmark.h"
+
+#include <DebugServer/Clock.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Round trips made before timing starts, so connection setup and first use
+// of the debugger's buffers are not measured.
+const size_t kWarmUpRoundTrips = 10;
+
+// Answered by RDIP on its i/o thread without waiting for Ruby, so a round
+// trip is the transport, the command parsing and the output queue.
+const char kCommand[] = "th l\n";
+const char kReplyEnd[] = "</threads>\n";
+
+template <typename Socket>
+void SetNoDelay(Socket&) {}
+
+void SetNoDelay(boost::asio::ip::tcp::socket& socket) {
+  boost::system::error_code err;
+  socket.set_option(boost::asio::ip::tcp::no_delay(true), err);
+}
+
+double ToMicroseconds(long long ns) {
+  return ns / 1000.0;
+}
+
+template <typename Protocol>
+int TimeRoundTrips(const typename Protocol::endpoint& endpoint,
+                   const std::string& description, size_t count) {
+  boost::asio::io_service service;
+  typename Protocol::socket socket(service);
+  boost::system::error_code err;
+  socket.connect(endpoint, err);
+  if (err) {
+    std::cerr << "Could not connect to " << description << ": "
+              << err.message() << "\n";
+    return EXIT_FAILURE;
+  }
+  SetNoDelay(socket);
+
+  boost::asio::streambuf reply;
+  std::vector<long long> times;
+  times.reserve(count);
+  for (size_t i = 0; i < kWarmUpRoundTrips + count; ++i) {
+    long long start = Clock::NowNanoseconds();
+    boost::asio::write(socket,
+        boost::asio::buffer(kCommand, sizeof(kCommand) - 1), err);
+    size_t bytes = 0;
+    if (!err)
+      bytes = boost::asio::read_until(socket, reply, kReplyEnd, err);
+    if (err) {
+      std::cerr << "Connection to " << description << " failed: "
+                << err.message() << "\n";
+      return EXIT_FAILURE;
+    }
+    reply.consume(bytes);
+    if (i >= kWarmUpRoundTrips)
+      times.push_back(Clock::NowNanoseconds() - start);
+  }
+
+  std::sort(times.begin(), times.end());
+  auto percentile = [&times](size_t percent) {
+    return ToMicroseconds(times[(times.size() - 1) * percent / 100]);
+  };
+  long long total = 0;
+  for (long long time : times)
+    total += time;
+  std::cout << "Round trips: " << count << " over " << description << "\n"
+            << std::fixed << std::setprecision(1)
+            << "Mean: " << ToMicroseconds(total / times.size()) << " us\n"
+            << "p50:  " << percentile(50) << " us\n"
+            << "p90:  " << percentile(90) << " us\n"
+            << "p99:  " << percentile(99) << " us\n"
+            << "Max:  " << ToMicroseconds(times.back()) << " us\n";
+  return EXIT_SUCCESS;
+}
+
+} // end anonymous namespace
+
+int RunRoundTripBenchmark(const std::vector<std::string>& args) {
+  std::string target = args.size() > 1 ? args[1] : "port=1234";
+  size_t count = std::max<size_t>(1, GetCountArgument(args, 2, 10000));
+
+  if (boost::starts_with(target, "socket=")) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    typedef boost::asio::local::stream_protocol Local;
+    std::string path = target.substr(7);
+    return TimeRoundTrips<Local>(Local::endpoint(path), "unix:" + path,
+                                 count);
+#else
+    std::cerr << "Unix domain sockets are not supported here\n";
+    return EXIT_FAILURE;
+#endif
+  }
+
+  unsigned short port = 0;
+  if (boost::starts_with(target, "port=")) {
+    try {
+      port = boost::lexical_cast<unsigned short>(target.substr(5));
+    } catch (const boost::bad_lexical_cast&) {
+    }
+  }
+  if (port == 0) {
+    std::cerr << "Expected port=<port> or socket=<path>, got " << target
+              << "\n";
+    return EXIT_FAILURE;
+  }
+  typedef boost::asio::ip::tcp Tcp;
+  return TimeRoundTrips<Tcp>(
+      Tcp::endpoint(boost::asio::ip::address_v4::loopback(), port),
+      "tcp:" + boost::lexical_cast<std::string>(port), count);
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,214 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Benchmark.h"
+
+#include <DebugServer/Clock.h>
+#include <DebugServer/StackCapture.h>
+
+#include <ruby.h>
+#include <ruby/debug.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+struct StackBenchmark {
+  size_t iterations;
+  bool frames_agree;
+  size_t depth;
+  // Per stop.
+  double inspector_us;
+  double inspector_objects;
+  double top_frame_us;
+  double top_frame_objects;
+  double all_frames_us;
+  double all_frames_objects;
+  double binding_us;
+  double binding_objects;
+};
+
+StackBenchmark g_benchmark;
+
+#if RDEBUGGER_HAS_INTERNAL_EVENTS
+void CountNewObject(VALUE, void* data) {
+  ++*reinterpret_cast<size_t*>(data);
+}
+#endif
+
+// Runs stop the given number of times and returns the microseconds taken
+// per stop. The objects allocated per stop are counted in a second run, as
+// counting them slows Ruby down. Ruby 2.0 cannot count them, they are 0
+// there.
+template <typename Stop>
+void TimeStops(size_t iterations, Stop stop, double& us, double& objects) {
+  long long start = Clock::NowNanoseconds();
+  for (size_t i = 0; i < iterations; ++i)
+    stop();
+  long long elapsed = Clock::NowNanoseconds() - start;
+  us = static_cast<double>(elapsed) / iterations / 1000;
+  objects = 0;
+#if RDEBUGGER_HAS_INTERNAL_EVENTS
+  size_t allocated = 0;
+  VALUE tp = rb_tracepoint_new(Qnil, RUBY_INTERNAL_EVENT_NEWOBJ,
+                               &CountNewObject, &allocated);
+  rb_tracepoint_enable(tp);
+  for (size_t i = 0; i < iterations; ++i)
+    stop();
+  rb_tracepoint_disable(tp);
+  objects = static_cast<double>(allocated) / iterations;
+#endif
+}
+
+// How every stop read the stack before StackCapture, and still does on
+// Ruby 2.0: the debug inspector makes a Location and a Binding for every
+// frame, and the top Location gives the frame shown.
+VALUE ReadWithInspector(const rb_debug_inspector_t* di, void* data) {
+  static const ID id_path = rb_intern("path");
+  static const ID id_label = rb_intern("label");
+  static const ID id_lineno = rb_intern("lineno");
+  auto strings = reinterpret_cast<RubyStringCache*>(data);
+  VALUE bt = rb_debug_inspector_backtrace_locations(di);
+  if (RARRAY_LEN(bt) > 0) {
+    VALUE location = RARRAY_PTR(bt)[0];
+    strings->Intern(rb_funcall(location, id_path, 0));
+    strings->Intern(rb_funcall(location, id_label, 0));
+    rb_funcall(location, id_lineno, 0);
+  }
+  return Qnil;
+}
+
+// The path and line of the frames the debug inspector lists with an iseq,
+// top first: those StackCapture reads. Labels are left out, from Ruby 3.2
+// StackCapture names the frames of blocks after their method.
+VALUE ListRubyFrames(const rb_debug_inspector_t* di, void* data) {
+  static const ID id_path = rb_intern("path");
+  static const ID id_lineno = rb_intern("lineno");
+  auto frames = reinterpret_cast<std::vector<std::string>*>(data);
+  VALUE bt = rb_debug_inspector_backtrace_locations(di);
+  for (long i = 0; i < RARRAY_LEN(bt); ++i) {
+    if (NIL_P(rb_debug_inspector_frame_iseq_get(di, i)))
+      continue;
+    VALUE location = RARRAY_PTR(bt)[i];
+    std::ostringstream os;
+    VALUE path = rb_funcall(location, id_path, 0);
+    os << StringValueCStr(path) << ":"
+       << FIX2INT(rb_funcall(location, id_lineno, 0));
+    frames->push_back(os.str());
+  }
+  return Qnil;
+}
+
+bool CheckFrames(StackCapture& capture, RubyStringCache& strings) {
+  std::vector<std::string> expected;
+  rb_debug_inspector_open(&ListRubyFrames, &expected);
+  size_t depth = capture.Read(nullptr);
+  if (depth == 0 || depth > expected.size())
+    return false;
+  for (size_t i = 0; i < depth; ++i) {
+    CapturedFrame frame = capture.GetFrame(i, strings);
+    std::ostringstream os;
+    os << strings.Get(frame.file) << ":" << frame.line;
+    if (os.str() != expected[i] || NIL_P(capture.GetBinding(i)))
+      return false;
+  }
+  return true;
+}
+
+// Called at the top of the stack built by RunStackBenchmark, like a stop.
+VALUE StopAtDepth(VALUE) {
+  StackBenchmark& b = g_benchmark;
+  RubyStringCache strings;
+  StackCapture capture;
+  b.frames_agree = CheckFrames(capture, strings);
+  b.depth = capture.depth();
+
+  TimeStops(b.iterations, [&strings]() {
+    rb_debug_inspector_open(&ReadWithInspector, &strings);
+  }, b.inspector_us, b.inspector_objects);
+
+  TimeStops(b.iterations, [&capture, &strings]() {
+    capture.Read(nullptr);
+    capture.GetFrame(0, strings);
+  }, b.top_frame_us, b.top_frame_objects);
+
+  TimeStops(b.iterations, [&capture, &strings]() {
+    size_t depth = capture.Read(nullptr);
+    for (size_t i = 0; i < depth; ++i)
+      capture.GetFrame(i, strings);
+  }, b.all_frames_us, b.all_frames_objects);
+
+  TimeStops(b.iterations, [&capture, &strings]() {
+    capture.Read(nullptr);
+    capture.GetFrame(0, strings);
+    capture.GetBinding(1);
+  }, b.binding_us, b.binding_objects);
+
+  capture.Clear();
+  return Qnil;
+}
+
+} // end anonymous namespace
+
+int RunStackBenchmark(const std::vector<std::string>& args) {
+  size_t levels = std::max<size_t>(1, GetCountArgument(args, 1, 100));
+  g_benchmark = StackBenchmark();
+  g_benchmark.iterations = std::max<size_t>(1,
+                                            GetCountArgument(args, 2, 10000));
+
+  RUBY_INIT_STACK;
+  ruby_init();
+  rb_define_global_function("stack_benchmark_stop",
+                            RUBY_METHOD_FUNC(StopAtDepth), 0);
+  // A method and a block per level, with a C function in between.
+  std::ostringstream code;
+  code << "def stack_benchmark_call(n)\n"
+          "  return stack_benchmark_stop if n == 0\n"
+          "  [n].each { |i| stack_benchmark_call(i - 1) }\n"
+          "end\n"
+          "stack_benchmark_call(" << levels << ")\n";
+  int error = 0;
+  rb_eval_string_protect(code.str().c_str(), &error);
+  ruby_cleanup(0);
+  if (error) {
+    std::cout << "The Ruby code of the benchmark failed\n";
+    return EXIT_FAILURE;
+  }
+
+  const StackBenchmark& b = g_benchmark;
+  std::cout << "Ruby frames: " << b.depth << ", " << b.iterations
+            << " stops\n"
+#if !RDEBUGGER_HAS_PROFILE_FRAMES
+            << "Ruby 2.0 has no rb_profile_frames, StackCapture opens the "
+               "debug inspector too\n"
+#endif
+            << std::fixed << std::setprecision(1)
+            << "Debug inspector:       " << b.inspector_us << " us, "
+            << b.inspector_objects << " objects per stop\n"
+            << "Top frame:             " << b.top_frame_us << " us, "
+            << b.top_frame_objects << " objects per stop\n"
+            << "All frames:            " << b.all_frames_us << " us, "
+            << b.all_frames_objects << " objects per stop\n"
+            << "Top frame and binding\n"
+            << "  of its caller:       " << b.binding_us << " us, "
+            << b.binding_objects << " objects per stop\n";
+  if (!b.frames_agree) {
+    std::cout << "StackCapture and the debug inspector did not agree on the "
+                 "frames\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
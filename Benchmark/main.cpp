@@ -0,0 +1,67 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+// Command line tool that times parts of the debugger outside of SketchUp.
+
+#include "./Benchmark.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SketchUp::RubyDebugger;
+
+namespace {
+
+void PrintUsage() {
+  std::cerr <<
+      "Usage: Benchmark <command>\n"
+      "Commands:\n"
+      "  commands [iterations]  Parse RDIP commands with the tokenizer and\n"
+      "                         with std::regex (default 100000)\n"
+      "  roundtrip [port=<port> | socket=<path>] [count]\n"
+      "                         Time command round trips to a debugger\n"
+      "                         started with ide (default port=1234, 10000)\n"
+      "  stack [levels] [stops] Read a Ruby stack at a stop with StackCapture\n"
+      "                         and with the debug inspector (default 100,\n"
+      "                         10000)\n";
+}
+
+} // end anonymous namespace
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+size_t GetCountArgument(const std::vector<std::string>& args, size_t index,
+                        size_t default_value) {
+  if (index >= args.size())
+    return default_value;
+  try {
+    return boost::lexical_cast<size_t>(args[index]);
+  } catch (const boost::bad_lexical_cast&) {
+    return default_value;
+  }
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (args.empty()) {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+  if (args[0] == "commands")
+    return RunCommandBenchmark(args);
+  if (args[0] == "roundtrip")
+    return RunRoundTripBenchmark(args);
+  if (args[0] == "stack")
+    return RunStackBenchmark(args);
+  PrintUsage();
+  return EXIT_FAILURE;
+}
@@ -19,6 +19,35 @@ struct BreakPoint {
   size_t line;
 };
 
+// Stops or logs when a method call takes longer than a threshold. It
+// watches either one method, given as "Class#name" or "Class.name", or
+// every method defined in files under a path prefix.
+struct SlowCallBreakPoint {
+  SlowCallBreakPoint() : index(0), threshold_ms(0), suspend(true) {}
+
+  size_t index;
+  std::string method;
+  std::string path_prefix;
+  unsigned threshold_ms;
+  // Logs the slow call without stopping if false.
+  bool suspend;
+};
+
+// Stops when a variable changes: an instance variable of an object, or a
+// local variable of a stack frame. Locals are watched until their frame
+// returns.
+struct WatchPoint {
+  WatchPoint() : index(0), object_id(0), frame(0) {}
+
+  size_t index;
+  // Variable name, starting with @ for instance variables.
+  std::string variable;
+  // Object of an instance variable, as in Variable::object_id.
+  size_t object_id;
+  // Stack frame of a local, as in IDebugServer::SetActiveFrameIndex.
+  size_t frame;
+};
+
 } // end namespace RubyDebugger
 } // end namespace SketchUp
 
@@ -15,9 +15,12 @@ struct StackFrame {
   std::string name;
   std::string file;
   int line;
-  VALUE binding;
-  VALUE self;
-  VALUE klass;
+  // Identify the frame from one stop to the next, together with its file
+  // and line. level counts from the bottom of the stack, which is where
+  // the frame's control frame sits. iseq stands for the code it runs, and
+  // is nil for frames of the execution history.
+  size_t level;
+  VALUE iseq;
 };
 
 } // end namespace RubyDebugger
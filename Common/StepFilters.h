@@ -0,0 +1,30 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_COMMON_STEPFILTERS_H_
+#define RDEBUGGER_COMMON_STEPFILTERS_H_
+
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Code that stepping and pausing never stop in. Breakpoints still do.
+struct StepFilters {
+  // Globs matched against the whole file path, case insensitive. '*'
+  // matches any run of characters, including '/', and '?' one character.
+  std::vector<std::string> paths;
+  // Classes and modules whose methods are skipped, along with the classes
+  // and modules nested in them, e.g. "Sketchup" also skips
+  // "Sketchup::Http::Request".
+  std::vector<std::string> classes;
+
+  bool empty() const { return paths.empty() && classes.empty(); }
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_COMMON_STEPFILTERS_H_
@@ -0,0 +1,207 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_COMMON_TRACEFORMAT_H_
+#define RDEBUGGER_COMMON_TRACEFORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Layout of execution trace recordings. A recording is a file that the
+// debugger maps into memory:
+//
+//   TraceFileHeader, padded to kTraceHeaderSize
+//   chunk_count chunks of chunk_size bytes, used as a ring
+//   names area of names_size bytes
+//
+// Each chunk starts with a TraceChunkHeader and holds records encoded
+// relative to the chunk's base values, so chunks decode on their own. When
+// the ring is full the oldest chunk is overwritten. A record is a tag byte
+// (event kind, plus kTraceFileChanged), the file id as a varint if it
+// changed, the zigzag varint line delta and the varint time delta in
+// nanoseconds. Depths are implied by the call and return events.
+//
+// The names area holds the file paths, in file id order, each one a varint
+// length followed by the bytes. All integers are little-endian.
+
+const char kTraceMagic[8] = { 'R', 'D', 'T', 'R', 'A', 'C', 'E', '1' };
+const uint32_t kTraceVersion = 1;
+const size_t kTraceHeaderSize = 4096;
+
+// Longest possible record.
+const size_t kTraceMaxRecordSize = 1 + 5 + 5 + 10;
+
+enum TraceEventKind {
+  TRACE_LINE,
+  TRACE_CALL,
+  TRACE_RETURN,
+  TRACE_C_CALL,
+  TRACE_C_RETURN,
+  TRACE_B_CALL,
+  TRACE_B_RETURN,
+  TRACE_CLASS,
+  TRACE_END,
+  TRACE_KIND_COUNT
+};
+
+const uint8_t kTraceKindMask = 0x0f;
+const uint8_t kTraceFileChanged = 0x10;
+
+inline bool IsTraceCall(TraceEventKind kind) {
+  return kind == TRACE_CALL || kind == TRACE_C_CALL || kind == TRACE_B_CALL ||
+         kind == TRACE_CLASS;
+}
+
+inline bool IsTraceReturn(TraceEventKind kind) {
+  return kind == TRACE_RETURN || kind == TRACE_C_RETURN ||
+         kind == TRACE_B_RETURN || kind == TRACE_END;
+}
+
+struct TraceFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t chunk_size;
+  uint64_t chunk_count;
+  uint64_t names_offset;
+  uint64_t names_size;
+  // Bytes of the names area in use.
+  uint64_t names_used;
+  // Sequence number the next chunk gets. Chunk n is stored in ring slot
+  // (n - 1) % chunk_count.
+  uint64_t next_sequence;
+  // Clock of the first record, in nanoseconds.
+  uint64_t start_time;
+};
+
+struct TraceChunkHeader {
+  // Zero while the chunk is unused or being reset.
+  uint64_t sequence;
+  // Values the first record is encoded against.
+  uint64_t base_time;
+  int32_t base_depth;
+  uint32_t base_file;
+  uint32_t base_line;
+  // Bytes of records after the header.
+  uint32_t used;
+};
+
+// One decoded record.
+struct TraceRecord {
+  TraceEventKind kind;
+  uint32_t file;
+  uint32_t line;
+  // Call depth of the frame the event belongs to. Calls count the new
+  // frame. Relative to the start of the recording, so it can get negative
+  // when code returns from frames entered before that.
+  int32_t depth;
+  uint64_t time;
+};
+
+inline uint8_t* WriteTraceVarint(uint8_t* p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = static_cast<uint8_t>(value);
+  return p;
+}
+
+// Returns nullptr if the varint runs past end.
+inline const uint8_t* ReadTraceVarint(const uint8_t* p, const uint8_t* end,
+                                      uint64_t& value) {
+  value = 0;
+  for (int shift = 0; p != end && shift < 64; shift += 7) {
+    uint8_t byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return p;
+  }
+  return nullptr;
+}
+
+inline uint32_t ZigZagEncode(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t ZigZagDecode(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// Decodes the records of one chunk.
+class TraceChunkReader {
+public:
+  // chunk points at the TraceChunkHeader. chunk_size bounds the records
+  // when the used count of a damaged file is too large.
+  TraceChunkReader(const uint8_t* chunk, size_t chunk_size) {
+    std::memcpy(&header_, chunk, sizeof(header_));
+    size_t used = header_.used;
+    if (used > chunk_size - sizeof(header_))
+      used = chunk_size - sizeof(header_);
+    pos_ = chunk + sizeof(header_);
+    end_ = pos_ + used;
+    record_.kind = TRACE_LINE;
+    record_.file = header_.base_file;
+    record_.line = header_.base_line;
+    record_.depth = header_.base_depth;
+    record_.time = header_.base_time;
+    depth_ = header_.base_depth;
+  }
+
+  const TraceChunkHeader& header() const { return header_; }
+
+  // Decodes the next record. Returns false at the end of the chunk or on
+  // malformed data.
+  bool Next(TraceRecord& record) {
+    if (pos_ == end_)
+      return false;
+    uint8_t tag = *pos_++;
+    TraceEventKind kind = static_cast<TraceEventKind>(tag & kTraceKindMask);
+    if (kind >= TRACE_KIND_COUNT)
+      return Fail();
+    uint64_t value;
+    if (tag & kTraceFileChanged) {
+      if ((pos_ = ReadTraceVarint(pos_, end_, value)) == nullptr)
+        return Fail();
+      record_.file = static_cast<uint32_t>(value);
+    }
+    if ((pos_ = ReadTraceVarint(pos_, end_, value)) == nullptr)
+      return Fail();
+    record_.line += ZigZagDecode(static_cast<uint32_t>(value));
+    if ((pos_ = ReadTraceVarint(pos_, end_, value)) == nullptr)
+      return Fail();
+    record_.time += value;
+    record_.kind = kind;
+    if (IsTraceCall(kind)) {
+      record_.depth = ++depth_;
+    } else if (IsTraceReturn(kind)) {
+      record_.depth = depth_--;
+    } else {
+      record_.depth = depth_;
+    }
+    record = record_;
+    return true;
+  }
+
+private:
+  bool Fail() {
+    pos_ = end_;
+    return false;
+  }
+
+  TraceChunkHeader header_;
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  TraceRecord record_;
+  int32_t depth_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_COMMON_TRACEFORMAT_H_
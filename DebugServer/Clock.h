@@ -0,0 +1,54 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_CLOCK_H_
+#define RDEBUGGER_DEBUGSERVER_CLOCK_H_
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Monotonic clock for measuring durations. VS2013's steady_clock is not
+// actually steady, so Windows builds read the performance counter directly.
+class Clock {
+public:
+  // Returns a monotonic time stamp in nanoseconds.
+  static long long NowNanoseconds() {
+#ifdef WIN32
+    static const long long frequency = GetFrequency();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // Split to avoid overflowing the multiplication.
+    long long seconds = counter.QuadPart / frequency;
+    long long remainder = counter.QuadPart % frequency;
+    return seconds * 1000000000LL + remainder * 1000000000LL / frequency;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  static long long NowMilliseconds() {
+    return NowNanoseconds() / 1000000;
+  }
+
+private:
+#ifdef WIN32
+  static long long GetFrequency() {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+  }
+#endif
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_CLOCK_H_
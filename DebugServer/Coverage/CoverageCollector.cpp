@@ -0,0 +1,375 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./CoverageCollector.h"
+
+#include <DebugServer/Log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <regex>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Binary coverage data, all numbers little endian:
+//   char[8]  "RDCOV01\n"
+//   uint32   file count
+// then per file:
+//   uint32   path length, followed by the UTF-8 path
+//   uint32   line count
+//   uint64[] executable line bits, (line count + 63) / 64 words
+//   uint64[] covered line bits, same size
+const char kDataMagic[8] = { 'R', 'D', 'C', 'O', 'V', '0', '1', '\n' };
+
+void WriteUInt(std::ostream& os, uint64_t value, int bytes) {
+  char buf[8];
+  for (int i = 0; i < bytes; ++i) {
+    buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+  os.write(buf, bytes);
+}
+
+bool ReadUInt(std::istream& is, uint64_t& value, int bytes) {
+  unsigned char buf[8];
+  if (!is.read(reinterpret_cast<char*>(buf), bytes))
+    return false;
+  value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(buf[i]) << (8 * i);
+  }
+  return true;
+}
+
+size_t WordCount(size_t line_count) {
+  return (line_count + 63) / 64;
+}
+
+size_t CountBits(uint64_t word) {
+  size_t count = 0;
+  for (; word != 0; word &= word - 1) {
+    ++count;
+  }
+  return count;
+}
+
+// Sets the bits of the lines that emit line events in an instruction
+// sequence array (RubyVM::InstructionSequence#to_a), including nested
+// blocks, methods and classes. Integers in the body are line numbers. Line
+// events show up as "trace 1" instructions up to Ruby 2.4, and as
+// :RUBY_EVENT_LINE entries from Ruby 2.5.
+void CollectExecutableLines(VALUE iseq, LineCoverage& lines);
+
+void CollectNested(VALUE ary, LineCoverage& lines) {
+  for (long i = 0; i < RARRAY_LEN(ary); ++i) {
+    VALUE item = RARRAY_PTR(ary)[i];
+    if (RB_TYPE_P(item, T_ARRAY))
+      CollectExecutableLines(item, lines);
+  }
+}
+
+void CollectExecutableLines(VALUE ary, LineCoverage& lines) {
+  static const ID id_trace = rb_intern("trace");
+  static const ID id_event_line = rb_intern("RUBY_EVENT_LINE");
+
+  long len = RARRAY_LEN(ary);
+  VALUE first = len > 0 ? RARRAY_PTR(ary)[0] : Qnil;
+  bool is_iseq = RB_TYPE_P(first, T_STRING) &&
+      strncmp(RSTRING_PTR(first), "YARVInstructionSequence/",
+              sizeof("YARVInstructionSequence/") - 1) == 0;
+  if (!is_iseq) {
+    CollectNested(ary, lines);
+    return;
+  }
+
+  // The body is the last element, the catch table before it holds the
+  // rescue and ensure sequences.
+  for (long i = 0; i < len - 1; ++i) {
+    VALUE item = RARRAY_PTR(ary)[i];
+    if (RB_TYPE_P(item, T_ARRAY))
+      CollectNested(item, lines);
+  }
+  VALUE body = RARRAY_PTR(ary)[len - 1];
+  if (!RB_TYPE_P(body, T_ARRAY))
+    return;
+  size_t line = 0;
+  for (long i = 0; i < RARRAY_LEN(body); ++i) {
+    VALUE item = RARRAY_PTR(body)[i];
+    bool is_line_event = false;
+    if (FIXNUM_P(item)) {
+      line = FIX2ULONG(item);
+    } else if (SYMBOL_P(item)) {
+      is_line_event = SYM2ID(item) == id_event_line;
+    } else if (RB_TYPE_P(item, T_ARRAY) && RARRAY_LEN(item) > 0) {
+      VALUE insn = RARRAY_PTR(item)[0];
+      is_line_event = SYMBOL_P(insn) && SYM2ID(insn) == id_trace &&
+                      RARRAY_LEN(item) > 1 &&
+                      FIXNUM_P(RARRAY_PTR(item)[1]) &&
+                      (FIX2LONG(RARRAY_PTR(item)[1]) & RUBY_EVENT_LINE);
+      CollectNested(item, lines);
+    }
+    if (is_line_event && line > 0) {
+      lines.Resize(line + 1);
+      lines.executable[line / 64] |= 1ull << (line % 64);
+    }
+  }
+}
+
+struct CompileArgs {
+  VALUE source;
+  VALUE path;
+};
+
+VALUE CompileToArray(VALUE data) {
+  CompileArgs* args = reinterpret_cast<CompileArgs*>(data);
+  static const ID id_compile = rb_intern("compile");
+  static const ID id_to_a = rb_intern("to_a");
+  VALUE iseq_class = rb_path2class("RubyVM::InstructionSequence");
+  VALUE iseq = rb_funcall(iseq_class, id_compile, 4, args->source, args->path,
+                          args->path, INT2FIX(1));
+  return rb_funcall(iseq, id_to_a, 0);
+}
+
+} // end anonymous namespace
+
+void LineCoverage::Resize(size_t lines) {
+  if (lines <= line_count)
+    return;
+  line_count = lines;
+  executable.resize(WordCount(lines));
+  covered.resize(WordCount(lines));
+}
+
+CoverageCollector& CoverageCollector::Instance() {
+  static CoverageCollector collector;
+  return collector;
+}
+
+CoverageCollector::CoverageCollector()
+  : tp_line_(Qnil),
+    script_lines_(Qnil),
+    last_path_(Qnil),
+    last_file_(nullptr),
+    path_values_(Qnil) {
+}
+
+CoverageCollector::~CoverageCollector() {
+}
+
+void CoverageCollector::Start(const std::string& str_options) {
+  if (tp_line_ != Qnil)
+    return;
+
+  std::smatch match;
+  const std::regex reg_lcov("lcov=(\\S+)");
+  if (regex_search(str_options, match, reg_lcov)) {
+    lcov_path_ = match[1];
+  }
+  const std::regex reg_data("data=(\\S+)");
+  if (regex_search(str_options, match, reg_data)) {
+    data_path_ = match[1];
+  }
+
+  // Let Ruby keep the source lines, they size the bitmaps and tell which
+  // lines are executable.
+  script_lines_ = rb_hash_new();
+  rb_define_global_const("SCRIPT_LINES__", script_lines_);
+  path_values_ = rb_ary_new();
+  rb_gc_register_address(&path_values_);
+
+  tp_line_ = rb_tracepoint_new(Qnil, RUBY_EVENT_LINE, &LineEvent, this);
+  rb_tracepoint_enable(tp_line_);
+  rb_set_end_proc(&AtExit, Qnil);
+  Log("Coverage collection started\n");
+}
+
+void CoverageCollector::Stop() {
+  if (tp_line_ == Qnil)
+    return;
+  rb_tracepoint_disable(tp_line_);
+  tp_line_ = Qnil;
+  Log("Coverage collection stopped\n");
+}
+
+CoverageCollector::File* CoverageCollector::FindFile(VALUE path) {
+  auto it = files_by_path_.find(path);
+  if (it != files_by_path_.end())
+    return it->second;
+
+  // Different sequences of the same file may have their own path strings.
+  std::string str_path = NIL_P(path) ? std::string() :
+      std::string(RSTRING_PTR(path), RSTRING_LEN(path));
+  uint32_t id = paths_.Intern(str_path);
+  if (id == files_.size()) {
+    files_.push_back(std::unique_ptr<File>(new File));
+    if (!NIL_P(path))
+      AnalyzeFile(*files_.back(), path);
+  }
+  File* file = files_[id].get();
+  files_by_path_.insert(std::make_pair(path, file));
+  rb_ary_push(path_values_, path);
+  return file;
+}
+
+void CoverageCollector::AnalyzeFile(File& file, VALUE path) {
+  VALUE source_lines = rb_hash_lookup(script_lines_, path);
+  if (!RB_TYPE_P(source_lines, T_ARRAY))
+    return; // eval'd code, or loaded before coverage started
+  file.lines.Resize(RARRAY_LEN(source_lines) + 1);
+
+  CompileArgs args;
+  args.source = rb_ary_join(source_lines, rb_str_new("", 0));
+  args.path = path;
+  int state = 0;
+  VALUE iseq = rb_protect(&CompileToArray, reinterpret_cast<VALUE>(&args),
+                          &state);
+  if (state != 0) {
+    rb_set_errinfo(Qnil);
+    return;
+  }
+  CollectExecutableLines(iseq, file.lines);
+  for (size_t i = 0; i < file.lines.executable.size(); ++i) {
+    file.remaining += CountBits(file.lines.executable[i]);
+  }
+}
+
+void CoverageCollector::Cover(File& file, size_t line) {
+  LineCoverage& lines = file.lines;
+  lines.Resize(line + 1);
+  uint64_t& word = lines.covered[line / 64];
+  uint64_t bit = 1ull << (line % 64);
+  if (word & bit)
+    return;
+  word |= bit;
+  if ((lines.executable[line / 64] & bit) && --file.remaining == 0)
+    file.is_complete = true;
+}
+
+void CoverageCollector::LineEvent(VALUE tp_val, void* data) {
+  CoverageCollector* collector = reinterpret_cast<CoverageCollector*>(data);
+  rb_trace_arg_t* trace_arg = rb_tracearg_from_tracepoint(tp_val);
+  VALUE path = rb_tracearg_path(trace_arg);
+  File* file;
+  if (path == collector->last_path_) {
+    file = collector->last_file_;
+  } else {
+    file = collector->FindFile(path);
+    collector->last_path_ = path;
+    collector->last_file_ = file;
+  }
+  if (file->is_complete)
+    return;
+  collector->Cover(*file, FIX2ULONG(rb_tracearg_lineno(trace_arg)));
+}
+
+void CoverageCollector::GetCoverage(CoverageMap& coverage) const {
+  for (uint32_t id = 0; id < files_.size(); ++id) {
+    const std::string& path = paths_.Get(id);
+    if (!path.empty())
+      coverage[path] = files_[id]->lines;
+  }
+}
+
+bool CoverageCollector::ReadData(const std::string& path,
+                                 CoverageMap& coverage) {
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kDataMagic)];
+  if (!file.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), kDataMagic))
+    return false;
+  uint64_t file_count;
+  if (!ReadUInt(file, file_count, 4))
+    return false;
+  for (uint64_t i = 0; i < file_count; ++i) {
+    uint64_t path_length, line_count;
+    if (!ReadUInt(file, path_length, 4))
+      return false;
+    std::string file_path(static_cast<size_t>(path_length), '\0');
+    if (!file.read(&file_path[0], path_length) ||
+        !ReadUInt(file, line_count, 4))
+      return false;
+    LineCoverage& lines = coverage[file_path];
+    lines.Resize(static_cast<size_t>(line_count));
+    const size_t words = WordCount(static_cast<size_t>(line_count));
+    std::vector<uint64_t>* bitmaps[] = { &lines.executable, &lines.covered };
+    for (int b = 0; b < 2; ++b) {
+      for (size_t w = 0; w < words; ++w) {
+        uint64_t word;
+        if (!ReadUInt(file, word, 8))
+          return false;
+        (*bitmaps[b])[w] |= word;
+      }
+    }
+  }
+  return true;
+}
+
+bool CoverageCollector::WriteData(const std::string& path,
+                                  const CoverageMap& coverage) {
+  std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+  if (!file)
+    return false;
+  file.write(kDataMagic, sizeof(kDataMagic));
+  WriteUInt(file, coverage.size(), 4);
+  for (auto it = coverage.cbegin(), ite = coverage.cend(); it != ite; ++it) {
+    const LineCoverage& lines = it->second;
+    WriteUInt(file, it->first.size(), 4);
+    file.write(it->first.data(), it->first.size());
+    WriteUInt(file, lines.line_count, 4);
+    for (size_t w = 0; w < lines.executable.size(); ++w) {
+      WriteUInt(file, lines.executable[w], 8);
+    }
+    for (size_t w = 0; w < lines.covered.size(); ++w) {
+      WriteUInt(file, lines.covered[w], 8);
+    }
+  }
+  return file.good();
+}
+
+bool CoverageCollector::WriteLcov(const std::string& path,
+                                  const CoverageMap& coverage) {
+  std::ofstream file(path.c_str());
+  if (!file)
+    return false;
+  file << "TN:\n";
+  for (auto it = coverage.cbegin(), ite = coverage.cend(); it != ite; ++it) {
+    const LineCoverage& lines = it->second;
+    size_t found = 0, hit = 0;
+    file << "SF:" << it->first << "\n";
+    for (size_t line = 1; line < lines.line_count; ++line) {
+      bool is_covered = lines.Test(lines.covered, line);
+      // Without instructions to go by, covered lines are all we know of.
+      if (!is_covered && !lines.Test(lines.executable, line))
+        continue;
+      // Only whether a line ran is recorded, not how often.
+      file << "DA:" << line << "," << (is_covered ? 1 : 0) << "\n";
+      ++found;
+      if (is_covered)
+        ++hit;
+    }
+    file << "LF:" << found << "\nLH:" << hit << "\nend_of_record\n";
+  }
+  return file.good();
+}
+
+void CoverageCollector::AtExit(VALUE data) {
+  CoverageCollector& collector = Instance();
+  collector.Stop();
+  CoverageMap coverage;
+  collector.GetCoverage(coverage);
+  if (!collector.data_path_.empty()) {
+    ReadData(collector.data_path_, coverage); // Previous runs, if any
+    if (!WriteData(collector.data_path_, coverage))
+      Log("Could not write coverage data\n");
+  }
+  if (!collector.lcov_path_.empty() &&
+      !WriteLcov(collector.lcov_path_, coverage))
+    Log("Could not write lcov file\n");
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
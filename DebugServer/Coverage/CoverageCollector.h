@@ -0,0 +1,107 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_COVERAGE_COVERAGECOLLECTOR_H_
+#define RDEBUGGER_DEBUGSERVER_COVERAGE_COVERAGECOLLECTOR_H_
+
+#include <DebugServer/Profiler/StringTable.h>
+
+#include <ruby/ruby.h>
+#include <ruby/debug.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Line bitmaps of one source file.
+struct LineCoverage {
+  LineCoverage() : line_count(0) {}
+
+  bool Test(const std::vector<uint64_t>& bits, size_t line) const {
+    return line < line_count && (bits[line / 64] >> (line % 64)) & 1;
+  }
+
+  void Resize(size_t lines);
+
+  size_t line_count;
+  // Lines that emit line events, if known. Indexed by line number.
+  std::vector<uint64_t> executable;
+  // Lines that have run.
+  std::vector<uint64_t> covered;
+};
+
+// Coverage data keyed by file path.
+typedef std::map<std::string, LineCoverage> CoverageMap;
+
+// Line coverage collected with a line TracePoint, without a debugger UI.
+// Every file gets a bitmap of covered lines, sized from SCRIPT_LINES__, and
+// a bitmap of executable lines taken from its compiled instructions. Once
+// all executable lines of a file have run, its events return right after
+// the file lookup.
+class CoverageCollector {
+public:
+  static CoverageCollector& Instance();
+
+  // Starts collecting. Options are read from the debugger init string:
+  // lcov=<lcov file written at exit>, data=<binary file merged with the
+  // previous run's data at exit>. Must be called on the Ruby thread, before
+  // the code to cover is loaded.
+  void Start(const std::string& str_options);
+
+  void Stop();
+
+  // Returns the coverage collected so far.
+  void GetCoverage(CoverageMap& coverage) const;
+
+  // Merges coverage from a binary data file. Returns false if the file
+  // cannot be read or is not a coverage file.
+  static bool ReadData(const std::string& path, CoverageMap& coverage);
+
+  static bool WriteData(const std::string& path, const CoverageMap& coverage);
+
+  static bool WriteLcov(const std::string& path, const CoverageMap& coverage);
+
+private:
+  struct File {
+    File() : remaining(0), is_complete(false) {}
+    LineCoverage lines;
+    // Executable lines not covered yet.
+    size_t remaining;
+    bool is_complete;
+  };
+
+  CoverageCollector();
+  ~CoverageCollector();
+
+  File* FindFile(VALUE path);
+  void AnalyzeFile(File& file, VALUE path);
+  void Cover(File& file, size_t line);
+
+  static void LineEvent(VALUE tp_val, void* data);
+  static void AtExit(VALUE data);
+
+  VALUE tp_line_;
+  VALUE script_lines_;
+  std::string lcov_path_;
+  std::string data_path_;
+
+  StringTable paths_;
+  // Indexed by path id.
+  std::vector<std::unique_ptr<File>> files_;
+  std::unordered_map<VALUE, File*> files_by_path_;
+  VALUE last_path_;
+  File* last_file_;
+  // Keeps the path strings used as keys alive.
+  VALUE path_values_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_COVERAGE_COVERAGECOLLECTOR_H_
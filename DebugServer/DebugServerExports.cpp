@@ -9,6 +9,9 @@
 #include <DebugServer/UI/Console/Win/ConsoleUI.h>
 #endif
 
+#include <DebugServer/Coverage/CoverageCollector.h>
+#include <DebugServer/Profiler/SamplingProfiler.h>
+#include <DebugServer/UI/DAP/DAP.h>
 #include <DebugServer/UI/RDIP/RDIP.h>
 
 #include <boost/algorithm/string.hpp>
@@ -19,12 +22,26 @@ bool InitDebugger(const char* debugger) {
   std::unique_ptr<IDebuggerUI> ui;
 
   std::string str_debugger(debugger);
+
+  // The profiler and coverage collector run on their own, without a
+  // debugger UI.
+  if (boost::istarts_with(str_debugger, "profile")) {
+    SamplingProfiler::Instance().Start(str_debugger);
+    return true;
+  }
+  if (boost::istarts_with(str_debugger, "coverage")) {
+    CoverageCollector::Instance().Start(str_debugger);
+    return true;
+  }
+
   if (boost::iequals(str_debugger, "console")) {
 #ifdef WIN32
     ui.reset(new ConsoleUI);
 #endif
   } else if(boost::istarts_with(str_debugger, "ide")) {
       ui.reset(new RDIP);
+  } else if(boost::istarts_with(str_debugger, "dap")) {
+      ui.reset(new DAP);
   }
 
   if (ui) {
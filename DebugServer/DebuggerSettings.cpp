@@ -45,10 +45,27 @@ static void Load(const ptree& pt, BreakPoint& bp) {
   bp.enabled = pt.get<bool>("enabled");
 }
 
+// Reads the whole settings file so that saving one kind of setting keeps
+// the others. Leaves pt empty if there is no file yet.
+static void ReadAll(ptree& pt) {
+  try {
+    read_xml(GetFilePath(), pt);
+  } catch (const std::exception&) {
+    pt.clear();
+  }
+}
+
+// Replaces all children of pt called key with value.
+static void Replace(ptree& pt, const std::string& key, const ptree& value) {
+  pt.erase(key);
+  pt.push_back(ptree::value_type(key, value));
+}
+
 void SaveBreakPoints(const BreakPointsMap& resolved_bps,
                      const std::vector<BreakPoint>& unresolved_pbs) {
   try {
     ptree pt_all;
+    ReadAll(pt_all);
 
     // Resolved breakpoints
     ptree pt_res;
@@ -62,7 +79,7 @@ void SaveBreakPoints(const BreakPointsMap& resolved_bps,
         pt_res.push_back(ptree::value_type("breakpoint", pt));
       }
     }
-    pt_all.push_back(ptree::value_type("resolved_breakpoints", pt_res));
+    Replace(pt_all, "resolved_breakpoints", pt_res);
 
     // Unresolved breakpoints
     ptree pt_unres;
@@ -73,7 +90,7 @@ void SaveBreakPoints(const BreakPointsMap& resolved_bps,
       Save(bp, pt);
       pt_unres.push_back(ptree::value_type("breakpoint", pt));
     }
-    pt_all.push_back(ptree::value_type("unresolved_breakpoints", pt_unres));
+    Replace(pt_all, "unresolved_breakpoints", pt_unres);
     
     std::string file_path = GetFilePath();
     write_xml(file_path, pt_all);
@@ -123,6 +140,46 @@ void LoadBreakPoints(BreakPointsMap& resolved_bps,
   }
 }
 
+void SaveStepFilters(const StepFilters& filters) {
+  try {
+    ptree pt_all;
+    ReadAll(pt_all);
+
+    ptree pt_filters;
+    for (auto it = filters.paths.cbegin(), ite = filters.paths.cend();
+         it != ite; ++it) {
+      pt_filters.add("path", *it);
+    }
+    for (auto it = filters.classes.cbegin(), ite = filters.classes.cend();
+         it != ite; ++it) {
+      pt_filters.add("class", *it);
+    }
+    Replace(pt_all, "step_filters", pt_filters);
+
+    std::string file_path = GetFilePath();
+    write_xml(file_path, pt_all);
+  } catch (const std::exception&) {
+  }
+}
+
+void LoadStepFilters(StepFilters& filters) {
+  filters.paths.clear();
+  filters.classes.clear();
+
+  ptree pt;
+  ReadAll(pt);
+  auto it = pt.find("step_filters");
+  if (it == pt.not_found())
+    return;
+  for (auto it2 = it->second.begin(), it2e = it->second.end(); it2 != it2e;
+       ++it2) {
+    if (it2->first == "path")
+      filters.paths.push_back(it2->second.data());
+    else if (it2->first == "class")
+      filters.classes.push_back(it2->second.data());
+  }
+}
+
 } // end namespace Settings
 } // end namespace RubyDebugger
 } // end namespace SketchUp
@@ -6,6 +6,7 @@
 #define RDEBUGGER_DEBUGSERVER_DEBUGGERSETTINGS_H_
 
 #include <Common/BreakPoint.h>
+#include <Common/StepFilters.h>
 
 #include <map>
 #include <vector>
@@ -40,6 +41,12 @@ void LoadBreakPoints(BreakPointsMap& resolved_bps,
                      std::vector<BreakPoint>& unresolved_pbs,
                      size_t& last_breakpoint_index);
 
+// Saves the step filters to the settings file, next to the breakpoints.
+void SaveStepFilters(const StepFilters& filters);
+
+// Loads step filters from the settings file.
+void LoadStepFilters(StepFilters& filters);
+
 } // end namespace Settings
 } // end namespace RubyDebugger
 } // end namespace SketchUp
@@ -13,6 +13,9 @@ namespace RubyDebugger {
 
 // Forward declarations
 struct BreakPoint;
+struct SlowCallBreakPoint;
+struct WatchPoint;
+struct StepFilters;
 struct StackFrame;
 
 // Information about a local or global variable
@@ -26,13 +29,96 @@ struct Variable {
   size_t object_id;
 };
 
+// Moves through the execution history while stopped. Backward moves look
+// at lines that already ran, forward moves go back towards the line where
+// Ruby is stopped.
+enum HistoryMove {
+  HISTORY_STEP_BACK,        // Previous line of the same or a calling frame
+  HISTORY_REVERSE_CONTINUE, // Previous line with a breakpoint
+  HISTORY_STEP,             // Next line
+  HISTORY_STEP_OVER,        // Next line of the same or a calling frame
+  HISTORY_STEP_OUT,         // Next line of a calling frame
+  HISTORY_CONTINUE          // Next line with a breakpoint
+};
+
 // Interface to the debugger server.
 class IDebugServer {
 public:
 
-  // Stops the server
+  // Called by the UI when the client ends the session. Tracing is switched
+  // off at the next safe point on the Ruby thread, as for Detach, but the
+  // breakpoints are kept. Can be called from any thread.
   virtual void Stop() = 0;
 
+  // Called by the UI when a client connects. Tracing is switched on at the
+  // next safe point on the Ruby thread. Can be called from any thread.
+  virtual void Attach() = 0;
+
+  // Called by the UI when the client disconnects. Breakpoints and pending
+  // steps are dropped and tracing is switched off at the next safe point on
+  // the Ruby thread. Can be called from any thread.
+  virtual void Detach() = 0;
+
+  // Returns true if a client is attached.
+  virtual bool IsAttached() const = 0;
+
+  // Starts the line profiler at the next safe point on the Ruby thread.
+  // Can be called from any thread.
+  virtual void StartProfiling() = 0;
+
+  // Stops the line profiler and writes its report to the given path. The
+  // UI gets an IDebuggerUI::Message once the report is written. Can be
+  // called from any thread.
+  virtual void StopProfiling(const std::string& report_path) = 0;
+
+  // Starts counting allocations per site at the next safe point on the Ruby
+  // thread. Needs Ruby 2.1 or later. Can be called from any thread.
+  virtual void StartAllocationTracking() = 0;
+
+  // Stops counting allocations. The counts stay available for reports. Can
+  // be called from any thread.
+  virtual void StopAllocationTracking() = 0;
+
+  // Starts a new allocation measurement period. Can be called from any
+  // thread.
+  virtual void MarkAllocations() = 0;
+
+  // Returns the top allocation sites since the last mark, with their live
+  // object deltas. Can be called from any thread, Ruby keeps running.
+  virtual std::string GetAllocationReport(size_t max_sites) const = 0;
+
+  // Writes the allocation report to a file. Returns false on failure.
+  virtual bool WriteAllocationReport(const std::string& path,
+                                     size_t max_sites) const = 0;
+
+  // Starts timing garbage collections at the next safe point on the Ruby
+  // thread. Needs Ruby 2.1 or later. Can be called from any thread.
+  virtual void StartGcMonitoring() = 0;
+
+  // Stops timing garbage collections. Can be called from any thread.
+  virtual void StopGcMonitoring() = 0;
+
+  // Drops the GC and stack read statistics collected so far. Can be called
+  // from any thread.
+  virtual void ResetGcStats() = 0;
+
+  // Returns GC mark and sweep statistics, and the time spent reading stack
+  // frames at stops. Can be called from any thread.
+  virtual std::string GetGcStats() const = 0;
+
+  // Starts recording line, call and return events into a memory-mapped
+  // ring file of about size_mb megabytes, at the next safe point on the
+  // Ruby thread. The file keeps the latest events. Can be called from any
+  // thread.
+  virtual void StartRecording(const std::string& path, size_t size_mb) = 0;
+
+  // Stops recording and closes the file. Can be called from any thread.
+  virtual void StopRecording() = 0;
+
+  // Writes the recorded events to disk without stopping. Can be called from
+  // any thread.
+  virtual void FlushRecording() = 0;
+
   // Adds the given breakpoint. Returns true on success.
   virtual bool AddBreakPoint(BreakPoint& bp, bool assume_resolved = false) = 0;
 
@@ -42,6 +128,36 @@ public:
   // Returns all breakpoints.
   virtual std::vector<BreakPoint> GetBreakPoints() const = 0;
 
+  // Adds a breakpoint that is deleted when it is first hit. With run_to, it
+  // is also deleted when execution stops anywhere else first, and reaching
+  // it is reported as a suspension rather than a breakpoint hit. Temporary
+  // breakpoints are not saved. Returns true on success.
+  virtual bool AddTemporaryBreakPoint(BreakPoint& bp, bool run_to) = 0;
+
+  // Adds a breakpoint that fires when a method call runs longer than its
+  // threshold. It shares the index space of line breakpoints and is removed
+  // with RemoveBreakPoint. Returns true on success.
+  virtual bool AddSlowCallBreakPoint(SlowCallBreakPoint& bp) = 0;
+
+  // Returns all slow-call breakpoints.
+  virtual std::vector<SlowCallBreakPoint> GetSlowCallBreakPoints() const = 0;
+
+  // Adds a watchpoint that stops at the next line after its variable
+  // changes. It shares the index space of line breakpoints and is removed
+  // with RemoveBreakPoint. Must be called on the Ruby thread while stopped.
+  // Returns false if the variable does not exist, or if it is a local and
+  // Ruby is older than 2.1.
+  virtual bool AddWatchPoint(WatchPoint& wp) = 0;
+
+  // Returns all watchpoints.
+  virtual std::vector<WatchPoint> GetWatchPoints() const = 0;
+
+  // Replaces the step filters, which keep stepping and pausing out of the
+  // matching code. They are saved with the settings.
+  virtual void SetStepFilters(const StepFilters& filters) = 0;
+
+  virtual StepFilters GetStepFilters() const = 0;
+
   // Returns true if SketchUp has stopped and waiting for the debugger.
   // Returns false if it is running.
   virtual bool IsStopped() const = 0;
@@ -49,8 +165,28 @@ public:
   // Evaluates the given Ruby expression and returns the result as a string.
   virtual Variable EvaluateExpression(const std::string& expr) = 0;
 
-  // Returns current stack frames. Execution must have stopped.
-  virtual std::vector<StackFrame> GetStackFrames() const = 0;
+  // Returns levels stack frames from start_frame, or all the frames below it
+  // if levels is 0. Only the top frame is read when execution stops, the
+  // others are read from the Ruby stack the first time they are asked for,
+  // which must be done on the Ruby thread. Execution must have stopped.
+  virtual std::vector<StackFrame> GetStackFrames(size_t start_frame = 0,
+                                                 size_t levels = 0) const = 0;
+
+  // Returns the number of stack frames. Can be called from any thread.
+  // Execution must have stopped.
+  virtual size_t GetStackDepth() const = 0;
+
+  // Returns an id for the current stop, which changes every time execution
+  // stops. Can be called from any thread.
+  virtual size_t GetStopId() const = 0;
+
+  // Returns the frames of the current stop from the top down to the first
+  // one the client already has from stop known_stop_id, and sets unchanged
+  // to the number of frames below them. known_stop_id must be the last stop
+  // whose frames were returned here, otherwise all frames are returned.
+  // Must be called on the Ruby thread. Execution must have stopped.
+  virtual std::vector<StackFrame> GetStackFrameChanges(size_t known_stop_id,
+                                                       size_t& unchanged) = 0;
 
   // Shifts the active stack frame index up/down by one.
   virtual void ShiftActiveFrame(bool shift_up) = 0;
@@ -70,6 +206,38 @@ public:
   // Steps execution out of the current method.
   virtual void StepOut() = 0;
 
+  // Steps into or over methods count times, or until the Ruby expression
+  // until is true at the line reached, or both, whichever comes first. The
+  // lines in between are run without stopping and only the last one is
+  // reported through IDebuggerUI::Break. A breakpoint or pause ends it
+  // early. With trace, the lines passed are sent as an IDebuggerUI::Message
+  // before the stop. Execution must have stopped.
+  virtual void StepRepeatedly(bool step_over, size_t count,
+                              const std::string& until, bool trace) = 0;
+
+  // Moves the position shown to the client through the recent execution
+  // history, without running Ruby code. Stack frames, local variables and
+  // code lines then describe that position, until a forward move gets back
+  // to where Ruby is stopped. breakpoint_index is set if the new position
+  // has a breakpoint. Returns false if there is nowhere to move. Execution
+  // must have stopped.
+  virtual bool MoveInHistory(HistoryMove move, size_t& breakpoint_index) = 0;
+
+  // Returns true while the client is shown a position from the history
+  // rather than where Ruby is stopped. Step and continue commands must then
+  // go through MoveInHistory.
+  virtual bool IsInHistory() const = 0;
+
+  // Returns true if the execution history is kept, which the history=<lines>
+  // option turns on.
+  virtual bool HasHistory() const = 0;
+
+  // Suspends running Ruby code at the next line it executes. The UI is
+  // notified through IDebuggerUI::Break. Returns false if there is nothing to
+  // pause, because no client is attached or Ruby is already stopped. Can be
+  // called from any thread.
+  virtual bool Pause() = 0;
+
   // Returns the code lines around the current line. Execution must have stopped.
   virtual std::vector<std::pair<size_t, std::string>>
       GetCodeLines(size_t beg_line, size_t end_line) const = 0;
@@ -80,14 +248,21 @@ public:
   // Data structure to return Ruby variables.
   typedef std::vector<Variable> VariablesVector;
 
+  // The variable getters return count variables from start, or all the
+  // variables from start if count is 0. Only those are evaluated.
+
   // Returns a list of global variables
-  virtual VariablesVector GetGlobalVariables() const = 0;
+  virtual VariablesVector GetGlobalVariables(size_t start = 0,
+                                             size_t count = 0) const = 0;
 
   // Returns a list of local variables. Execution must have stopped.
-  virtual VariablesVector GetLocalVariables() const = 0;
+  virtual VariablesVector GetLocalVariables(size_t start = 0,
+                                            size_t count = 0) const = 0;
 
   // Returns the instance variables of a given object
-  virtual VariablesVector GetInstanceVariables(size_t object_id) const = 0;
+  virtual VariablesVector GetInstanceVariables(size_t object_id,
+                                               size_t start = 0,
+                                               size_t count = 0) const = 0;
 };
 
 } // end namespace RubyDebugger
@@ -0,0 +1,333 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./AllocationTracker.h"
+
+#include <DebugServer/Log.h>
+#include <DebugServer/RubyFeatures.h>
+
+#include <ruby/debug.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Number of sites the table can hold. Allocations at further sites are
+// counted as lost.
+const uint32_t kCapacity = 1 << 15;
+
+// Probes before an insertion gives up.
+const uint32_t kMaxProbes = 64;
+
+// Size of the live object table, and the number of objects it takes before
+// further ones are left untracked. Probe sequences stay short below 3/4 full.
+const uint32_t kLiveCapacity = 1 << 20;
+const uint32_t kMaxLiveObjects = kLiveCapacity / 4 * 3;
+
+inline uint32_t HashObject(VALUE obj) {
+  // Objects are at least 8 byte aligned.
+  uint64_t key = static_cast<uint64_t>(obj) >> 3;
+  return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+struct SiteOrder {
+  bool operator()(const AllocationTracker::Site& a,
+                  const AllocationTracker::Site& b) const {
+    return a.allocated > b.allocated;
+  }
+};
+
+} // end anonymous namespace
+
+AllocationTracker::AllocationTracker()
+  : tp_newobj_(Qnil),
+    tp_freeobj_(Qnil),
+    lost_(0),
+    live_count_(0),
+    untracked_(0),
+    key_marker_(Qnil) {
+}
+
+AllocationTracker::~AllocationTracker() {
+}
+
+bool AllocationTracker::IsSupported() {
+  return RDEBUGGER_HAS_INTERNAL_EVENTS != 0;
+}
+
+#if RDEBUGGER_HAS_INTERNAL_EVENTS
+
+void AllocationTracker::Start() {
+  if (tp_newobj_ != Qnil)
+    return;
+  if (!slots_) {
+    slots_.reset(new Slot[kCapacity]);
+    live_.reset(new LiveObject[kLiveCapacity]);
+    key_marker_ = Data_Wrap_Struct(0, &MarkKeys, nullptr, this);
+    rb_gc_register_address(&key_marker_);
+  }
+  for (uint32_t i = 0; i < kCapacity; ++i) {
+    Slot& slot = slots_[i];
+    slot.used = false;
+    slot.allocated = 0;
+    slot.freed = 0;
+    slot.mark_allocated = 0;
+    slot.mark_freed = 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(names_mutex_);
+    names_.assign(kCapacity, SiteName());
+  }
+  lost_ = 0;
+  untracked_ = 0;
+  ClearLiveObjects();
+  unresolved_.clear();
+
+  tp_newobj_ = rb_tracepoint_new(0, RUBY_INTERNAL_EVENT_NEWOBJ, &NewObjEvent,
+                                 this);
+  rb_tracepoint_enable(tp_newobj_);
+  tp_freeobj_ = rb_tracepoint_new(0, RUBY_INTERNAL_EVENT_FREEOBJ,
+                                  &FreeObjEvent, this);
+  rb_tracepoint_enable(tp_freeobj_);
+  Log("Allocation tracking started\n");
+}
+
+void AllocationTracker::Stop() {
+  if (tp_newobj_ == Qnil)
+    return;
+  rb_tracepoint_disable(tp_newobj_);
+  rb_tracepoint_disable(tp_freeobj_);
+  tp_newobj_ = Qnil;
+  tp_freeobj_ = Qnil;
+  ClearLiveObjects();
+  ResolveNames();
+  Log("Allocation tracking stopped\n");
+}
+
+AllocationTracker::Slot* AllocationTracker::FindOrAddSlot(VALUE path,
+                                                          unsigned line,
+                                                          VALUE klass) {
+  size_t hash = (static_cast<size_t>(path) >> 3) * 31 +
+                (static_cast<size_t>(klass) >> 3) * 17 + line;
+  for (uint32_t probe = 0; probe < kMaxProbes; ++probe) {
+    uint32_t index = (hash + probe) & (kCapacity - 1);
+    Slot& slot = slots_[index];
+    if (!slot.used.load(std::memory_order_relaxed)) {
+      slot.path = path;
+      slot.klass = klass;
+      slot.line = line;
+      // Readers only look at the key once they see the flag.
+      slot.used.store(true, std::memory_order_release);
+      unresolved_.push_back(index);
+      rb_postponed_job_register_one(0, &ResolveNamesJob, this);
+      return &slot;
+    }
+    if (slot.path == path && slot.klass == klass && slot.line == line)
+      return &slot;
+  }
+  return nullptr;
+}
+
+// Called for every new object. Must not allocate Ruby objects.
+void AllocationTracker::NewObjEvent(VALUE tp_val, void* data) {
+  AllocationTracker* tracker = reinterpret_cast<AllocationTracker*>(data);
+  rb_trace_arg_t* trace_arg = rb_tracearg_from_tracepoint(tp_val);
+  VALUE obj = rb_tracearg_object(trace_arg);
+  VALUE klass = RBASIC(obj)->klass;
+  if (klass == 0)
+    return; // Hidden internal object
+  VALUE path = rb_tracearg_path(trace_arg);
+  unsigned line = NIL_P(path) ? 0 : FIX2UINT(rb_tracearg_lineno(trace_arg));
+  Slot* slot = tracker->FindOrAddSlot(path, line, klass);
+  if (slot == nullptr) {
+    tracker->lost_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  slot->allocated.fetch_add(1, std::memory_order_relaxed);
+  tracker->AddLiveObject(obj,
+                         static_cast<uint32_t>(slot - &tracker->slots_[0]));
+}
+
+// Called during GC for every freed object. Must not allocate Ruby objects.
+void AllocationTracker::FreeObjEvent(VALUE tp_val, void* data) {
+  AllocationTracker* tracker = reinterpret_cast<AllocationTracker*>(data);
+  rb_trace_arg_t* trace_arg = rb_tracearg_from_tracepoint(tp_val);
+  LiveObject* entry = tracker->FindLiveObject(rb_tracearg_object(trace_arg));
+  if (entry == nullptr)
+    return; // Allocated before tracking started
+  tracker->slots_[entry->slot].freed.fetch_add(1, std::memory_order_relaxed);
+  tracker->RemoveLiveObject(entry);
+}
+
+void AllocationTracker::AddLiveObject(VALUE obj, uint32_t slot) {
+  if (live_count_ >= kMaxLiveObjects) {
+    untracked_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  uint32_t index = HashObject(obj) & (kLiveCapacity - 1);
+  // The address of a freed object can be reused, but its entry is gone by
+  // then, so an empty entry always comes first.
+  while (live_[index].obj != 0)
+    index = (index + 1) & (kLiveCapacity - 1);
+  live_[index].obj = obj;
+  live_[index].slot = slot;
+  ++live_count_;
+}
+
+AllocationTracker::LiveObject* AllocationTracker::FindLiveObject(VALUE obj) {
+  uint32_t index = HashObject(obj) & (kLiveCapacity - 1);
+  while (live_[index].obj != 0) {
+    if (live_[index].obj == obj)
+      return &live_[index];
+    index = (index + 1) & (kLiveCapacity - 1);
+  }
+  return nullptr;
+}
+
+// Moves later entries of the probe sequence back into the gap, so lookups
+// never need to skip deleted entries.
+void AllocationTracker::RemoveLiveObject(LiveObject* entry) {
+  uint32_t gap = static_cast<uint32_t>(entry - &live_[0]);
+  uint32_t index = gap;
+  while (true) {
+    index = (index + 1) & (kLiveCapacity - 1);
+    if (live_[index].obj == 0)
+      break;
+    uint32_t home = HashObject(live_[index].obj) & (kLiveCapacity - 1);
+    // The entry can move if its home is not in (gap, index], cyclically.
+    bool stays = gap <= index ? (gap < home && home <= index) :
+                                (gap < home || home <= index);
+    if (!stays) {
+      live_[gap] = live_[index];
+      gap = index;
+    }
+  }
+  live_[gap].obj = 0;
+  --live_count_;
+}
+
+void AllocationTracker::ClearLiveObjects() {
+  for (uint32_t i = 0; i < kLiveCapacity; ++i)
+    live_[i].obj = 0;
+  live_count_ = 0;
+}
+
+// Called by GC. The hooks cannot allocate the Ruby array that would keep the
+// keys alive, so every key in the table is marked instead.
+void AllocationTracker::MarkKeys(void* data) {
+  AllocationTracker* tracker = reinterpret_cast<AllocationTracker*>(data);
+  for (uint32_t i = 0; i < kCapacity; ++i) {
+    const Slot& slot = tracker->slots_[i];
+    if (!slot.used.load(std::memory_order_acquire))
+      continue;
+    rb_gc_mark(slot.path);
+    rb_gc_mark(slot.klass);
+  }
+}
+
+void AllocationTracker::ResolveNamesJob(void* data) {
+  reinterpret_cast<AllocationTracker*>(data)->ResolveNames();
+}
+
+// Names need Ruby calls, which the event hooks cannot make.
+void AllocationTracker::ResolveNames() {
+  std::vector<uint32_t> unresolved;
+  unresolved.swap(unresolved_);
+  for (auto it = unresolved.cbegin(), ite = unresolved.cend(); it != ite;
+       ++it) {
+    const Slot& slot = slots_[*it];
+    SiteName name;
+    if (!NIL_P(slot.path))
+      name.file.assign(RSTRING_PTR(slot.path), RSTRING_LEN(slot.path));
+    name.class_name = rb_class2name(rb_class_real(slot.klass));
+    std::lock_guard<std::mutex> lock(names_mutex_);
+    names_[*it] = name;
+  }
+}
+
+#else
+
+void AllocationTracker::Start() {
+  Log("Allocation tracking needs Ruby 2.1 or later\n");
+}
+
+void AllocationTracker::Stop() {
+}
+
+#endif
+
+void AllocationTracker::Mark() {
+  if (!slots_)
+    return;
+  for (uint32_t i = 0; i < kCapacity; ++i) {
+    Slot& slot = slots_[i];
+    if (!slot.used.load(std::memory_order_acquire))
+      continue;
+    slot.mark_allocated = slot.allocated.load(std::memory_order_relaxed);
+    slot.mark_freed = slot.freed.load(std::memory_order_relaxed);
+  }
+}
+
+void AllocationTracker::GetSites(std::vector<Site>& sites) const {
+  sites.clear();
+  if (!slots_)
+    return;
+  std::lock_guard<std::mutex> lock(names_mutex_);
+  for (uint32_t i = 0; i < kCapacity; ++i) {
+    const Slot& slot = slots_[i];
+    if (!slot.used.load(std::memory_order_acquire))
+      continue;
+    Site site;
+    site.allocated = slot.allocated.load(std::memory_order_relaxed) -
+                     slot.mark_allocated.load(std::memory_order_relaxed);
+    site.freed = slot.freed.load(std::memory_order_relaxed) -
+                 slot.mark_freed.load(std::memory_order_relaxed);
+    if (site.allocated == 0 && site.freed == 0)
+      continue;
+    site.file = names_[i].file;
+    site.line = slot.line;
+    site.class_name = names_[i].class_name;
+    sites.push_back(site);
+  }
+  std::sort(sites.begin(), sites.end(), SiteOrder());
+}
+
+std::string AllocationTracker::GetReport(size_t max_sites) const {
+  std::vector<Site> sites;
+  GetSites(sites);
+  unsigned long long allocated = 0, freed = 0;
+  for (auto it = sites.cbegin(), ite = sites.cend(); it != ite; ++it) {
+    allocated += it->allocated;
+    freed += it->freed;
+  }
+
+  std::ostringstream os;
+  os << "Allocations: " << allocated << ", freed " << freed << " at "
+     << sites.size() << " sites";
+  if (lost_ != 0)
+    os << " (" << lost_ << " at sites that did not fit the table)";
+  if (untracked_ != 0)
+    os << " (frees of " << untracked_ << " objects not counted, too many "
+       << "were live)";
+  os << "\n   Allocated       Freed  Live delta  Site\n";
+  if (sites.size() > max_sites)
+    sites.resize(max_sites);
+  for (auto it = sites.cbegin(), ite = sites.cend(); it != ite; ++it) {
+    long long live_delta = static_cast<long long>(it->allocated) -
+                           static_cast<long long>(it->freed);
+    os << std::setw(12) << it->allocated << std::setw(12) << it->freed
+       << std::setw(12) << live_delta << "  "
+       << (it->class_name.empty() ? "?" : it->class_name) << " at "
+       << (it->file.empty() ? "?" : it->file) << ":" << it->line << "\n";
+  }
+  return os.str();
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
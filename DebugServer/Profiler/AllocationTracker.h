@@ -0,0 +1,129 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_ALLOCATIONTRACKER_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_ALLOCATIONTRACKER_H_
+
+#include <ruby/ruby.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Counts object allocations and frees per allocation site, a site being the
+// source line and the class of the new object. The counters are hooked to
+// Ruby's NEWOBJ and FREEOBJ internal events, which must not allocate Ruby
+// objects, so the hooks only touch fixed size tables. Sites are added by
+// the Ruby thread alone and published with a flag, which lets any thread
+// read the counters while Ruby keeps running. Needs Ruby 2.1 or later.
+class AllocationTracker {
+public:
+  // Allocation site as reported. Counts since the last Mark.
+  struct Site {
+    std::string file;
+    unsigned line;
+    std::string class_name;
+    unsigned long long allocated;
+    unsigned long long freed;
+  };
+
+  AllocationTracker();
+  ~AllocationTracker();
+
+  // Returns false if the Ruby in use has no allocation events.
+  static bool IsSupported();
+
+  // Starts counting, dropping previous counts. Must be called on the Ruby
+  // thread.
+  void Start();
+
+  // Must be called on the Ruby thread.
+  void Stop();
+
+  // Starts a new measurement period. Reports only count what happens after
+  // the mark. Can be called from any thread.
+  void Mark();
+
+  // Returns the sites with allocations since the last mark, most
+  // allocations first. Can be called from any thread.
+  void GetSites(std::vector<Site>& sites) const;
+
+  // Returns a text table of the top allocation sites.
+  std::string GetReport(size_t max_sites) const;
+
+private:
+  struct Slot {
+    std::atomic<bool> used;
+    VALUE path;
+    VALUE klass;
+    unsigned line;
+    std::atomic<unsigned long long> allocated;
+    std::atomic<unsigned long long> freed;
+    // Counter values at the last Mark
+    std::atomic<unsigned long long> mark_allocated;
+    std::atomic<unsigned long long> mark_freed;
+  };
+
+  struct SiteName {
+    std::string file;
+    std::string class_name;
+  };
+
+  // A live tracked object and the index of its slot. obj is 0 if unused.
+  struct LiveObject {
+    VALUE obj;
+    uint32_t slot;
+  };
+
+  AllocationTracker(const AllocationTracker&);
+  AllocationTracker& operator=(const AllocationTracker&);
+
+  Slot* FindOrAddSlot(VALUE path, unsigned line, VALUE klass);
+  void AddLiveObject(VALUE obj, uint32_t slot);
+  LiveObject* FindLiveObject(VALUE obj);
+  void RemoveLiveObject(LiveObject* entry);
+  void ClearLiveObjects();
+  void ResolveNames();
+
+  static void NewObjEvent(VALUE tp_val, void* data);
+  static void FreeObjEvent(VALUE tp_val, void* data);
+  static void ResolveNamesJob(void* data);
+  static void MarkKeys(void* data);
+
+  VALUE tp_newobj_;
+  VALUE tp_freeobj_;
+
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<unsigned long long> lost_;
+
+  // Live tracked objects, an open-addressed table. Ruby thread only.
+  std::unique_ptr<LiveObject[]> live_;
+  uint32_t live_count_;
+
+  // Objects not added to live_ because it was full. Their frees are not
+  // counted.
+  std::atomic<unsigned long long> untracked_;
+
+  // Slots whose names are not resolved yet. Ruby thread only.
+  std::vector<uint32_t> unresolved_;
+
+  // Indexed like slots_.
+  mutable std::mutex names_mutex_;
+  std::vector<SiteName> names_;
+
+  // Marks the paths and classes used as keys of slots_, from the moment they
+  // are added, without allocating in the hooks.
+  VALUE key_marker_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_ALLOCATIONTRACKER_H_
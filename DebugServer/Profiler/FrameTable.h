@@ -0,0 +1,85 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_FRAMETABLE_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_FRAMETABLE_H_
+
+#include "./StringTable.h"
+
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// A Ruby method or block as seen by the profilers.
+struct ProfileFrame {
+  uint32_t name; // Id in FrameTable::GetStrings()
+  uint32_t file; // Id in FrameTable::GetStrings()
+  uint32_t line;
+};
+
+// Interns profile frames so that samples can be stored as frame ids.
+class FrameTable {
+public:
+  FrameTable() {}
+
+  uint32_t Intern(const std::string& name, const std::string& file,
+                  uint32_t line) {
+    ProfileFrame frame;
+    frame.name = strings_.Intern(name);
+    frame.file = strings_.Intern(file);
+    frame.line = line;
+    uint64_t key = (static_cast<uint64_t>(frame.name) << 40) ^
+                   (static_cast<uint64_t>(frame.file) << 20) ^ frame.line;
+    auto range = ids_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+      const ProfileFrame& other = frames_[it->second];
+      if (other.name == frame.name && other.file == frame.file &&
+          other.line == frame.line)
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(frames_.size());
+    frames_.push_back(frame);
+    ids_.insert(std::make_pair(key, id));
+    return id;
+  }
+
+  const ProfileFrame& Get(uint32_t id) const { return frames_[id]; }
+
+  const std::string& GetName(uint32_t id) const {
+    return strings_.Get(frames_[id].name);
+  }
+
+  const std::string& GetFile(uint32_t id) const {
+    return strings_.Get(frames_[id].file);
+  }
+
+  // Returns "name (file:line)".
+  std::string Describe(uint32_t id) const {
+    const ProfileFrame& frame = frames_[id];
+    std::ostringstream os;
+    os << strings_.Get(frame.name) << " (" << strings_.Get(frame.file);
+    if (frame.line != 0)
+      os << ":" << frame.line;
+    os << ")";
+    return os.str();
+  }
+
+  const StringTable& GetStrings() const { return strings_; }
+
+  size_t size() const { return frames_.size(); }
+
+private:
+  FrameTable(const FrameTable&);
+  FrameTable& operator=(const FrameTable&);
+
+  StringTable strings_;
+  std::vector<ProfileFrame> frames_;
+  std::unordered_multimap<uint64_t, uint32_t> ids_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_FRAMETABLE_H_
@@ -0,0 +1,304 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./GcMonitor.h"
+
+#include <DebugServer/Clock.h>
+#include <DebugServer/Log.h>
+#include <DebugServer/RubyFeatures.h>
+
+#include <ruby/debug.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Events kept between two runs of the postponed job.
+const size_t kRingSize = 1024;
+
+// Upper bounds of the mark phase histogram buckets in microseconds. The last
+// bucket takes everything longer.
+const long long kBucketLimits[] = {
+  100, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+const size_t kBucketCount =
+    sizeof(kBucketLimits) / sizeof(kBucketLimits[0]) + 1;
+
+// Lines shown in the trigger table.
+const size_t kMaxTriggers = 10;
+
+#if RDEBUGGER_HAS_INCREMENTAL_MARKING
+const char kMarkLabel[] =
+    "Mark phases (incremental, may include Ruby code run in between)";
+#else
+const char kMarkLabel[] = "Mark pauses";
+#endif
+
+double ToMilliseconds(long long ns) {
+  return ns / 1000000.0;
+}
+
+// Reads the first of the given GC.stat keys that exists, as names differ
+// between Ruby versions.
+size_t GetGcStat(VALUE stats, const char* name, const char* old_name) {
+  VALUE value = rb_hash_lookup(stats, ID2SYM(rb_intern(name)));
+  if (NIL_P(value))
+    value = rb_hash_lookup(stats, ID2SYM(rb_intern(old_name)));
+  return NIL_P(value) ? 0 : NUM2SIZET(value);
+}
+
+struct TriggerOrder {
+  template <typename T>
+  bool operator()(const T& a, const T& b) const {
+    return a->second.total > b->second.total;
+  }
+};
+
+} // end anonymous namespace
+
+GcMonitor::Stats::Stats()
+  : collections(0),
+    mark_total(0),
+    mark_max(0),
+    sweep_total(0),
+    sweep_max(0),
+    histogram(kBucketCount),
+    first_live_slots(0),
+    live_slots(0),
+    max_live_slots(0),
+    total_slots(0) {
+}
+
+GcMonitor::GcMonitor()
+  : tp_start_(Qnil),
+    tp_end_mark_(Qnil),
+    tp_end_sweep_(Qnil),
+    ring_(kRingSize),
+    head_(0),
+    tail_(0),
+    dropped_(0),
+    start_time_(0),
+    end_mark_time_(0) {
+}
+
+GcMonitor::~GcMonitor() {
+}
+
+bool GcMonitor::IsSupported() {
+  return RDEBUGGER_HAS_INTERNAL_EVENTS != 0;
+}
+
+void GcMonitor::Reset() {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  stats_ = Stats();
+}
+
+#if RDEBUGGER_HAS_INTERNAL_EVENTS
+
+void GcMonitor::Start() {
+  if (tp_start_ != Qnil)
+    return;
+  start_time_ = 0;
+  end_mark_time_ = 0;
+  tp_start_ = rb_tracepoint_new(0, RUBY_INTERNAL_EVENT_GC_START, &StartEvent,
+                                this);
+  rb_tracepoint_enable(tp_start_);
+  tp_end_mark_ = rb_tracepoint_new(0, RUBY_INTERNAL_EVENT_GC_END_MARK,
+                                   &EndMarkEvent, this);
+  rb_tracepoint_enable(tp_end_mark_);
+  tp_end_sweep_ = rb_tracepoint_new(0, RUBY_INTERNAL_EVENT_GC_END_SWEEP,
+                                    &EndSweepEvent, this);
+  rb_tracepoint_enable(tp_end_sweep_);
+  Log("GC monitoring started\n");
+}
+
+void GcMonitor::Stop() {
+  if (tp_start_ == Qnil)
+    return;
+  rb_tracepoint_disable(tp_start_);
+  rb_tracepoint_disable(tp_end_mark_);
+  rb_tracepoint_disable(tp_end_sweep_);
+  tp_start_ = Qnil;
+  tp_end_mark_ = Qnil;
+  tp_end_sweep_ = Qnil;
+  ProcessEvents();
+  Log("GC monitoring stopped\n");
+}
+
+// Runs inside the garbage collector. Must not allocate Ruby objects.
+void GcMonitor::Record(EventType type, VALUE tp_val) {
+  size_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) == ring_.size()) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Event& event = ring_[head % ring_.size()];
+  event.type = type;
+  event.time = Clock::NowNanoseconds();
+  event.path = Qnil;
+  event.line = 0;
+  if (type == EVENT_START) {
+    // The allocating frame is running, so its path is alive until the job
+    // reads it.
+    rb_trace_arg_t* trace_arg = rb_tracearg_from_tracepoint(tp_val);
+    event.path = rb_tracearg_path(trace_arg);
+    if (!NIL_P(event.path))
+      event.line = FIX2UINT(rb_tracearg_lineno(trace_arg));
+  }
+  head_.store(head + 1, std::memory_order_release);
+}
+
+void GcMonitor::StartEvent(VALUE tp_val, void* data) {
+  reinterpret_cast<GcMonitor*>(data)->Record(EVENT_START, tp_val);
+}
+
+void GcMonitor::EndMarkEvent(VALUE tp_val, void* data) {
+  reinterpret_cast<GcMonitor*>(data)->Record(EVENT_END_MARK, tp_val);
+}
+
+void GcMonitor::EndSweepEvent(VALUE tp_val, void* data) {
+  GcMonitor* monitor = reinterpret_cast<GcMonitor*>(data);
+  monitor->Record(EVENT_END_SWEEP, tp_val);
+  rb_postponed_job_register_one(0, &ProcessEventsJob, monitor);
+}
+
+void GcMonitor::ProcessEventsJob(void* data) {
+  reinterpret_cast<GcMonitor*>(data)->ProcessEvents();
+}
+
+void GcMonitor::ProcessEvents() {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  size_t head = head_.load(std::memory_order_acquire);
+  for (; tail != head; ++tail) {
+    const Event& event = ring_[tail % ring_.size()];
+    switch (event.type) {
+    case EVENT_START:
+      start_time_ = event.time;
+      end_mark_time_ = 0;
+      if (NIL_P(event.path)) {
+        trigger_ = "(no Ruby code)";
+      } else {
+        std::ostringstream os;
+        os << std::string(RSTRING_PTR(event.path), RSTRING_LEN(event.path))
+           << ":" << event.line;
+        trigger_ = os.str();
+      }
+      break;
+    case EVENT_END_MARK:
+      if (start_time_ != 0) {
+        // The pause on Ruby 2.1. Later Rubies mark major collections in
+        // steps between Ruby code, and this is the span of all steps.
+        long long mark = event.time - start_time_;
+        ++stats_.collections;
+        stats_.mark_total += mark;
+        stats_.mark_max = std::max(stats_.mark_max, mark);
+        size_t bucket = 0;
+        while (bucket < kBucketCount - 1 &&
+               mark / 1000 >= kBucketLimits[bucket]) {
+          ++bucket;
+        }
+        ++stats_.histogram[bucket];
+        Trigger& trigger = stats_.triggers[trigger_];
+        ++trigger.count;
+        trigger.total += mark;
+        trigger.max = std::max(trigger.max, mark);
+        end_mark_time_ = event.time;
+      }
+      break;
+    case EVENT_END_SWEEP:
+      if (end_mark_time_ != 0) {
+        // Sweeping may be lazy and interleaved with Ruby code, this is the
+        // time until it completed.
+        long long sweep = event.time - end_mark_time_;
+        stats_.sweep_total += sweep;
+        stats_.sweep_max = std::max(stats_.sweep_max, sweep);
+      }
+      start_time_ = 0;
+      end_mark_time_ = 0;
+      break;
+    }
+  }
+  tail_.store(tail, std::memory_order_release);
+
+  static const ID id_stat = rb_intern("stat");
+  VALUE gc_stats = rb_funcall(rb_mGC, id_stat, 0);
+  stats_.live_slots = GetGcStat(gc_stats, "heap_live_slots", "heap_live_slot");
+  stats_.total_slots = stats_.live_slots +
+      GetGcStat(gc_stats, "heap_free_slots", "heap_free_slot");
+  if (stats_.first_live_slots == 0)
+    stats_.first_live_slots = stats_.live_slots;
+  stats_.max_live_slots = std::max(stats_.max_live_slots, stats_.live_slots);
+}
+
+#else
+
+void GcMonitor::Start() {
+  Log("GC monitoring needs Ruby 2.1 or later\n");
+}
+
+void GcMonitor::Stop() {
+}
+
+#endif
+
+std::string GcMonitor::GetReport() const {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(3);
+  os << "GC runs: " << stats_.collections;
+  if (dropped_ != 0)
+    os << " (" << dropped_ << " events dropped)";
+  os << "\n" << kMarkLabel << ": total "
+     << ToMilliseconds(stats_.mark_total)
+     << " ms, max " << ToMilliseconds(stats_.mark_max) << " ms";
+  if (stats_.collections != 0)
+    os << ", mean " << ToMilliseconds(stats_.mark_total / stats_.collections)
+       << " ms";
+  os << "\nSweeps: total " << ToMilliseconds(stats_.sweep_total)
+     << " ms, max " << ToMilliseconds(stats_.sweep_max) << " ms\n";
+
+  os << "Mark histogram:\n";
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    std::ostringstream range;
+    range << std::fixed << std::setprecision(1);
+    if (i < kBucketCount - 1)
+      range << "< " << kBucketLimits[i] / 1000.0 << " ms";
+    else
+      range << ">= " << kBucketLimits[i - 1] / 1000.0 << " ms";
+    os << std::setw(12) << range.str() << std::setw(10)
+       << stats_.histogram[i] << "\n";
+  }
+
+  typedef std::map<std::string, Trigger>::const_iterator TriggerIt;
+  std::vector<TriggerIt> triggers;
+  for (TriggerIt it = stats_.triggers.begin(); it != stats_.triggers.end();
+       ++it) {
+    triggers.push_back(it);
+  }
+  std::sort(triggers.begin(), triggers.end(), TriggerOrder());
+  if (triggers.size() > kMaxTriggers)
+    triggers.resize(kMaxTriggers);
+  os << "Triggered at:\n      Runs    Total ms      Max ms  Line\n";
+  for (auto it = triggers.cbegin(), ite = triggers.cend(); it != ite; ++it) {
+    const Trigger& trigger = (*it)->second;
+    os << std::setw(10) << trigger.count
+       << std::setw(12) << ToMilliseconds(trigger.total)
+       << std::setw(12) << ToMilliseconds(trigger.max)
+       << "  " << (*it)->first << "\n";
+  }
+
+  os << "Heap: " << stats_.live_slots << " live of " << stats_.total_slots
+     << " slots, peak " << stats_.max_live_slots << " live, "
+     << stats_.first_live_slots << " live after the first run\n";
+  return os.str();
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
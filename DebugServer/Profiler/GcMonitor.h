@@ -0,0 +1,117 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_GCMONITOR_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_GCMONITOR_H_
+
+#include <ruby/ruby.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Times garbage collections. Hooks on Ruby's GC_START, GC_END_MARK and
+// GC_END_SWEEP internal events put time stamps and the current source
+// location into a preallocated ring, and a postponed job turns them into
+// mark and sweep statistics after each collection. Needs Ruby 2.1 or later.
+// On Ruby 2.1 the mark phase is the pause. Later Rubies mark major
+// collections incrementally, so the mark phase is only an upper bound of the
+// pauses in it.
+class GcMonitor {
+public:
+  GcMonitor();
+  ~GcMonitor();
+
+  // Returns false if the Ruby in use has no GC events.
+  static bool IsSupported();
+
+  // Must be called on the Ruby thread.
+  void Start();
+
+  // Must be called on the Ruby thread.
+  void Stop();
+
+  // Drops the statistics collected so far. Can be called from any thread.
+  void Reset();
+
+  // Returns the mark phase histogram, the source lines that triggered the
+  // longest mark phases and the heap size. Can be called from any thread.
+  std::string GetReport() const;
+
+private:
+  enum EventType {
+    EVENT_START,
+    EVENT_END_MARK,
+    EVENT_END_SWEEP
+  };
+
+  struct Event {
+    EventType type;
+    long long time;
+    VALUE path;
+    unsigned line;
+  };
+
+  // Mark phases attributed to one source line.
+  struct Trigger {
+    Trigger() : count(0), total(0), max(0) {}
+    unsigned long long count;
+    long long total;
+    long long max;
+  };
+
+  struct Stats {
+    Stats();
+    unsigned long long collections;
+    long long mark_total;
+    long long mark_max;
+    long long sweep_total;
+    long long sweep_max;
+    std::vector<unsigned long long> histogram;
+    std::map<std::string, Trigger> triggers;
+    size_t first_live_slots;
+    size_t live_slots;
+    size_t max_live_slots;
+    size_t total_slots;
+  };
+
+  GcMonitor(const GcMonitor&);
+  GcMonitor& operator=(const GcMonitor&);
+
+  void Record(EventType type, VALUE tp_val);
+  void ProcessEvents();
+
+  static void StartEvent(VALUE tp_val, void* data);
+  static void EndMarkEvent(VALUE tp_val, void* data);
+  static void EndSweepEvent(VALUE tp_val, void* data);
+  static void ProcessEventsJob(void* data);
+
+  VALUE tp_start_;
+  VALUE tp_end_mark_;
+  VALUE tp_end_sweep_;
+
+  // Written by the hooks, read by ProcessEvents.
+  std::vector<Event> ring_;
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+  std::atomic<unsigned long long> dropped_;
+
+  // Collection in progress. Ruby thread only.
+  long long start_time_;
+  long long end_mark_time_;
+  std::string trigger_;
+
+  mutable std::mutex stats_mutex_;
+  Stats stats_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_GCMONITOR_H_
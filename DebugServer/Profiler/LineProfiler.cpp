@@ -0,0 +1,240 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./LineProfiler.h"
+
+#include <DebugServer/Clock.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+enum MethodKind {
+  METHOD_RUBY,
+  METHOD_BLOCK,
+  METHOD_C,
+  METHOD_CLASS
+};
+
+double ToMilliseconds(long long ns) {
+  return ns / 1000000.0;
+}
+
+} // end anonymous namespace
+
+LineProfiler::LineProfiler()
+  : last_path_(Qnil),
+    last_file_(kNoFile),
+    cur_file_(kNoFile),
+    cur_line_(0),
+    last_time_(0),
+    keep_alive_(Qnil)
+{}
+
+LineProfiler::~LineProfiler() {
+}
+
+void LineProfiler::Reset() {
+  if (keep_alive_ == Qnil) {
+    keep_alive_ = rb_ary_new();
+    rb_gc_register_address(&keep_alive_);
+  }
+  for (auto it = lines_.begin(), ite = lines_.end(); it != ite; ++it) {
+    it->clear();
+  }
+  for (auto it = methods_.begin(), ite = methods_.end(); it != ite; ++it) {
+    it->calls = 0;
+    it->total_time = 0;
+    it->self_time = 0;
+  }
+  calls_.clear();
+  cur_file_ = kNoFile;
+  cur_line_ = 0;
+  last_time_ = Clock::NowNanoseconds();
+}
+
+uint32_t LineProfiler::GetFileId(VALUE path) {
+  // Consecutive events nearly always come from the same file.
+  if (path == last_path_)
+    return last_file_;
+  uint32_t id;
+  auto it = file_ids_.find(path);
+  if (it != file_ids_.end()) {
+    id = it->second;
+  } else {
+    id = NIL_P(path) ? paths_.Intern("") :
+        paths_.Intern(std::string(RSTRING_PTR(path), RSTRING_LEN(path)));
+    if (id >= lines_.size())
+      lines_.resize(id + 1);
+    file_ids_.insert(std::make_pair(path, id));
+    rb_ary_push(keep_alive_, path);
+  }
+  last_path_ = path;
+  last_file_ = id;
+  return id;
+}
+
+uint32_t LineProfiler::GetMethodId(rb_trace_arg_t* trace_arg) {
+  static const ID id_b_call = rb_intern("b_call");
+  static const ID id_c_call = rb_intern("c_call");
+  static const ID id_class = rb_intern("class");
+
+  ID event = SYM2ID(rb_tracearg_event(trace_arg));
+  MethodKey key;
+  if (event == id_class) {
+    key.kind = METHOD_CLASS;
+    key.klass = rb_tracearg_self(trace_arg);
+    key.method = Qnil;
+  } else {
+    key.kind = event == id_b_call ? METHOD_BLOCK :
+               event == id_c_call ? METHOD_C : METHOD_RUBY;
+    key.klass = rb_tracearg_defined_class(trace_arg);
+    key.method = rb_tracearg_method_id(trace_arg);
+  }
+
+  auto it = method_ids_.find(key);
+  if (it != method_ids_.end())
+    return it->second;
+
+  MethodStats stats;
+  if (key.kind == METHOD_CLASS) {
+    stats.name = std::string("<class:") + rb_class2name(key.klass) + ">";
+  } else {
+    if (key.kind == METHOD_BLOCK)
+      stats.name = "block in ";
+    if (!NIL_P(key.klass))
+      stats.name += rb_class2name(key.klass);
+    stats.name += "#";
+    stats.name += NIL_P(key.method) ? "<main>" :
+                                      rb_id2name(SYM2ID(key.method));
+  }
+  stats.file = key.kind == METHOD_C ? kNoFile :
+                                      GetFileId(rb_tracearg_path(trace_arg));
+  uint32_t id = static_cast<uint32_t>(methods_.size());
+  methods_.push_back(stats);
+  method_ids_.insert(std::make_pair(key, id));
+  rb_ary_push(keep_alive_, key.klass);
+  return id;
+}
+
+// Charges the time since the last event to the line that was executing.
+void LineProfiler::Charge(long long now) {
+  if (cur_file_ != kNoFile)
+    lines_[cur_file_][cur_line_].time += now - last_time_;
+  last_time_ = now;
+}
+
+void LineProfiler::Line(rb_trace_arg_t* trace_arg) {
+  long long now = Clock::NowNanoseconds();
+  Charge(now);
+  cur_file_ = GetFileId(rb_tracearg_path(trace_arg));
+  cur_line_ = FIX2UINT(rb_tracearg_lineno(trace_arg));
+  std::vector<LineStats>& lines = lines_[cur_file_];
+  if (cur_line_ >= lines.size())
+    lines.resize(cur_line_ + 1);
+  ++lines[cur_line_].hits;
+}
+
+void LineProfiler::Call(rb_trace_arg_t* trace_arg) {
+  long long now = Clock::NowNanoseconds();
+  Charge(now);
+  ActiveCall call;
+  call.method = GetMethodId(trace_arg);
+  call.start = now;
+  call.child_time = 0;
+  call.file = cur_file_;
+  call.line = cur_line_;
+  calls_.push_back(call);
+  // Time spent in C functions stays with the calling line, which gets no
+  // line events until they return.
+}
+
+void LineProfiler::Return(rb_trace_arg_t* trace_arg) {
+  long long now = Clock::NowNanoseconds();
+  Charge(now);
+  if (calls_.empty()) {
+    // Called before profiling started. Ruby may be unwinding back into
+    // SketchUp, so no line runs until the next event.
+    cur_file_ = kNoFile;
+    return;
+  }
+  const ActiveCall& call = calls_.back();
+  long long total = now - call.start;
+  MethodStats& stats = methods_[call.method];
+  ++stats.calls;
+  stats.total_time += total;
+  stats.self_time += total - call.child_time;
+  cur_file_ = call.file;
+  cur_line_ = call.line;
+  calls_.pop_back();
+  if (!calls_.empty())
+    calls_.back().child_time += total;
+}
+
+void LineProfiler::Pause() {
+  Charge(Clock::NowNanoseconds());
+  cur_file_ = kNoFile;
+}
+
+bool LineProfiler::WriteReport(const std::string& path) const {
+  std::ofstream file(path.c_str());
+  if (!file)
+    return false;
+  file << std::fixed << std::setprecision(3);
+
+  // Methods by self time
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0; i < methods_.size(); ++i) {
+    if (methods_[i].calls != 0)
+      order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return methods_[a].self_time > methods_[b].self_time;
+  });
+  file << "      Calls    Total ms     Self ms  Method\n";
+  for (auto it = order.cbegin(), ite = order.cend(); it != ite; ++it) {
+    const MethodStats& stats = methods_[*it];
+    file << std::setw(11) << stats.calls
+         << std::setw(12) << ToMilliseconds(stats.total_time)
+         << std::setw(12) << ToMilliseconds(stats.self_time)
+         << "  " << stats.name;
+    if (stats.file != kNoFile)
+      file << " (" << paths_.Get(stats.file) << ")";
+    file << "\n";
+  }
+
+  // Annotated sources
+  for (uint32_t file_id = 0; file_id < lines_.size(); ++file_id) {
+    const std::vector<LineStats>& lines = lines_[file_id];
+    if (lines.empty())
+      continue;
+    const std::string& file_path = paths_.Get(file_id);
+    file << "\n== " << file_path << "\n"
+         << "      Hits     Time ms  Line\n";
+    std::ifstream source(file_path.c_str());
+    std::string text;
+    for (size_t line = 1; line < lines.size() || source; ++line) {
+      if (!std::getline(source, text))
+        text.clear();
+      if (line >= lines.size() && !source)
+        break;
+      if (line < lines.size() && lines[line].hits != 0) {
+        file << std::setw(10) << lines[line].hits
+             << std::setw(12) << ToMilliseconds(lines[line].time);
+      } else {
+        file << std::setw(22) << "";
+      }
+      file << std::setw(6) << line << "  " << text << "\n";
+    }
+  }
+  return file.good();
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,117 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_LINEPROFILER_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_LINEPROFILER_H_
+
+#include "./StringTable.h"
+
+#include <ruby/ruby.h>
+#include <ruby/debug.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Deterministic profiler fed by the debugger's line, call and return
+// tracepoints. Wall time between two events is charged to the line that was
+// executing, and each call's duration to its method. Per line data lives in
+// flat arrays indexed by file id and line number, so an event costs a clock
+// read and a few array updates. All methods must be called on the Ruby
+// thread.
+class LineProfiler {
+public:
+  LineProfiler();
+  ~LineProfiler();
+
+  // Drops all collected data.
+  void Reset();
+
+  void Line(rb_trace_arg_t* trace_arg);
+
+  void Call(rb_trace_arg_t* trace_arg);
+
+  void Return(rb_trace_arg_t* trace_arg);
+
+  // Stops the clock on the line currently executing.
+  void Pause();
+
+  // Writes the per method table followed by the annotated sources.
+  // Returns false if the file cannot be written.
+  bool WriteReport(const std::string& path) const;
+
+private:
+  struct LineStats {
+    LineStats() : hits(0), time(0) {}
+    unsigned long long hits;
+    long long time;
+  };
+
+  struct MethodStats {
+    MethodStats() : calls(0), total_time(0), self_time(0) {}
+    std::string name;
+    uint32_t file;
+    unsigned long long calls;
+    long long total_time;
+    long long self_time;
+  };
+
+  struct ActiveCall {
+    uint32_t method;
+    long long start;
+    long long child_time;
+    // The caller's position, restored on return.
+    uint32_t file;
+    uint32_t line;
+  };
+
+  struct MethodKey {
+    VALUE klass;
+    VALUE method;
+    int kind;
+    bool operator==(const MethodKey& other) const {
+      return klass == other.klass && method == other.method &&
+             kind == other.kind;
+    }
+  };
+
+  struct MethodKeyHash {
+    size_t operator()(const MethodKey& key) const {
+      return std::hash<VALUE>()(key.klass) * 31 +
+             std::hash<VALUE>()(key.method) * 7 + key.kind;
+    }
+  };
+
+  static const uint32_t kNoFile = 0xffffffff;
+
+  uint32_t GetFileId(VALUE path);
+  uint32_t GetMethodId(rb_trace_arg_t* trace_arg);
+  void Charge(long long now);
+
+  StringTable paths_;
+  // Indexed by file id, then by line number.
+  std::vector<std::vector<LineStats>> lines_;
+  std::unordered_map<VALUE, uint32_t> file_ids_;
+  VALUE last_path_;
+  uint32_t last_file_;
+
+  std::vector<MethodStats> methods_;
+  std::unordered_map<MethodKey, uint32_t, MethodKeyHash> method_ids_;
+
+  std::vector<ActiveCall> calls_;
+  uint32_t cur_file_;
+  uint32_t cur_line_;
+  long long last_time_;
+
+  // Keeps the path strings and classes used as map keys alive.
+  VALUE keep_alive_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_LINEPROFILER_H_
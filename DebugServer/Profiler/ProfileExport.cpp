@@ -0,0 +1,428 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./ProfileExport.h"
+#include "./StringTable.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+struct NodeOrder {
+  explicit NodeOrder(const StackTrie& trie) : trie_(trie) {}
+  bool operator()(uint32_t a, uint32_t b) const {
+    return trie_.GetNode(a).total > trie_.GetNode(b).total;
+  }
+  const StackTrie& trie_;
+};
+
+void GetChildren(const StackTrie& trie, uint32_t index,
+                 std::vector<uint32_t>& children) {
+  children.clear();
+  for (uint32_t child = trie.GetNode(index).first_child;
+       child != StackTrie::kNone; child = trie.GetNode(child).next_sibling) {
+    children.push_back(child);
+  }
+  std::sort(children.begin(), children.end(), NodeOrder(trie));
+}
+
+std::string Describe(const ProfileSnapshot::Frame& frame) {
+  std::ostringstream os;
+  os << frame.name << " (" << frame.file;
+  if (frame.line != 0)
+    os << ":" << frame.line;
+  os << ")";
+  return os.str();
+}
+
+//------------------------------------------------------------------------------
+// Text
+
+void WriteTree(std::ostream& os, const ProfileSnapshot& snapshot,
+               uint32_t index, int indent) {
+  const StackTrie& trie = snapshot.trie;
+  std::vector<uint32_t> children;
+  GetChildren(trie, index, children);
+
+  const double total = static_cast<double>(trie.GetTotal());
+  for (auto it = children.cbegin(), ite = children.cend(); it != ite; ++it) {
+    const StackTrie::Node& node = trie.GetNode(*it);
+    os << std::setw(6) << std::fixed << std::setprecision(1)
+       << (100.0 * node.total / total) << "% "
+       << std::setw(8) << node.total << " " << std::setw(8) << node.self
+       << "  " << std::string(indent * 2, ' ')
+       << Describe(snapshot.frames[node.frame]) << "\n";
+    WriteTree(os, snapshot, *it, indent + 1);
+  }
+}
+
+void WriteText(std::ostream& os, const ProfileSnapshot& snapshot) {
+  os << "Samples: " << snapshot.trie.GetTotal() << " (dropped "
+     << snapshot.dropped << "), interval " << snapshot.interval_us << " us\n"
+     << " total%    total     self  frame\n";
+  WriteTree(os, snapshot, StackTrie::kRoot, 0);
+}
+
+//------------------------------------------------------------------------------
+// Folded stacks
+
+// flamegraph.pl splits frames on ';' and the count off at the last space.
+std::string FoldedName(const std::string& name) {
+  std::string folded(name);
+  std::replace(folded.begin(), folded.end(), ';', ':');
+  std::replace(folded.begin(), folded.end(), '\n', ' ');
+  return folded;
+}
+
+void WriteFolded(std::ostream& os, const ProfileSnapshot& snapshot) {
+  const StackTrie& trie = snapshot.trie;
+  // Parents always precede their children, so each stack string is built
+  // from the parent's.
+  std::vector<std::string> stacks(trie.size());
+  for (uint32_t i = 1; i < trie.size(); ++i) {
+    const StackTrie::Node& node = trie.GetNode(i);
+    std::string& stack = stacks[i];
+    if (node.parent != StackTrie::kRoot) {
+      stack = stacks[node.parent];
+      stack += ';';
+    }
+    stack += FoldedName(snapshot.frames[node.frame].name);
+    if (node.self != 0)
+      os << stack << ' ' << node.self << '\n';
+    if (node.first_child == StackTrie::kNone)
+      std::string().swap(stack); // Leaves are not needed again
+  }
+}
+
+//------------------------------------------------------------------------------
+// pprof
+
+// Gzip stream made of stored deflate blocks. The profile is written once and
+// read by tools that only need a valid gzip container, so compression is not
+// worth a zlib dependency.
+class GzipWriter {
+public:
+  explicit GzipWriter(std::ostream& os) : os_(os), size_(0) {
+    static const unsigned char header[10] =
+        { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+    os_.write(reinterpret_cast<const char*>(header), sizeof(header));
+    block_.reserve(kBlockSize);
+  }
+
+  void Write(const std::string& data) {
+    for (size_t pos = 0; pos < data.size(); ) {
+      size_t n = std::min(kBlockSize - block_.size(), data.size() - pos);
+      block_.append(data, pos, n);
+      pos += n;
+      if (block_.size() == kBlockSize)
+        WriteBlock(false);
+    }
+  }
+
+  void Finish() {
+    WriteBlock(true);
+    WriteUInt32(crc_.checksum());
+    WriteUInt32(static_cast<uint32_t>(size_));
+  }
+
+private:
+  static const size_t kBlockSize = 65535;
+
+  void WriteBlock(bool is_final) {
+    const size_t len = block_.size();
+    unsigned char header[5] = {
+      static_cast<unsigned char>(is_final ? 1 : 0), // BFINAL, BTYPE stored
+      static_cast<unsigned char>(len & 0xff),
+      static_cast<unsigned char>(len >> 8),
+      static_cast<unsigned char>(~len & 0xff),
+      static_cast<unsigned char>((~len >> 8) & 0xff)
+    };
+    os_.write(reinterpret_cast<const char*>(header), sizeof(header));
+    os_.write(block_.data(), len);
+    crc_.process_bytes(block_.data(), len);
+    size_ += len;
+    block_.clear();
+  }
+
+  void WriteUInt32(uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+      bytes[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    os_.write(bytes, 4);
+  }
+
+  std::ostream& os_;
+  std::string block_;
+  boost::crc_32_type crc_;
+  unsigned long long size_;
+};
+
+// Minimal protocol buffer encoder for the fields pprof uses.
+class ProtoBuffer {
+public:
+  void Varint(uint64_t value) {
+    while (value >= 0x80) {
+      data_ += static_cast<char>((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    data_ += static_cast<char>(value);
+  }
+
+  void UInt(int field, uint64_t value) {
+    Varint(static_cast<uint64_t>(field) << 3); // Wire type 0
+    Varint(value);
+  }
+
+  void Bytes(int field, const std::string& bytes) {
+    Varint((static_cast<uint64_t>(field) << 3) | 2);
+    Varint(bytes.size());
+    data_ += bytes;
+  }
+
+  void Message(int field, const ProtoBuffer& message) {
+    Bytes(field, message.data_);
+  }
+
+  void Packed(int field, const std::vector<uint64_t>& values) {
+    ProtoBuffer packed;
+    for (auto it = values.cbegin(), ite = values.cend(); it != ite; ++it) {
+      packed.Varint(*it);
+    }
+    Message(field, packed);
+  }
+
+  const std::string& data() const { return data_; }
+
+  void Clear() { data_.clear(); }
+
+private:
+  std::string data_;
+};
+
+// Field numbers from pprof's profile.proto
+enum {
+  PROFILE_SAMPLE_TYPE = 1,
+  PROFILE_SAMPLE = 2,
+  PROFILE_LOCATION = 4,
+  PROFILE_FUNCTION = 5,
+  PROFILE_STRING_TABLE = 6,
+  PROFILE_PERIOD_TYPE = 11,
+  PROFILE_PERIOD = 12,
+  VALUE_TYPE_TYPE = 1,
+  VALUE_TYPE_UNIT = 2,
+  SAMPLE_LOCATION_ID = 1,
+  SAMPLE_VALUE = 2,
+  LOCATION_ID = 1,
+  LOCATION_LINE = 4,
+  LINE_FUNCTION_ID = 1,
+  LINE_LINE = 2,
+  FUNCTION_ID = 1,
+  FUNCTION_NAME = 2,
+  FUNCTION_SYSTEM_NAME = 3,
+  FUNCTION_FILENAME = 4,
+  FUNCTION_START_LINE = 5
+};
+
+// Top level fields are written out one at a time, so only the largest single
+// message is ever held in memory.
+void WritePprof(std::ostream& os, const ProfileSnapshot& snapshot) {
+  GzipWriter gzip(os);
+  ProtoBuffer field;
+  ProtoBuffer message;
+  StringTable strings;
+  strings.Intern(""); // pprof requires string 0 to be empty
+
+  // Sample types: number of samples and CPU time.
+  const uint64_t kSamples = strings.Intern("samples");
+  const uint64_t kCount = strings.Intern("count");
+  const uint64_t kCpu = strings.Intern("cpu");
+  const uint64_t kNanoseconds = strings.Intern("nanoseconds");
+  message.UInt(VALUE_TYPE_TYPE, kSamples);
+  message.UInt(VALUE_TYPE_UNIT, kCount);
+  field.Message(PROFILE_SAMPLE_TYPE, message);
+  message.Clear();
+  message.UInt(VALUE_TYPE_TYPE, kCpu);
+  message.UInt(VALUE_TYPE_UNIT, kNanoseconds);
+  field.Message(PROFILE_SAMPLE_TYPE, message);
+  field.Message(PROFILE_PERIOD_TYPE, message);
+  const uint64_t period = snapshot.interval_us * 1000ull;
+  field.UInt(PROFILE_PERIOD, period);
+  gzip.Write(field.data());
+
+  // One sample per stack, innermost location first. Location and function
+  // ids are the frame ids plus one, as pprof reserves zero.
+  const StackTrie& trie = snapshot.trie;
+  std::vector<uint32_t> path;
+  std::vector<uint64_t> location_ids;
+  std::vector<uint64_t> values(2);
+  for (uint32_t i = 1; i < trie.size(); ++i) {
+    const StackTrie::Node& node = trie.GetNode(i);
+    if (node.self == 0)
+      continue;
+    trie.GetPath(i, path);
+    location_ids.assign(path.rbegin(), path.rend());
+    for (auto it = location_ids.begin(), ite = location_ids.end();
+         it != ite; ++it) {
+      ++*it;
+    }
+    values[0] = node.self;
+    values[1] = node.self * period;
+    message.Clear();
+    message.Packed(SAMPLE_LOCATION_ID, location_ids);
+    message.Packed(SAMPLE_VALUE, values);
+    field.Clear();
+    field.Message(PROFILE_SAMPLE, message);
+    gzip.Write(field.data());
+  }
+
+  ProtoBuffer line;
+  for (uint32_t id = 0; id < snapshot.frames.size(); ++id) {
+    const ProfileSnapshot::Frame& frame = snapshot.frames[id];
+    line.Clear();
+    line.UInt(LINE_FUNCTION_ID, id + 1);
+    line.UInt(LINE_LINE, frame.line);
+    message.Clear();
+    message.UInt(LOCATION_ID, id + 1);
+    message.Message(LOCATION_LINE, line);
+    field.Clear();
+    field.Message(PROFILE_LOCATION, message);
+
+    uint64_t name = strings.Intern(frame.name);
+    message.Clear();
+    message.UInt(FUNCTION_ID, id + 1);
+    message.UInt(FUNCTION_NAME, name);
+    message.UInt(FUNCTION_SYSTEM_NAME, name);
+    message.UInt(FUNCTION_FILENAME, strings.Intern(frame.file));
+    message.UInt(FUNCTION_START_LINE, frame.line);
+    field.Message(PROFILE_FUNCTION, message);
+    gzip.Write(field.data());
+  }
+
+  // Repeated fields may come in any order, so the string table can go last.
+  for (uint32_t id = 0; id < strings.size(); ++id) {
+    field.Clear();
+    field.Bytes(PROFILE_STRING_TABLE, strings.Get(id));
+    gzip.Write(field.data());
+  }
+  gzip.Finish();
+}
+
+//------------------------------------------------------------------------------
+// Chrome trace events
+
+std::string JsonEscape(const std::string& str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (auto it = str.cbegin(), ite = str.cend(); it != ite; ++it) {
+    unsigned char c = static_cast<unsigned char>(*it);
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += *it;
+    } else if (c < 0x20) {
+      char buf[8];
+      sprintf(buf, "\\u%04x", c);
+      escaped += buf;
+    } else {
+      escaped += *it;
+    }
+  }
+  return escaped;
+}
+
+// Lays the call tree out on a made up timeline, each node spanning its total
+// time, with children side by side within their parent.
+void WriteTraceEvents(std::ostream& os, const ProfileSnapshot& snapshot,
+                      uint32_t index, unsigned long long start,
+                      bool& is_first) {
+  const StackTrie& trie = snapshot.trie;
+  std::vector<uint32_t> children;
+  GetChildren(trie, index, children);
+  for (auto it = children.cbegin(), ite = children.cend(); it != ite; ++it) {
+    const StackTrie::Node& node = trie.GetNode(*it);
+    const ProfileSnapshot::Frame& frame = snapshot.frames[node.frame];
+    unsigned long long duration = node.total * snapshot.interval_us;
+    if (!is_first)
+      os << ",\n";
+    is_first = false;
+    os << "{\"name\":\"" << JsonEscape(frame.name)
+       << "\",\"cat\":\"ruby\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+       << ",\"ts\":" << start << ",\"dur\":" << duration
+       << ",\"args\":{\"file\":\"" << JsonEscape(frame.file)
+       << "\",\"line\":" << frame.line << ",\"samples\":" << node.total
+       << "}}";
+    WriteTraceEvents(os, snapshot, *it, start, is_first);
+    start += duration;
+  }
+}
+
+void WriteChromeTrace(std::ostream& os, const ProfileSnapshot& snapshot) {
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool is_first = true;
+  WriteTraceEvents(os, snapshot, StackTrie::kRoot, 0, is_first);
+  os << "\n]}\n";
+}
+
+} // end anonymous namespace
+
+bool ParseProfileFormat(const std::string& name, ProfileFormat& format) {
+  if (boost::iequals(name, "text"))
+    format = PROFILE_FORMAT_TEXT;
+  else if (boost::iequals(name, "folded"))
+    format = PROFILE_FORMAT_FOLDED;
+  else if (boost::iequals(name, "pprof"))
+    format = PROFILE_FORMAT_PPROF;
+  else if (boost::iequals(name, "chrome"))
+    format = PROFILE_FORMAT_CHROME;
+  else
+    return false;
+  return true;
+}
+
+ProfileFormat GetProfileFormatFromPath(const std::string& path) {
+  if (boost::iends_with(path, ".folded") ||
+      boost::iends_with(path, ".collapsed"))
+    return PROFILE_FORMAT_FOLDED;
+  if (boost::iends_with(path, ".pb.gz") || boost::iends_with(path, ".pprof"))
+    return PROFILE_FORMAT_PPROF;
+  if (boost::iends_with(path, ".json"))
+    return PROFILE_FORMAT_CHROME;
+  return PROFILE_FORMAT_TEXT;
+}
+
+bool WriteProfile(const ProfileSnapshot& snapshot, ProfileFormat format,
+                  const std::string& path) {
+  std::ofstream file(path.c_str(), format == PROFILE_FORMAT_PPROF ?
+      std::ios::out | std::ios::binary : std::ios::out);
+  if (!file)
+    return false;
+  switch (format) {
+  case PROFILE_FORMAT_FOLDED:
+    WriteFolded(file, snapshot);
+    break;
+  case PROFILE_FORMAT_PPROF:
+    WritePprof(file, snapshot);
+    break;
+  case PROFILE_FORMAT_CHROME:
+    WriteChromeTrace(file, snapshot);
+    break;
+  default:
+    WriteText(file, snapshot);
+    break;
+  }
+  return file.good();
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,57 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_PROFILEEXPORT_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_PROFILEEXPORT_H_
+
+#include "./StackTrie.h"
+
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Copy of the collected stacks that exporters can work on without touching
+// the profiler's own tables, typically on a background thread.
+struct ProfileSnapshot {
+  struct Frame {
+    std::string name;
+    std::string file;
+    uint32_t line;
+  };
+
+  ProfileSnapshot() : interval_us(0), dropped(0) {}
+
+  StackTrie trie;
+  // Indexed by the frame ids stored in the trie.
+  std::vector<Frame> frames;
+  unsigned interval_us;
+  unsigned long long dropped;
+};
+
+enum ProfileFormat {
+  PROFILE_FORMAT_TEXT,   // Indented call tree
+  PROFILE_FORMAT_FOLDED, // One "outer;inner count" line per stack, for flamegraph.pl
+  PROFILE_FORMAT_PPROF,  // Gzipped pprof protobuf
+  PROFILE_FORMAT_CHROME  // Chrome trace event JSON
+};
+
+// Parses a format name ("text", "folded", "pprof" or "chrome"). Returns false
+// if the name is unknown.
+bool ParseProfileFormat(const std::string& name, ProfileFormat& format);
+
+// Picks the format from the file extension: .folded and .collapsed are
+// folded stacks, .pb.gz and .pprof are pprof, .json is Chrome trace events.
+// Anything else is text.
+ProfileFormat GetProfileFormatFromPath(const std::string& path);
+
+// Writes the snapshot to a file. Returns false if the file cannot be written.
+bool WriteProfile(const ProfileSnapshot& snapshot, ProfileFormat format,
+                  const std::string& path);
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_PROFILEEXPORT_H_
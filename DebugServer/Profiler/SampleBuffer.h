@@ -0,0 +1,93 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_SAMPLEBUFFER_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_SAMPLEBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Preallocated ring of stack samples with one producer (the Ruby thread) and
+// one consumer (the thread that aggregates them). Each sample is stored as
+// its depth followed by its frame ids, innermost frame first. Samples that do
+// not fit are dropped and counted rather than blocking the Ruby thread.
+class SampleBuffer {
+public:
+  explicit SampleBuffer(size_t capacity)
+    : data_(capacity), head_(0), tail_(0), dropped_(0) {}
+
+  // Producer side. Returns false if the sample was dropped.
+  bool Push(const uint32_t* frames, uint32_t depth) {
+    const size_t capacity = data_.size();
+    size_t need = depth + 1;
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t available = capacity - (head - tail);
+    size_t pos = head % capacity;
+    // Records never wrap. Skip the tail end of the buffer if needed.
+    size_t skip = capacity - pos < need ? capacity - pos : 0;
+    if (need + skip > available) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (skip != 0) {
+      data_[pos] = kSkip;
+      head += skip;
+      pos = 0;
+    }
+    data_[pos] = depth;
+    for (uint32_t i = 0; i < depth; ++i) {
+      data_[pos + 1 + i] = frames[i];
+    }
+    head_.store(head + need, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Calls fn(const uint32_t* frames, uint32_t depth) for each
+  // queued sample and returns the number of samples.
+  template <typename Fn>
+  size_t Drain(Fn fn) {
+    const size_t capacity = data_.size();
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (tail != head) {
+      size_t pos = tail % capacity;
+      uint32_t depth = data_[pos];
+      if (depth == kSkip) {
+        tail += capacity - pos;
+        continue;
+      }
+      fn(&data_[pos + 1], depth);
+      tail += depth + 1;
+      ++count;
+    }
+    tail_.store(tail, std::memory_order_release);
+    return count;
+  }
+
+  unsigned long long GetDropped() const { return dropped_; }
+
+private:
+  SampleBuffer(const SampleBuffer&);
+  SampleBuffer& operator=(const SampleBuffer&);
+
+  static const uint32_t kSkip = 0xffffffff;
+
+  std::vector<uint32_t> data_;
+  // Running word counts, the positions are taken modulo the capacity.
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+  std::atomic<unsigned long long> dropped_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_SAMPLEBUFFER_H_
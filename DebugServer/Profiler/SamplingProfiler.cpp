@@ -0,0 +1,280 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./SamplingProfiler.h"
+
+#include <DebugServer/Log.h>
+#include <DebugServer/RubyFeatures.h>
+
+#include <ruby/debug.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <regex>
+
+#ifdef WIN32
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Deepest stack recorded per sample, deeper frames are cut off.
+const int kMaxFrames = 256;
+
+// Ring capacity in words, enough for a few hundred deep samples between
+// two drains.
+const size_t kBufferCapacity = 256 * 1024;
+
+std::string ToString(VALUE str) {
+  if (NIL_P(str))
+    return std::string();
+  if (TYPE(str) != T_STRING)
+    str = rb_obj_as_string(str);
+  return std::string(RSTRING_PTR(str), RSTRING_LEN(str));
+}
+
+} // end anonymous namespace
+
+SamplingProfiler& SamplingProfiler::Instance() {
+  static SamplingProfiler profiler;
+  return profiler;
+}
+
+SamplingProfiler::SamplingProfiler()
+  : running_(false),
+    interval_us_(1000),
+    frame_values_(Qnil),
+    buffer_(kBufferCapacity) {
+  sample_.resize(kMaxFrames);
+}
+
+SamplingProfiler::~SamplingProfiler() {
+  Stop();
+}
+
+void SamplingProfiler::Start(const std::string& str_options) {
+  if (running_)
+    return;
+
+  std::smatch match;
+  const std::regex reg_hz("hz=(\\d+)");
+  if (regex_search(str_options, match, reg_hz)) {
+    unsigned hz = boost::lexical_cast<unsigned>(match[1]);
+    if (hz > 0)
+      interval_us_ = 1000000 / std::min(hz, 100000u);
+  }
+  const std::regex reg_out("out=(\\S+)");
+  if (regex_search(str_options, match, reg_out)) {
+    out_path_ = match[1];
+  }
+
+  if (frame_values_ == Qnil) {
+    frame_values_ = rb_ary_new();
+    rb_gc_register_address(&frame_values_);
+
+    VALUE module = rb_define_module("RubyDebugger");
+    rb_define_module_function(module, "profile_dump",
+                              RUBY_METHOD_FUNC(&ProfileDump), -1);
+    rb_set_end_proc(&AtExit, Qnil);
+  }
+
+  running_ = true;
+#ifdef WIN32
+  // The default timer resolution of 15.6 ms would cap the sampling rate.
+  timeBeginPeriod(1);
+#endif
+  timer_thread_ = std::thread(std::bind(&SamplingProfiler::TimerThreadFunc,
+                                        this));
+#if !RDEBUGGER_HAS_POSTPONED_JOB
+  rb_thread_create((VALUE(*)(...))&SamplerThread, this);
+#endif
+  Log("Sampling profiler started\n");
+}
+
+void SamplingProfiler::Stop() {
+  if (!running_)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+    running_ = false;
+  }
+  timer_cond_.notify_all();
+  timer_thread_.join();
+#ifdef WIN32
+  timeEndPeriod(1);
+#endif
+  DrainSamples();
+  JoinExportThread();
+  Log("Sampling profiler stopped\n");
+}
+
+// Asks for samples and moves queued ones into the trie.
+void SamplingProfiler::TimerThreadFunc() {
+  const std::chrono::microseconds interval(interval_us_);
+  std::unique_lock<std::mutex> lock(timer_mutex_);
+  while (running_) {
+    timer_cond_.wait_for(lock, interval);
+    if (!running_)
+      break;
+#if RDEBUGGER_HAS_POSTPONED_JOB
+    rb_postponed_job_register_one(0, &SampleJob, this);
+#endif
+    DrainSamples();
+  }
+}
+
+void SamplingProfiler::DrainSamples() {
+  std::lock_guard<std::mutex> lock(trie_mutex_);
+  StackTrie& trie = trie_;
+  buffer_.Drain([&trie](const uint32_t* frames, uint32_t depth) {
+    trie.Add(frames, depth);
+  });
+}
+
+#if RDEBUGGER_HAS_POSTPONED_JOB
+
+void SamplingProfiler::SampleJob(void* data) {
+  reinterpret_cast<SamplingProfiler*>(data)->TakeSample();
+}
+
+void SamplingProfiler::TakeSample() {
+  VALUE frames[kMaxFrames];
+  int lines[kMaxFrames];
+  int depth = rb_profile_frames(0, kMaxFrames, frames, lines);
+  for (int i = 0; i < depth; ++i) {
+    sample_[i] = InternFrame(frames[i]);
+  }
+  buffer_.Push(sample_.data(), depth);
+}
+
+uint32_t SamplingProfiler::InternFrame(VALUE frame) {
+  auto it = frame_ids_.find(frame);
+  if (it != frame_ids_.end())
+    return it->second;
+  VALUE line = rb_profile_frame_first_lineno(frame);
+  uint32_t id = frames_.Intern(
+      ToString(rb_profile_frame_full_label(frame)),
+      ToString(rb_profile_frame_path(frame)),
+      NIL_P(line) ? 0 : NUM2UINT(line));
+  rb_ary_push(frame_values_, frame);
+  frame_ids_.insert(std::make_pair(frame, id));
+  return id;
+}
+
+#else
+
+// Ruby 2.0 has neither postponed jobs nor rb_profile_frames. A Ruby thread
+// wakes up at the sampling rate and reads the main thread's backtrace
+// instead. Ruby only switches threads every few milliseconds, which caps the
+// effective rate.
+VALUE SamplingProfiler::SamplerThread(void* data) {
+  SamplingProfiler* profiler = reinterpret_cast<SamplingProfiler*>(data);
+  struct timeval interval;
+  interval.tv_sec = profiler->interval_us_ / 1000000;
+  interval.tv_usec = profiler->interval_us_ % 1000000;
+  while (profiler->running_) {
+    rb_thread_wait_for(interval);
+    if (profiler->running_)
+      profiler->TakeSample();
+  }
+  return Qnil;
+}
+
+void SamplingProfiler::TakeSample() {
+  static const ID id_backtrace_locations = rb_intern("backtrace_locations");
+  static const ID id_label = rb_intern("label");
+  static const ID id_path = rb_intern("path");
+  static const ID id_lineno = rb_intern("lineno");
+  VALUE locations = rb_funcall(rb_thread_main(), id_backtrace_locations, 0);
+  if (NIL_P(locations))
+    return;
+  int depth = std::min(static_cast<int>(RARRAY_LEN(locations)), kMaxFrames);
+  for (int i = 0; i < depth; ++i) {
+    VALUE location = RARRAY_PTR(locations)[i];
+    VALUE line = rb_funcall(location, id_lineno, 0);
+    sample_[i] = frames_.Intern(ToString(rb_funcall(location, id_label, 0)),
+                                ToString(rb_funcall(location, id_path, 0)),
+                                NIL_P(line) ? 0 : NUM2UINT(line));
+  }
+  buffer_.Push(sample_.data(), depth);
+}
+
+#endif
+
+std::shared_ptr<ProfileSnapshot> SamplingProfiler::TakeSnapshot() {
+  DrainSamples();
+  std::shared_ptr<ProfileSnapshot> snapshot(new ProfileSnapshot);
+  {
+    std::lock_guard<std::mutex> lock(trie_mutex_);
+    snapshot->trie = trie_;
+  }
+  snapshot->frames.resize(frames_.size());
+  for (uint32_t id = 0; id < frames_.size(); ++id) {
+    ProfileSnapshot::Frame& frame = snapshot->frames[id];
+    frame.name = frames_.GetName(id);
+    frame.file = frames_.GetFile(id);
+    frame.line = frames_.Get(id).line;
+  }
+  snapshot->interval_us = interval_us_;
+  snapshot->dropped = buffer_.GetDropped();
+  return snapshot;
+}
+
+void SamplingProfiler::JoinExportThread() {
+  if (export_thread_.joinable())
+    export_thread_.join();
+}
+
+bool SamplingProfiler::Dump(const std::string& path, ProfileFormat format) {
+  std::shared_ptr<ProfileSnapshot> snapshot = TakeSnapshot();
+  return WriteProfile(*snapshot, format, path);
+}
+
+void SamplingProfiler::DumpInBackground(const std::string& path,
+                                        ProfileFormat format) {
+  std::shared_ptr<ProfileSnapshot> snapshot = TakeSnapshot();
+  // Exports are rare, waiting for the previous one keeps them in order.
+  JoinExportThread();
+  export_thread_ = std::thread([snapshot, path, format]() {
+    std::string text = WriteProfile(*snapshot, format, path) ?
+        "Profile written to " + path + "\n" :
+        "Could not write profile to " + path + "\n";
+    Log(text.c_str());
+  });
+}
+
+// RubyDebugger.profile_dump(path = out, format = nil)
+// The format is one of "text", "folded", "pprof" or "chrome". Without one,
+// it is picked from the file extension.
+VALUE SamplingProfiler::ProfileDump(int argc, VALUE* argv, VALUE self) {
+  SamplingProfiler& profiler = Instance();
+  std::string path = argc > 0 && !NIL_P(argv[0]) ?
+      StringValueCStr(argv[0]) : profiler.GetOutputPath();
+  if (path.empty())
+    rb_raise(rb_eArgError, "no output path given");
+  ProfileFormat format = GetProfileFormatFromPath(path);
+  if (argc > 1 && !NIL_P(argv[1])) {
+    std::string name = ToString(argv[1]);
+    if (!ParseProfileFormat(name, format))
+      rb_raise(rb_eArgError, "unknown profile format: %s", name.c_str());
+  }
+  profiler.DumpInBackground(path, format);
+  return Qtrue;
+}
+
+void SamplingProfiler::AtExit(VALUE data) {
+  SamplingProfiler& profiler = Instance();
+  profiler.Stop();
+  const std::string& path = profiler.GetOutputPath();
+  if (!path.empty())
+    profiler.Dump(path, GetProfileFormatFromPath(path));
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
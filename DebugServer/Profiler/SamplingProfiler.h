@@ -0,0 +1,96 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_SAMPLINGPROFILER_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_SAMPLINGPROFILER_H_
+
+#include "./FrameTable.h"
+#include "./ProfileExport.h"
+#include "./SampleBuffer.h"
+#include "./StackTrie.h"
+
+#include <ruby/ruby.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Statistical profiler. A timer thread asks the Ruby thread for a backtrace
+// at a fixed rate; the backtraces are queued in a preallocated ring and
+// aggregated into a call tree off the Ruby thread. No TracePoints are used,
+// so Ruby runs at full speed between samples.
+class SamplingProfiler {
+public:
+  static SamplingProfiler& Instance();
+
+  // Starts sampling. Options are read from the debugger init string:
+  // hz=<samples per second> (default 1000), out=<file written at exit>.
+  // Also defines RubyDebugger.profile_dump(path = out, format = nil) for
+  // dumps on demand. Must be called on the Ruby thread.
+  void Start(const std::string& str_options);
+
+  void Stop();
+
+  bool IsRunning() const { return running_; }
+
+  // Writes the collected stacks in the given format. Must be called on the
+  // Ruby thread. Returns false if the file cannot be written.
+  bool Dump(const std::string& path, ProfileFormat format);
+
+  // Like Dump, but the file is written on a background thread. The Ruby
+  // thread only copies the call tree and the frame names.
+  void DumpInBackground(const std::string& path, ProfileFormat format);
+
+  const std::string& GetOutputPath() const { return out_path_; }
+
+private:
+  SamplingProfiler();
+  ~SamplingProfiler();
+
+  void TimerThreadFunc();
+  void DrainSamples();
+  void TakeSample();
+  std::shared_ptr<ProfileSnapshot> TakeSnapshot();
+  void JoinExportThread();
+  uint32_t InternFrame(VALUE frame);
+
+  static void SampleJob(void* data);
+  static VALUE SamplerThread(void* data);
+  static void AtExit(VALUE data);
+  static VALUE ProfileDump(int argc, VALUE* argv, VALUE self);
+
+  std::atomic<bool> running_;
+  unsigned interval_us_;
+  std::string out_path_;
+
+  std::thread timer_thread_;
+  std::mutex timer_mutex_;
+  std::condition_variable timer_cond_;
+
+  // Ruby thread only.
+  FrameTable frames_;
+  std::unordered_map<VALUE, uint32_t> frame_ids_;
+  // Keeps the interned frame objects alive so their addresses stay unique.
+  VALUE frame_values_;
+  std::vector<uint32_t> sample_;
+
+  SampleBuffer buffer_;
+
+  std::mutex trie_mutex_;
+  StackTrie trie_;
+
+  std::thread export_thread_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_SAMPLINGPROFILER_H_
@@ -0,0 +1,57 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./StackTrie.h"
+
+#include <algorithm>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+StackTrie::StackTrie() {
+  Clear();
+}
+
+void StackTrie::Clear() {
+  nodes_.clear();
+  children_.clear();
+  Node root = { kNone, kNone, kNone, kNone, 0, 0 };
+  nodes_.push_back(root);
+}
+
+void StackTrie::Add(const uint32_t* frames, uint32_t depth,
+                    unsigned long long count) {
+  uint32_t node = kRoot;
+  nodes_[kRoot].total += count;
+  for (uint32_t i = depth; i > 0; --i) {
+    node = FindOrAddChild(node, frames[i - 1]);
+    nodes_[node].total += count;
+  }
+  nodes_[node].self += count;
+}
+
+void StackTrie::GetPath(uint32_t index, std::vector<uint32_t>& frames) const {
+  frames.clear();
+  for (uint32_t node = index; node != kRoot && node != kNone;
+       node = nodes_[node].parent) {
+    frames.push_back(nodes_[node].frame);
+  }
+  std::reverse(frames.begin(), frames.end());
+}
+
+uint32_t StackTrie::FindOrAddChild(uint32_t parent, uint32_t frame) {
+  uint64_t key = (static_cast<uint64_t>(parent) << 32) | frame;
+  auto it = children_.find(key);
+  if (it != children_.end())
+    return it->second;
+  uint32_t index = static_cast<uint32_t>(nodes_.size());
+  Node node = { frame, parent, kNone, nodes_[parent].first_child, 0, 0 };
+  nodes_.push_back(node);
+  nodes_[parent].first_child = index;
+  children_.insert(std::make_pair(key, index));
+  return index;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,63 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_STACKTRIE_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_STACKTRIE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Call tree of aggregated stack samples. Every distinct call path gets one
+// node holding the number of samples that ended there (self) and that passed
+// through it (total).
+class StackTrie {
+public:
+  struct Node {
+    uint32_t frame;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    unsigned long long self;
+    unsigned long long total;
+  };
+
+  static const uint32_t kRoot = 0;
+  static const uint32_t kNone = 0xffffffff;
+
+  StackTrie();
+
+  void Clear();
+
+  // Adds a sample. Frames are ordered innermost first, the way Ruby reports
+  // them.
+  void Add(const uint32_t* frames, uint32_t depth,
+           unsigned long long count = 1);
+
+  const Node& GetNode(uint32_t index) const { return nodes_[index]; }
+
+  size_t size() const { return nodes_.size(); }
+
+  // Total number of samples added.
+  unsigned long long GetTotal() const { return nodes_[kRoot].total; }
+
+  // Returns the frames from the outermost one down to the given node.
+  void GetPath(uint32_t index, std::vector<uint32_t>& frames) const;
+
+private:
+  uint32_t FindOrAddChild(uint32_t parent, uint32_t frame);
+
+  std::vector<Node> nodes_;
+  // (parent << 32 | frame) -> node
+  std::unordered_map<uint64_t, uint32_t> children_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_STACKTRIE_H_
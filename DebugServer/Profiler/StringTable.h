@@ -0,0 +1,56 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_PROFILER_STRINGTABLE_H_
+#define RDEBUGGER_DEBUGSERVER_PROFILER_STRINGTABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Interns strings such as file paths and method names, handing out small
+// dense ids so that hot data structures can store and index by integer.
+// Ids stay valid until the table is cleared.
+class StringTable {
+public:
+  StringTable() {}
+
+  uint32_t Intern(const std::string& str) {
+    auto it = ids_.find(str);
+    if (it != ids_.end())
+      return it->second;
+    uint32_t id = static_cast<uint32_t>(strings_.size());
+    it = ids_.insert(std::make_pair(str, id)).first;
+    strings_.push_back(&it->first);
+    return id;
+  }
+
+  const std::string& Get(uint32_t id) const { return *strings_[id]; }
+
+  size_t size() const { return strings_.size(); }
+
+  // Drops all strings. Ids start from 0 again.
+  void Clear() {
+    strings_.clear();
+    ids_.clear();
+  }
+
+private:
+  StringTable(const StringTable&);
+  StringTable& operator=(const StringTable&);
+
+  std::unordered_map<std::string, uint32_t> ids_;
+  // Points at the keys of ids_, which do not move.
+  std::vector<const std::string*> strings_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_PROFILER_STRINGTABLE_H_
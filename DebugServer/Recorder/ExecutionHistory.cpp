@@ -0,0 +1,105 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./ExecutionHistory.h"
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+const uint32_t kNoFile = static_cast<uint32_t>(-1);
+
+// Evaluated in the binding of each line. Binding#local_variable_get needs
+// Ruby 2.1, eval works on 2.0 as well. The block parameter has an unusual
+// name so that it does not hide a local.
+const char* kSnapshotCode =
+    "local_variables.map { |__rdebugger_var| "
+    "[__rdebugger_var, eval(__rdebugger_var.to_s)] }";
+
+struct SnapshotArgs {
+  VALUE binding;
+  VALUE code;
+};
+
+VALUE EvalSnapshot(VALUE data) {
+  static const ID id_eval = rb_intern("eval");
+  const SnapshotArgs* args = reinterpret_cast<const SnapshotArgs*>(data);
+  return rb_funcall(args->binding, id_eval, 1, args->code);
+}
+
+} // end anonymous namespace
+
+ExecutionHistory::ExecutionHistory()
+  : next_(0),
+    count_(0),
+    last_file_(kNoFile),
+    snapshot_locals_(false),
+    locals_(Qnil),
+    snapshot_code_(Qnil)
+{}
+
+ExecutionHistory::~ExecutionHistory() {
+}
+
+void ExecutionHistory::Configure(size_t capacity, bool snapshot_locals) {
+  entries_.assign(capacity, Entry());
+  next_ = 0;
+  count_ = 0;
+  snapshot_locals_ = snapshot_locals && capacity > 0;
+  if (snapshot_locals_ && locals_ == Qnil) {
+    locals_ = rb_ary_new();
+    rb_gc_register_address(&locals_);
+    snapshot_code_ = rb_str_new2(kSnapshotCode);
+    rb_gc_register_address(&snapshot_code_);
+  }
+  if (locals_ != Qnil)
+    rb_ary_clear(locals_);
+}
+
+void ExecutionHistory::Add(rb_trace_arg_t* trace_arg,
+                           const std::string& file_path, int line,
+                           size_t depth) {
+  if (last_file_ == kNoFile || files_.Get(last_file_) != file_path)
+    last_file_ = files_.Intern(file_path);
+  size_t slot = next_;
+  Entry& entry = entries_[slot];
+  entry.file = last_file_;
+  entry.line = line;
+  entry.depth = depth;
+  next_ = (next_ + 1) % entries_.size();
+  if (count_ < entries_.size())
+    ++count_;
+
+  if (snapshot_locals_) {
+    VALUE locals = Qnil;
+    SnapshotArgs args = { rb_tracearg_binding(trace_arg), snapshot_code_ };
+    if (args.binding != Qnil) {
+      int error = 0;
+      locals = rb_protect(&EvalSnapshot, reinterpret_cast<VALUE>(&args),
+                          &error);
+      if (error) {
+        rb_set_errinfo(Qnil);
+        locals = Qnil;
+      }
+    }
+    rb_ary_store(locals_, static_cast<long>(slot), locals);
+  }
+}
+
+void ExecutionHistory::Clear() {
+  next_ = 0;
+  count_ = 0;
+  if (locals_ != Qnil)
+    rb_ary_clear(locals_);
+}
+
+VALUE ExecutionHistory::GetLocals(size_t age) const {
+  if (!snapshot_locals_ || age == 0 || age > count_)
+    return Qnil;
+  return rb_ary_entry(locals_, static_cast<long>(GetSlot(age)));
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
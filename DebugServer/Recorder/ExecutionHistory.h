@@ -0,0 +1,87 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_RECORDER_EXECUTIONHISTORY_H_
+#define RDEBUGGER_DEBUGSERVER_RECORDER_EXECUTIONHISTORY_H_
+
+#include <DebugServer/Profiler/StringTable.h>
+
+#include <ruby/ruby.h>
+#include <ruby/debug.h>
+
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Bounded window of the latest lines executed while a client is attached,
+// so that the client can step backwards without running Ruby code again.
+// Optionally keeps the local variables of the frame at each line. Lines are
+// addressed by age: 1 is the latest line, size() the oldest. All methods
+// must be called on the Ruby thread, or while it is stopped in the
+// debugger.
+class ExecutionHistory {
+public:
+  struct Entry {
+    uint32_t file;
+    int line;
+    // Call depth of the frame running the line.
+    size_t depth;
+  };
+
+  ExecutionHistory();
+  ~ExecutionHistory();
+
+  // Keeps up to capacity lines, 0 turns the history off. With
+  // snapshot_locals, every line also evaluates local_variables in its frame,
+  // which slows down stepping through loops noticeably.
+  void Configure(size_t capacity, bool snapshot_locals);
+
+  bool IsEnabled() const { return !entries_.empty(); }
+
+  // Appends a line. Must be called from the line tracepoint hook.
+  void Add(rb_trace_arg_t* trace_arg, const std::string& file_path, int line,
+           size_t depth);
+
+  void Clear();
+
+  size_t size() const { return count_; }
+
+  const Entry& Get(size_t age) const { return entries_[GetSlot(age)]; }
+
+  const std::string& GetFile(const Entry& entry) const {
+    return files_.Get(entry.file);
+  }
+
+  // Returns the locals of the frame at the line as an array of
+  // [name, value] pairs, or Qnil if they were not kept.
+  VALUE GetLocals(size_t age) const;
+
+private:
+  ExecutionHistory(const ExecutionHistory&);
+  ExecutionHistory& operator=(const ExecutionHistory&);
+
+  size_t GetSlot(size_t age) const {
+    return (next_ + entries_.size() - age) % entries_.size();
+  }
+
+  std::vector<Entry> entries_;
+  // Slot the next line goes to.
+  size_t next_;
+  size_t count_;
+
+  StringTable files_;
+  uint32_t last_file_;
+
+  bool snapshot_locals_;
+  // Locals per slot. Keeping them here also keeps their values alive.
+  VALUE locals_;
+  VALUE snapshot_code_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_RECORDER_EXECUTIONHISTORY_H_
@@ -0,0 +1,253 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./TraceRecorder.h"
+
+#include <DebugServer/Clock.h>
+#include <DebugServer/Log.h>
+
+#include <boost/interprocess/exceptions.hpp>
+
+#include <fstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+const uint32_t kChunkSize = 64 * 1024;
+
+const size_t kNamesSize = 1024 * 1024;
+
+// Keeps the ring large enough to hold a few chunks.
+const size_t kMinChunks = 4;
+
+TraceEventKind GetEventKind(VALUE event_sym) {
+  static const ID id_line = rb_intern("line");
+  static const ID id_call = rb_intern("call");
+  static const ID id_return = rb_intern("return");
+  static const ID id_c_call = rb_intern("c_call");
+  static const ID id_c_return = rb_intern("c_return");
+  static const ID id_b_call = rb_intern("b_call");
+  static const ID id_b_return = rb_intern("b_return");
+  static const ID id_class = rb_intern("class");
+  ID id = SYM2ID(event_sym);
+  if (id == id_line)
+    return TRACE_LINE;
+  if (id == id_call)
+    return TRACE_CALL;
+  if (id == id_return)
+    return TRACE_RETURN;
+  if (id == id_c_call)
+    return TRACE_C_CALL;
+  if (id == id_c_return)
+    return TRACE_C_RETURN;
+  if (id == id_b_call)
+    return TRACE_B_CALL;
+  if (id == id_b_return)
+    return TRACE_B_RETURN;
+  if (id == id_class)
+    return TRACE_CLASS;
+  return TRACE_END;
+}
+
+} // end anonymous namespace
+
+TraceRecorder::TraceRecorder()
+  : header_(nullptr),
+    chunks_(nullptr),
+    names_(nullptr),
+    chunk_(nullptr),
+    chunk_data_(nullptr),
+    pos_(nullptr),
+    chunk_end_(nullptr),
+    file_(0),
+    line_(0),
+    time_(0),
+    depth_(0),
+    names_full_(false),
+    last_path_(Qnil),
+    last_file_(0),
+    path_values_(Qnil) {
+}
+
+TraceRecorder::~TraceRecorder() {
+}
+
+bool TraceRecorder::Open(const std::string& path, size_t size_mb) {
+  Close();
+  uint64_t chunk_count = static_cast<uint64_t>(size_mb) * 1024 * 1024 /
+                         kChunkSize;
+  if (chunk_count < kMinChunks)
+    chunk_count = kMinChunks;
+  uint64_t names_offset = kTraceHeaderSize + chunk_count * kChunkSize;
+  uint64_t file_size = names_offset + kNamesSize;
+  {
+    // The file must have its full size before it can be mapped.
+    std::filebuf file;
+    if (!file.open(path.c_str(), std::ios::in | std::ios::out |
+                   std::ios::trunc | std::ios::binary))
+      return false;
+    file.pubseekoff(file_size - 1, std::ios::beg);
+    file.sputc(0);
+  }
+
+  std::lock_guard<std::mutex> lock(region_mutex_);
+  try {
+    using namespace boost::interprocess;
+    mapping_.reset(new file_mapping(path.c_str(), read_write));
+    region_.reset(new mapped_region(*mapping_, read_write));
+  } catch (const boost::interprocess::interprocess_exception& e) {
+    Log(("Could not map trace file: " + std::string(e.what()) + "\n").c_str());
+    region_.reset();
+    mapping_.reset();
+    return false;
+  }
+  uint8_t* base = static_cast<uint8_t*>(region_->get_address());
+  header_ = reinterpret_cast<TraceFileHeader*>(base);
+  std::memcpy(header_->magic, kTraceMagic, sizeof(kTraceMagic));
+  header_->version = kTraceVersion;
+  header_->chunk_size = kChunkSize;
+  header_->chunk_count = chunk_count;
+  header_->names_offset = names_offset;
+  header_->names_size = kNamesSize;
+  header_->names_used = 0;
+  header_->next_sequence = 1;
+  header_->start_time = Clock::NowNanoseconds();
+  chunks_ = base + kTraceHeaderSize;
+  names_ = base + names_offset;
+
+  if (path_values_ == Qnil) {
+    path_values_ = rb_ary_new();
+    rb_gc_register_address(&path_values_);
+  }
+  file_ = 0;
+  line_ = 0;
+  depth_ = 0;
+  StartChunk(header_->start_time);
+  Log(("Recording execution trace to " + path + "\n").c_str());
+  return true;
+}
+
+void TraceRecorder::Close() {
+  std::lock_guard<std::mutex> lock(region_mutex_);
+  if (header_ == nullptr)
+    return;
+  region_->flush();
+  region_.reset();
+  mapping_.reset();
+  header_ = nullptr;
+  chunk_ = nullptr;
+  pos_ = nullptr;
+  chunk_end_ = nullptr;
+  // File ids are per recording.
+  paths_.Clear();
+  file_ids_.clear();
+  names_full_ = false;
+  last_path_ = Qnil;
+  rb_ary_clear(path_values_);
+  Log("Trace recording stopped\n");
+}
+
+void TraceRecorder::Flush() {
+  std::lock_guard<std::mutex> lock(region_mutex_);
+  if (region_)
+    region_->flush();
+}
+
+uint32_t TraceRecorder::FindFileId(VALUE path) {
+  auto it = file_ids_.find(path);
+  if (it != file_ids_.end())
+    return it->second;
+
+  // Different sequences of the same file may have their own path strings.
+  std::string str_path = NIL_P(path) ? std::string() :
+      std::string(RSTRING_PTR(path), RSTRING_LEN(path));
+  size_t old_size = paths_.size();
+  uint32_t id = paths_.Intern(str_path);
+  if (paths_.size() != old_size && !names_full_) {
+    // Ids from the first name that does not fit on stay unnamed in the
+    // recording.
+    uint8_t length[5];
+    size_t length_size = WriteTraceVarint(length, str_path.size()) - length;
+    uint64_t used = header_->names_used;
+    if (used + length_size + str_path.size() <= header_->names_size) {
+      std::memcpy(names_ + used, length, length_size);
+      std::memcpy(names_ + used + length_size, str_path.data(),
+                  str_path.size());
+      header_->names_used = used + length_size + str_path.size();
+    } else {
+      names_full_ = true;
+    }
+  }
+  file_ids_.insert(std::make_pair(path, id));
+  rb_ary_push(path_values_, path);
+  return id;
+}
+
+// Resets the next ring slot. The records that were there are lost.
+void TraceRecorder::StartChunk(uint64_t time) {
+  uint64_t sequence = header_->next_sequence++;
+  uint8_t* chunk = chunks_ + ((sequence - 1) % header_->chunk_count) *
+                   header_->chunk_size;
+  chunk_ = reinterpret_cast<TraceChunkHeader*>(chunk);
+  chunk_->sequence = 0;
+  chunk_->base_time = time;
+  chunk_->base_depth = depth_;
+  chunk_->base_file = file_;
+  chunk_->base_line = line_;
+  chunk_->used = 0;
+  chunk_->sequence = sequence;
+  chunk_data_ = chunk + sizeof(TraceChunkHeader);
+  pos_ = chunk_data_;
+  chunk_end_ = chunk + header_->chunk_size;
+  time_ = time;
+}
+
+// Runs for every event, so it only writes to the mapped file.
+void TraceRecorder::Record(rb_trace_arg_t* trace_arg) {
+  if (header_ == nullptr)
+    return;
+  TraceEventKind kind = GetEventKind(rb_tracearg_event(trace_arg));
+  VALUE path = rb_tracearg_path(trace_arg);
+  uint32_t file;
+  if (path == last_path_) {
+    file = last_file_;
+  } else {
+    file = FindFileId(path);
+    last_path_ = path;
+    last_file_ = file;
+  }
+  uint32_t line = NIL_P(path) ? 0 : FIX2UINT(rb_tracearg_lineno(trace_arg));
+  uint64_t time = Clock::NowNanoseconds();
+  if (time < time_)
+    time = time_;
+
+  if (static_cast<size_t>(chunk_end_ - pos_) < kTraceMaxRecordSize)
+    StartChunk(time);
+
+  uint8_t* p = pos_;
+  uint8_t tag = static_cast<uint8_t>(kind);
+  if (file != file_)
+    tag |= kTraceFileChanged;
+  *p++ = tag;
+  if (file != file_)
+    p = WriteTraceVarint(p, file);
+  p = WriteTraceVarint(p, ZigZagEncode(static_cast<int32_t>(line - line_)));
+  p = WriteTraceVarint(p, time - time_);
+  pos_ = p;
+  // Published last, a crash leaves only whole records.
+  chunk_->used = static_cast<uint32_t>(p - chunk_data_);
+
+  file_ = file;
+  line_ = line;
+  time_ = time;
+  if (IsTraceCall(kind))
+    ++depth_;
+  else if (IsTraceReturn(kind))
+    --depth_;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,93 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_RECORDER_TRACERECORDER_H_
+#define RDEBUGGER_DEBUGSERVER_RECORDER_TRACERECORDER_H_
+
+#include <Common/TraceFormat.h>
+#include <DebugServer/Profiler/StringTable.h>
+
+#include <ruby/ruby.h>
+#include <ruby/debug.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Records line, call and return events into a memory-mapped ring file laid
+// out as described in Common/TraceFormat.h. Recording only writes to mapped
+// memory, the operating system writes the pages out, so the last events
+// survive a crash of SketchUp.
+class TraceRecorder {
+public:
+  TraceRecorder();
+  ~TraceRecorder();
+
+  // Creates a ring file of about size_mb megabytes and maps it. Returns
+  // false if the file cannot be created. Must be called on the Ruby thread.
+  bool Open(const std::string& path, size_t size_mb);
+
+  // Must be called on the Ruby thread.
+  void Close();
+
+  bool IsOpen() const { return header_ != nullptr; }
+
+  // Asks the operating system to write the recording to disk now. Can be
+  // called from any thread.
+  void Flush();
+
+  // Appends the event. Must be called from the tracepoint hooks.
+  void Record(rb_trace_arg_t* trace_arg);
+
+private:
+  TraceRecorder(const TraceRecorder&);
+  TraceRecorder& operator=(const TraceRecorder&);
+
+  uint32_t FindFileId(VALUE path);
+  void StartChunk(uint64_t time);
+
+  // Guards the mapping against Flush from other threads.
+  std::mutex region_mutex_;
+  std::unique_ptr<boost::interprocess::file_mapping> mapping_;
+  std::unique_ptr<boost::interprocess::mapped_region> region_;
+
+  TraceFileHeader* header_;
+  uint8_t* chunks_;
+  uint8_t* names_;
+
+  // Chunk being written.
+  TraceChunkHeader* chunk_;
+  uint8_t* chunk_data_;
+  uint8_t* pos_;
+  uint8_t* chunk_end_;
+
+  // Values of the last record.
+  uint32_t file_;
+  uint32_t line_;
+  uint64_t time_;
+  int32_t depth_;
+
+  // File ids are per recording, like the names area.
+  StringTable paths_;
+  std::unordered_map<VALUE, uint32_t> file_ids_;
+  // Set once a name did not fit the names area. Later names are not written
+  // either, as names are found by their position.
+  bool names_full_;
+  VALUE last_path_;
+  uint32_t last_file_;
+  // Keeps the path strings used as keys alive.
+  VALUE path_values_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_RECORDER_TRACERECORDER_H_
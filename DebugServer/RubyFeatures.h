@@ -0,0 +1,58 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_RUBYFEATURES_H_
+#define RDEBUGGER_DEBUGSERVER_RUBYFEATURES_H_
+
+#include <ruby/version.h>
+
+// Ruby C API features the debugger uses when the Ruby it is built against has
+// them. Each macro can be predefined to 0 to force the fallback code path.
+
+// rb_postponed_job_register_one (Ruby 2.1)
+#ifndef RDEBUGGER_HAS_POSTPONED_JOB
+#if RUBY_API_VERSION_CODE >= 20100
+#define RDEBUGGER_HAS_POSTPONED_JOB 1
+#else
+#define RDEBUGGER_HAS_POSTPONED_JOB 0
+#endif
+#endif
+
+// rb_profile_frames and the rb_profile_frame_* accessors (Ruby 2.1)
+#ifndef RDEBUGGER_HAS_PROFILE_FRAMES
+#if RUBY_API_VERSION_CODE >= 20100
+#define RDEBUGGER_HAS_PROFILE_FRAMES 1
+#else
+#define RDEBUGGER_HAS_PROFILE_FRAMES 0
+#endif
+#endif
+
+// RUBY_INTERNAL_EVENT_NEWOBJ and RUBY_INTERNAL_EVENT_FREEOBJ (Ruby 2.1)
+#ifndef RDEBUGGER_HAS_INTERNAL_EVENTS
+#if RUBY_API_VERSION_CODE >= 20100
+#define RDEBUGGER_HAS_INTERNAL_EVENTS 1
+#else
+#define RDEBUGGER_HAS_INTERNAL_EVENTS 0
+#endif
+#endif
+
+// Binding#local_variable_get (Ruby 2.1)
+#ifndef RDEBUGGER_HAS_LOCAL_VARIABLE_GET
+#if RUBY_API_VERSION_CODE >= 20100
+#define RDEBUGGER_HAS_LOCAL_VARIABLE_GET 1
+#else
+#define RDEBUGGER_HAS_LOCAL_VARIABLE_GET 0
+#endif
+#endif
+
+// Incremental marking of major GCs, interleaved with Ruby code (Ruby 2.2)
+#ifndef RDEBUGGER_HAS_INCREMENTAL_MARKING
+#if RUBY_API_VERSION_CODE >= 20200
+#define RDEBUGGER_HAS_INCREMENTAL_MARKING 1
+#else
+#define RDEBUGGER_HAS_INCREMENTAL_MARKING 0
+#endif
+#endif
+
+#endif // RDEBUGGER_DEBUGSERVER_RUBYFEATURES_H_
@@ -3,30 +3,64 @@
 // - Bugra Barin
 //
 #include "./Server.h"
+#include "./Clock.h"
 #include "./DebuggerSettings.h"
 #include "./FindSubstringCaseInsensitive.h"
 #include "./Log.h"
+#include "./RubyFeatures.h"
+#include "./StackCapture.h"
+#include "./StepFilter.h"
+#include "./Watchdog.h"
+#include "./Profiler/AllocationTracker.h"
+#include "./Profiler/GcMonitor.h"
+#include "./Profiler/LineProfiler.h"
+#include "./Profiler/StringTable.h"
+#include "./Recorder/ExecutionHistory.h"
+#include "./Recorder/TraceRecorder.h"
 
 #include <Common/BreakPoint.h>
 #include <Common/StackFrame.h>
+#include <Common/StepFilters.h>
 
 #include <ruby.h>
 #include <ruby/debug.h>
 #include <ruby/encoding.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <cstring>
+#include <fstream>
 #include <string>
 #include <iostream>
 #include <map>
 #include <mutex>
+#include <regex>
+#include <sstream>
 #include <thread>
+#include <unordered_map>
 
 using namespace SketchUp::RubyDebugger;
 
 namespace {
 
+// Size of the trace recording ring unless record_size= says otherwise.
+const size_t kDefaultRecordSizeMb = 64;
+
+// Lines listed in the trace of a repeated step. The steps are still counted
+// past it.
+const size_t kMaxRepeatTraceLines = 1000;
+
+// Returns the end of a page of count items from start, or of all the items
+// from start if count is 0.
+size_t GetPageEnd(size_t size, size_t start, size_t count) {
+  if (count > 0 && start < size && count < size - start)
+    return start + count;
+  return size;
+}
+
 VALUE GetRubyInterface(const char* s) {
   VALUE str_val = rb_str_new2(s);
   // Mark all strings as UTF-8 encoded.
@@ -155,28 +189,45 @@ Variable EvaluateRubyExpression(const std::string& expr, VALUE binding) {
   return var;
 }
 
-VALUE DebugInspectorFunc(const rb_debug_inspector_t* di, void* data) {
-  auto frames = reinterpret_cast<std::vector<StackFrame>*>(data);
-  VALUE bt = rb_debug_inspector_backtrace_locations(di);
-  int bt_count = RARRAY_LEN(bt);
-  for (int i=0; i < bt_count; ++i) {
-    VALUE bt_val = RARRAY_PTR(bt)[i];
-    VALUE path_val = rb_funcall(bt_val, rb_intern("path"), 0);
-    if (path_val == Qnil)
-      continue; // Probably the top stack when run from console
-    StackFrame frame;
-    frame.file = RSTRING_PTR(path_val);
-    if (frame.file == "<main>")
-      continue; // Top frame when called from Ruby Console
-    frame.name = GetRubyObjectAsString(bt_val);
-    VALUE line_val = rb_funcall(bt_val, rb_intern("lineno"), 0);
-    frame.line = FIX2INT(line_val);
-    frame.binding = rb_debug_inspector_frame_binding_get(di, i);
-    frame.self = rb_debug_inspector_frame_self_get(di, i);
-    frame.klass = rb_debug_inspector_frame_class_get(di, i);
-    frames->push_back(frame);
+// Whether two frames of different stops are the same, as far as the client
+// can tell.
+bool IsSameFrame(const CapturedFrame& frame0, const CapturedFrame& frame1) {
+  return frame0.level == frame1.level && frame0.iseq == frame1.iseq &&
+         frame0.line == frame1.line && frame0.file == frame1.file &&
+         frame0.label == frame1.label;
+}
+
+// Returns "Class#name" for instance methods and "Class.name" for singleton
+// methods, the way slow-call breakpoints name them.
+std::string GetMethodName(VALUE klass, ID method_id, VALUE self) {
+  const char* method = rb_id2name(method_id);
+  if (FL_TEST(klass, FL_SINGLETON)) {
+    bool is_module = RB_TYPE_P(self, T_CLASS) || RB_TYPE_P(self, T_MODULE);
+    return std::string(is_module ? rb_class2name(self) : "?") + "." + method;
+  }
+  return std::string(rb_class2name(klass)) + "#" + method;
+}
+
+std::string GetMethodName(rb_trace_arg_t* trace_arg) {
+  return GetMethodName(rb_tracearg_defined_class(trace_arg),
+                       SYM2ID(rb_tracearg_method_id(trace_arg)),
+                       rb_tracearg_self(trace_arg));
+}
+
+// Watchpoints compare values by identity, which covers immediates and
+// reassignments. Strings, arrays and hashes changed in place are caught by
+// their contents or size.
+long long GetFingerprint(VALUE value) {
+  switch (TYPE(value)) {
+  case T_STRING:
+    return static_cast<long long>(rb_str_hash(value));
+  case T_ARRAY:
+    return RARRAY_LEN(value);
+  case T_HASH:
+    return static_cast<long long>(RHASH_SIZE(value));
+  default:
+    return 0;
   }
-  return Qnil;
 }
 
 bool SortBreakPoints(const SketchUp::RubyDebugger::BreakPoint& bp0,
@@ -204,15 +255,107 @@ public:
       stepover_break_at_next_line_(false),
       stepout_to_call_depth_(-1),
       stepover_to_call_depth_(-1),
+      event_trace_arg_(nullptr),
+      stop_id_(0),
+      sent_stop_id_(0),
+      stack_capture_count_(0),
+      stack_capture_time_(0),
+      stack_depth_(0),
       active_frame_index_(0),
       last_break_line_(0),
-      call_depth_(0)
+      call_depth_(0),
+      attached_(false),
+      tracing_(false),
+      watchdog_depth_(0),
+      stall_capture_requested_(false),
+      attach_state_requested_(false),
+      attach_watcher_(Qnil),
+      profiling_wanted_(false),
+      profiling_(false),
+      allocations_wanted_(false),
+      tracking_allocations_(false),
+      gc_monitoring_wanted_(false),
+      monitoring_gc_(false),
+      slow_calls_version_(0),
+      has_slow_calls_(false),
+      active_slow_calls_version_(0),
+      slow_call_classes_(Qnil),
+      suspended_time_(0),
+      recording_wanted_(false),
+      recording_(false),
+      record_size_mb_(0),
+      history_age_(0),
+      watchpoints_version_(0),
+      has_watchpoints_(false),
+      active_watchpoints_version_(0),
+      watch_values_(Qnil),
+      has_temp_breakpoints_(false),
+      first_client_breakpoint_index_(1),
+      drop_detached_breakpoints_(false),
+      step_filters_version_(0),
+      active_step_filters_version_(0)
   {}
 
   void EnableTracePoint();
 
   void DisableTracePoint();
 
+  void RequestAttachStateUpdate();
+
+  void ApplyAttachState();
+
+  // Tracing is needed by an attached client, the watchdog, the line
+  // profiler and the trace recorder.
+  bool WantsTracing() const {
+    return attached_ || watchdog_ || profiling_wanted_ || recording_wanted_;
+  }
+
+  // Returns true if ApplyAttachState has work to do.
+  bool IsAttachStatePending() const {
+    return WantsTracing() != tracing_ || profiling_wanted_ != profiling_ ||
+           allocations_wanted_ != tracking_allocations_ ||
+           gc_monitoring_wanted_ != monitoring_gc_ ||
+           recording_wanted_ != recording_ ||
+           (!attached_ && history_.size() > 0);
+  }
+
+  // Bookkeeping done for every trace event, even with no client attached.
+  // depth_change is +1 for calls, -1 for returns.
+  void OnEvent(int depth_change) {
+#if !RDEBUGGER_HAS_POSTPONED_JOB
+    if (attach_state_requested_)
+      ApplyAttachState();
+#endif
+    if (!watchdog_)
+      return;
+    watchdog_->Beat();
+    if (depth_change > 0) {
+      if (watchdog_depth_++ == 0)
+        watchdog_->EnterRuby();
+    } else if (depth_change < 0 && watchdog_depth_ > 0) {
+      if (--watchdog_depth_ == 0)
+        watchdog_->LeaveRuby();
+    }
+#if !RDEBUGGER_HAS_POSTPONED_JOB
+    if (stall_capture_requested_)
+      CaptureStall();
+#endif
+  }
+
+  void RequestStallCapture(const std::string& reason);
+
+  void CaptureStall();
+
+#if RDEBUGGER_HAS_POSTPONED_JOB
+  static void AttachStateJob(void* data);
+
+  static void StallCaptureJob(void* data);
+#else
+  static VALUE AttachWatcher(void* data);
+
+  void StartAttachWatcher();
+#endif
+
   const BreakPoint* GetBreakPoint(const std::string& file, size_t line) const;
 
   void ReadScriptLinesHash();
@@ -223,6 +366,13 @@ public:
 
   void AddBreakPoint(BreakPoint& bp, bool is_resolved);
 
+  void DropDetachedBreakPoints();
+
+  bool IsDetachedBreakPoint(const BreakPoint& bp) const {
+    return drop_detached_breakpoints_ &&
+           bp.index < first_client_breakpoint_index_;
+  }
+
   void ClearBreakData();
 
   void ClearSuspensionData();
@@ -235,9 +385,61 @@ public:
 
   void DoBreak(const BreakPoint& bp);
 
+  bool MoveInHistory(HistoryMove move, size_t& breakpoint_index);
+
+  size_t GetHistoryBreakPoint(size_t age) const;
+
+  void BuildHistoryFrames();
+
+  const std::string& GetShownFilePath() const;
+
+  size_t GetShownLine() const;
+
+  IDebugServer::VariablesVector GetHistoryLocals(size_t start,
+                                                 size_t count) const;
+
+  void EnterCall(rb_trace_arg_t* trace_arg, VALUE event_sym,
+                 const std::string& file_path);
+
+  bool LeaveCall(const std::string& file_path, int line);
+
+  void SyncSlowCalls();
+
+  struct ActiveWatchPoint;
+
+  VALUE ReadWatchedValue(const ActiveWatchPoint& wp) const;
+
+  void SyncWatchPoints();
+
+  bool CheckWatchPoints(VALUE self, const std::string& file_path, int line);
+
+  void DropReturnedWatchPoints();
+
+  struct TemporaryBreakPoint;
+
+  bool TakeTemporaryBreakPoint(const std::string& file_path, size_t line,
+                               TemporaryBreakPoint& hit);
+
+  void DropRunToBreakPoints();
+
+  bool IsStepFiltered(rb_trace_arg_t* trace_arg);
+
+  bool RepeatStep(rb_trace_arg_t* trace_arg, const std::string& file_path,
+                  int line);
+
+  void EndRepeatedStep();
+
   VALUE GetBinding(bool use_toplevel_binding);
 
-  static std::vector<StackFrame> GetStackFrames();
+  void CaptureStack();
+
+  void ResolveFrames(size_t count);
+
+  VALUE GetFrameBinding(size_t index);
+
+  size_t ReadStack(StackCapture& capture, rb_trace_arg_t* trace_arg);
+
+  StackFrame MakeStackFrame(const CapturedFrame& captured) const;
 
   static void LineEvent(VALUE tp_val, void* data);
 
@@ -279,8 +481,36 @@ public:
   std::atomic<size_t> stepout_to_call_depth_;
 
   std::atomic<size_t> stepover_to_call_depth_;
-  
-  std::vector<StackFrame> frames_;
+
+  // The event being handled. Only valid inside its handler, which is where
+  // execution stops.
+  rb_trace_arg_t* event_trace_arg_;
+
+  // The stack of the stop, read once when execution stops.
+  StackCapture stop_capture_;
+
+  // Frames of the stop, read from stop_capture_ up to frames_.size(). The
+  // top one is read when execution stops, the others on the Ruby thread
+  // when first asked for.
+  std::vector<CapturedFrame> frames_;
+
+  // Paths and labels of the frames. Only added to on the Ruby thread.
+  RubyStringCache frame_strings_;
+
+  // Changes with every stop. Set on the Ruby thread.
+  std::atomic<size_t> stop_id_;
+
+  // The frames last returned by GetStackFrameChanges, and their stop. Ruby
+  // thread only.
+  std::vector<CapturedFrame> sent_frames_;
+  size_t sent_stop_id_;
+
+  // Time spent reading frames, for the stats.
+  std::atomic<long long> stack_capture_count_;
+  std::atomic<long long> stack_capture_time_;
+
+  // Number of frames at the stop.
+  size_t stack_depth_;
 
   size_t active_frame_index_;
 
@@ -289,10 +519,209 @@ public:
   size_t last_break_line_;
 
   size_t call_depth_;
+
+  // Whether a client is attached. Set from the UI thread.
+  std::atomic<bool> attached_;
+
+  // Whether the tracepoints are enabled. Ruby thread only.
+  bool tracing_;
+
+  std::unique_ptr<Watchdog> watchdog_;
+
+  // Call depth as seen by the watchdog. Unlike call_depth_ it is never
+  // adjusted, so it gets back to zero when control returns to SketchUp.
+  size_t watchdog_depth_;
+
+  // Reason for the stack capture requested by the watchdog thread.
+  std::mutex stall_mutex_;
+  std::string stall_reason_;
+  std::atomic<bool> stall_capture_requested_;
+
+  // Ruby 2.0 only. Set by RequestAttachStateUpdate, and picked up by the
+  // next trace event or by the watcher thread while nothing is traced.
+  std::atomic<bool> attach_state_requested_;
+  VALUE attach_watcher_;
+
+  LineProfiler line_profiler_;
+
+  // Whether the UI asked for line profiling. Set from the UI thread.
+  std::atomic<bool> profiling_wanted_;
+
+  // Whether line_profiler_ is being fed. Ruby thread only.
+  bool profiling_;
+
+  // Where the report goes when profiling stops.
+  std::mutex profile_mutex_;
+  std::string profile_report_path_;
+
+  AllocationTracker allocation_tracker_;
+
+  // Whether the UI asked for allocation tracking. Set from the UI thread.
+  std::atomic<bool> allocations_wanted_;
+
+  // Whether allocation_tracker_ is running. Ruby thread only.
+  bool tracking_allocations_;
+
+  GcMonitor gc_monitor_;
+
+  // Whether the UI asked for GC monitoring. Set from the UI thread.
+  std::atomic<bool> gc_monitoring_wanted_;
+
+  // Whether gc_monitor_ is running. Ruby thread only.
+  bool monitoring_gc_;
+
+  // Guarded by break_point_mutex_. The version is bumped on every change so
+  // the Ruby thread only takes the lock when there is something new.
+  std::vector<SlowCallBreakPoint> slow_calls_;
+  std::atomic<unsigned> slow_calls_version_;
+  std::atomic<bool> has_slow_calls_;
+
+  // Ruby thread copy of a slow-call breakpoint. A method is matched by its
+  // ID, and by its name only until the class it is defined in is known.
+  struct ActiveSlowCall {
+    SlowCallBreakPoint def;
+    ID method_id;
+    VALUE klass;
+  };
+
+  // Ruby thread copy of slow_calls_.
+  std::vector<ActiveSlowCall> active_slow_calls_;
+  unsigned active_slow_calls_version_;
+
+  // Keeps the classes in active_slow_calls_ alive, so their addresses are
+  // not reused.
+  VALUE slow_call_classes_;
+
+  // A call being timed. Every call event pushes one, so returns pop them in
+  // order. Only calls matching a slow-call breakpoint have an index.
+  struct CallTiming {
+    long long start;
+    long long suspended_at_start;
+    size_t breakpoint_index;
+    // The method, named only if the call turns out to be slow. self is kept
+    // alive by the call.
+    VALUE klass;
+    ID method_id;
+    VALUE self;
+  };
+  std::vector<CallTiming> call_timings_;
+
+  // Total time spent stopped in the debugger, not charged to slow calls.
+  long long suspended_time_;
+
+  TraceRecorder trace_recorder_;
+
+  // Whether the UI asked for trace recording. Set from the UI thread.
+  std::atomic<bool> recording_wanted_;
+
+  // Whether trace_recorder_ is being fed. Ruby thread only.
+  bool recording_;
+
+  // Where the next recording goes.
+  std::mutex record_mutex_;
+  std::string record_path_;
+  size_t record_size_mb_;
+
+  // Lines run while attached. Fed on the Ruby thread, read by MoveInHistory
+  // while it is stopped.
+  ExecutionHistory history_;
+
+  // Age in history_ of the position shown to the client, 0 for where Ruby
+  // is stopped. Only changes while stopped.
+  size_t history_age_;
+
+  // Frames of the shown position, rebuilt from the depths of older lines,
+  // and the age of the line each of them is at.
+  std::vector<StackFrame> history_frames_;
+  std::vector<size_t> history_frame_ages_;
+
+  struct ActiveWatchPoint {
+    WatchPoint def;
+    bool is_local;
+    ID id;
+    // The object of an instance variable, or the binding of a local's frame.
+    VALUE target;
+    // Call depth of a local's frame. Its lines run at that depth.
+    size_t depth;
+    // Last value seen, its fingerprint and how it was shown.
+    VALUE value;
+    long long fingerprint;
+    std::string text;
+  };
+
+  // Guarded by break_point_mutex_, versioned like slow_calls_.
+  std::vector<ActiveWatchPoint> watchpoints_;
+  std::atomic<unsigned> watchpoints_version_;
+  std::atomic<bool> has_watchpoints_;
+
+  // Ruby thread copy of watchpoints_, with the values last seen.
+  std::vector<ActiveWatchPoint> active_watchpoints_;
+  unsigned active_watchpoints_version_;
+
+  // Keeps the targets and values of the watchpoints alive. Ruby thread
+  // only.
+  VALUE watch_values_;
+
+  struct TemporaryBreakPoint {
+    BreakPoint bp;
+    // Also deleted when execution stops anywhere else, and reported as a
+    // suspension rather than a breakpoint hit.
+    bool run_to;
+    // Whether bp.file is a full path, or still a part of one.
+    bool resolved;
+  };
+
+  // Breakpoints deleted on their first hit. Guarded by break_point_mutex_.
+  // They are never saved, so adding and deleting them does not rewrite the
+  // settings file.
+  std::vector<TemporaryBreakPoint> temp_breakpoints_;
+  std::atomic<bool> has_temp_breakpoints_;
+
+  // Breakpoints with a lower index were set by a client that has detached.
+  // The Ruby thread reads breakpoints_ and unresolved_breakpoints_ without
+  // the lock, so Detach only records this, and the Ruby thread drops them in
+  // ApplyAttachState. Guarded by break_point_mutex_.
+  size_t first_client_breakpoint_index_;
+  std::atomic<bool> drop_detached_breakpoints_;
+
+  // Guarded by break_point_mutex_, versioned like slow_calls_.
+  StepFilters step_filters_;
+  std::atomic<unsigned> step_filters_version_;
+
+  // Ruby thread matcher for step_filters_.
+  StepFilter step_filter_;
+  unsigned active_step_filters_version_;
+
+  // A step repeated on the Ruby thread. It is set up while stopped, and
+  // only active is changed from other threads, to end it.
+  struct RepeatedStep {
+    RepeatedStep()
+      : active(false), step_over(false), remaining(0), trace(false),
+        steps(0), traced_lines(0) {}
+
+    std::atomic<bool> active;
+    bool step_over;
+    // Steps left, 0 for no limit.
+    size_t remaining;
+    // Stops once true at the line reached, if not empty.
+    std::string until;
+    bool trace;
+    size_t steps;
+    // Lines passed, grouped by file: "  file: 3 4 5\n".
+    std::string trace_text;
+    std::string trace_file;
+    size_t traced_lines;
+  };
+  RepeatedStep repeat_;
 };
 
 void Server::Impl::ClearBreakData() {
   frames_.clear();
+  stack_depth_ = 0;
+  stop_capture_.Clear();
+  history_age_ = 0;
+  history_frames_.clear();
+  history_frame_ages_.clear();
   is_stopped_ = false;
 }
 
@@ -329,6 +758,186 @@ void Server::Impl::DisableTracePoint() {
   }
 }
 
+// Asks the Ruby thread to bring the tracepoints in line with WantsTracing.
+void Server::Impl::RequestAttachStateUpdate() {
+#if RDEBUGGER_HAS_POSTPONED_JOB
+  rb_postponed_job_register_one(0, &AttachStateJob, this);
+#else
+  attach_state_requested_ = true;
+#endif
+}
+
+void Server::Impl::ApplyAttachState() {
+#if !RDEBUGGER_HAS_POSTPONED_JOB
+  attach_state_requested_ = false;
+#endif
+  if (drop_detached_breakpoints_)
+    DropDetachedBreakPoints();
+
+  if (profiling_wanted_ && !profiling_) {
+    line_profiler_.Reset();
+    profiling_ = true;
+    Log("Line profiling started\n");
+  } else if (!profiling_wanted_ && profiling_) {
+    profiling_ = false;
+    std::string path;
+    {
+      std::lock_guard<std::mutex> lock(profile_mutex_);
+      path = profile_report_path_;
+    }
+    std::string text = line_profiler_.WriteReport(path) ?
+        "Profile written to " + path + "\n" :
+        "Could not write profile to " + path + "\n";
+    Log(text.c_str());
+    if (ui_)
+      ui_->Message(text);
+  }
+
+  if (allocations_wanted_ != tracking_allocations_) {
+    tracking_allocations_ = allocations_wanted_;
+    if (tracking_allocations_)
+      allocation_tracker_.Start();
+    else
+      allocation_tracker_.Stop();
+  }
+
+  if (gc_monitoring_wanted_ != monitoring_gc_) {
+    monitoring_gc_ = gc_monitoring_wanted_;
+    if (monitoring_gc_)
+      gc_monitor_.Start();
+    else
+      gc_monitor_.Stop();
+  }
+
+  if (recording_wanted_ && !recording_) {
+    std::string path;
+    size_t size_mb;
+    {
+      std::lock_guard<std::mutex> lock(record_mutex_);
+      path = record_path_;
+      size_mb = record_size_mb_;
+    }
+    recording_ = trace_recorder_.Open(path, size_mb);
+    if (!recording_) {
+      recording_wanted_ = false;
+      std::string text = "Could not record to " + path + "\n";
+      Log(text.c_str());
+      if (ui_)
+        ui_->Message(text);
+    }
+  } else if (!recording_wanted_ && recording_) {
+    recording_ = false;
+    trace_recorder_.Close();
+  }
+
+  // The next client starts with a fresh history. Calls timed for the last
+  // one would never see their returns.
+  if (!attached_) {
+    history_.Clear();
+    call_timings_.clear();
+  }
+
+  bool wants_tracing = WantsTracing();
+  if (wants_tracing && !tracing_) {
+    call_depth_ = 0;
+    EnableTracePoint();
+    tracing_ = true;
+    Log("Debugger tracing enabled\n");
+  } else if (!wants_tracing && tracing_) {
+    DisableTracePoint();
+    tracing_ = false;
+    ClearSuspensionData();
+    repeat_.active = false;
+    repeat_.trace_text.clear();
+    Log("Debugger tracing disabled\n");
+#if !RDEBUGGER_HAS_POSTPONED_JOB
+    StartAttachWatcher();
+#endif
+  }
+}
+
+#if RDEBUGGER_HAS_POSTPONED_JOB
+void Server::Impl::AttachStateJob(void* data) {
+  reinterpret_cast<Server::Impl*>(data)->ApplyAttachState();
+}
+
+void Server::Impl::StallCaptureJob(void* data) {
+  reinterpret_cast<Server::Impl*>(data)->CaptureStall();
+}
+#else
+// Ruby 2.0 has no postponed jobs, and enabling a tracepoint needs the GVL.
+// While tracing, the trace events apply attach state changes. While nothing
+// is traced, a Ruby thread that wakes up a few times a second does. It only
+// gets scheduled while Ruby code is running, which is the only time tracing
+// matters, and sleeps for as long as tracing is on.
+VALUE Server::Impl::AttachWatcher(void* data) {
+  Server::Impl* impl = reinterpret_cast<Server::Impl*>(data);
+  struct timeval interval;
+  interval.tv_sec = 0;
+  interval.tv_usec = 100 * 1000;
+  while (true) {
+    if (impl->tracing_) {
+      rb_thread_sleep_forever();
+      continue;
+    }
+    rb_thread_wait_for(interval);
+    if (impl->IsAttachStatePending())
+      impl->ApplyAttachState();
+  }
+  return Qnil;
+}
+
+// Called on the Ruby thread once nothing is traced.
+void Server::Impl::StartAttachWatcher() {
+  if (attach_watcher_ == Qnil)
+    attach_watcher_ = rb_thread_create((VALUE(*)(...))&AttachWatcher, this);
+  else
+    rb_thread_wakeup(attach_watcher_);
+}
+#endif
+
+// Called on the watchdog thread. The stack can only be read on the Ruby
+// thread, at its next safe point.
+void Server::Impl::RequestStallCapture(const std::string& reason) {
+  {
+    std::lock_guard<std::mutex> lock(stall_mutex_);
+    stall_reason_ = reason;
+  }
+#if RDEBUGGER_HAS_POSTPONED_JOB
+  rb_postponed_job_register_one(0, &StallCaptureJob, this);
+#else
+  // Picked up by OnEvent.
+  stall_capture_requested_ = true;
+#endif
+}
+
+void Server::Impl::CaptureStall() {
+  stall_capture_requested_ = false;
+  std::string reason;
+  {
+    std::lock_guard<std::mutex> lock(stall_mutex_);
+    reason.swap(stall_reason_);
+  }
+  // Ruby code run while stopped can stall too, so the capture of the stop
+  // is left alone.
+  StackCapture capture;
+  size_t depth = ReadStack(capture, nullptr);
+  std::ostringstream os;
+  os << "Watchdog: " << reason << "\n";
+  for (size_t i = 0; i < depth; ++i) {
+    os << "  " << MakeStackFrame(capture.GetFrame(i, frame_strings_)).name
+       << "\n";
+  }
+  if (recording_) {
+    // Keeps the events that led to the stall, should SketchUp be killed.
+    trace_recorder_.Flush();
+    os << "  (trace recording flushed)\n";
+  }
+  std::string text = os.str();
+  Log(text.c_str());
+  ui_->Message(text);
+}
+
 const BreakPoint* Server::Impl::GetBreakPoint(const std::string& file,
                                               size_t line) const {
   const BreakPoint* bp = nullptr;
@@ -357,8 +966,8 @@ void Server::Impl::LoadBreakPoints() {
 
 #define EVENT_COMMON_CODE \
   rb_trace_arg_t* trace_arg = rb_tracearg_from_tracepoint(tp_val);\
-  Server::Impl* server = reinterpret_cast<Server::Impl*>(data);\
   server->ClearBreakData();\
+  server->event_trace_arg_ = trace_arg;\
   std::string file_path = GetRubyString(rb_tracearg_path(trace_arg));\
   int line = GetRubyInt(rb_tracearg_lineno(trace_arg));\
   VALUE event_sym = rb_tracearg_event(trace_arg);\
@@ -366,15 +975,21 @@ void Server::Impl::LoadBreakPoints() {
 //       GetRubyString(rb_sym_to_s(event_sym)) + ", " + file_path.c_str() + ":" +\
 //       boost::lexical_cast<std::string>(line).c_str() + "\n").c_str())
 
-static void ProcessLine(Server::Impl* server, const std::string& file_path,
-                        int line) {
+static void ProcessLine(Server::Impl* server, rb_trace_arg_t* trace_arg,
+                        const std::string& file_path, int line) {
   if (server->call_depth_ == 0)
     server->call_depth_ = 1;
 
-  if (server->break_at_next_line_ ||
-      (server->stepover_break_at_next_line_ &&
-       server->stepover_to_call_depth_ >= server->call_depth_) ||
-      (server->stepout_break_at_next_line_)) {
+  bool step_done = (server->break_at_next_line_ ||
+                    (server->stepover_break_at_next_line_ &&
+                     server->stepover_to_call_depth_ >= server->call_depth_) ||
+                    (server->stepout_break_at_next_line_)) &&
+                   !server->IsStepFiltered(trace_arg);
+  // A repeated step goes on from here, unless a breakpoint is hit below.
+  if (step_done && server->repeat_.active)
+    step_done = !server->RepeatStep(trace_arg, file_path, line);
+
+  if (step_done) {
     server->ClearSuspensionData();
     server->DoBreak(file_path, line);
   } else {
@@ -382,31 +997,86 @@ static void ProcessLine(Server::Impl* server, const std::string& file_path,
     if (!server->unresolved_breakpoints_.empty())
       server->ResolveBreakPoints();
 
+    Server::Impl::TemporaryBreakPoint temp;
+    bool temp_hit = server->has_temp_breakpoints_ &&
+                    server->TakeTemporaryBreakPoint(file_path, line, temp);
+
     auto bp = server->GetBreakPoint(file_path, line);
     if (bp != nullptr) {
       // Breakpoint hit
       server->DoBreak(*bp);
+    } else if (temp_hit) {
+      if (temp.run_to)
+        server->DoBreak(file_path, line);
+      else
+        server->DoBreak(temp.bp);
     }
   }
 }
 
+// The tracepoints also run for the watchdog and the line profiler, and may
+// fire a few more times after a detach until the Ruby thread gets around to
+// disabling them. Only their bookkeeping is done then, which includes the
+// call depth, so a client attaching while they run gets the right depths to
+// step over and out to.
 void Server::Impl::LineEvent(VALUE tp_val, void* data) {
+  Server::Impl* server = reinterpret_cast<Server::Impl*>(data);
+  server->OnEvent(0);
+  if (server->profiling_)
+    server->line_profiler_.Line(rb_tracearg_from_tracepoint(tp_val));
+  if (server->recording_)
+    server->trace_recorder_.Record(rb_tracearg_from_tracepoint(tp_val));
+  if (!server->attached_) {
+    if (server->call_depth_ == 0)
+      server->call_depth_ = 1;
+    return;
+  }
   EVENT_COMMON_CODE;
 
-  ProcessLine(server, file_path, line);
+  bool stopped = server->has_watchpoints_ &&
+      server->CheckWatchPoints(rb_tracearg_self(trace_arg), file_path, line);
+  if (!stopped)
+    ProcessLine(server, trace_arg, file_path, line);
+
+  // Added after any break, so the line where Ruby stops is not its own
+  // history.
+  if (server->history_.IsEnabled())
+    server->history_.Add(trace_arg, file_path, line, server->call_depth_);
 }
 
 void Server::Impl::ReturnEvent(VALUE tp_val, void* data) {
+  Server::Impl* server = reinterpret_cast<Server::Impl*>(data);
+  server->OnEvent(-1);
+  if (server->profiling_)
+    server->line_profiler_.Return(rb_tracearg_from_tracepoint(tp_val));
+  if (server->recording_)
+    server->trace_recorder_.Record(rb_tracearg_from_tracepoint(tp_val));
+  if (!server->attached_) {
+    if (server->call_depth_ > 0)
+      --server->call_depth_;
+    return;
+  }
   EVENT_COMMON_CODE;
 
+  bool stopped = !server->call_timings_.empty() &&
+                 server->LeaveCall(file_path, line);
+  // Also catches instance variables set by C methods of the watched object.
+  if (!stopped && server->has_watchpoints_) {
+    stopped = server->CheckWatchPoints(rb_tracearg_self(trace_arg),
+                                       file_path, line);
+  }
+
   // C returns complicate things, do not process their lines.
   static const ID id_c_return = rb_intern("c_return");
-  if (SYM2ID(event_sym) != id_c_return)
-    ProcessLine(server, file_path, line);
+  if (!stopped && SYM2ID(event_sym) != id_c_return)
+    ProcessLine(server, trace_arg, file_path, line);
 
   if(server->call_depth_ > 0)
     --server->call_depth_;
 
+  if (server->has_watchpoints_)
+    server->DropReturnedWatchPoints();
+
   if (server->call_depth_ == server->stepout_to_call_depth_) {
     server->ClearSuspensionData();
     server->stepout_break_at_next_line_ = true;
@@ -414,14 +1084,265 @@ void Server::Impl::ReturnEvent(VALUE tp_val, void* data) {
 }
 
 void Server::Impl::CallEvent(VALUE tp_val, void* data) {
+  Server::Impl* server = reinterpret_cast<Server::Impl*>(data);
+  server->OnEvent(1);
+  if (server->profiling_)
+    server->line_profiler_.Call(rb_tracearg_from_tracepoint(tp_val));
+  if (server->recording_)
+    server->trace_recorder_.Record(rb_tracearg_from_tracepoint(tp_val));
+  if (!server->attached_) {
+    ++server->call_depth_;
+    return;
+  }
   EVENT_COMMON_CODE;
 
   ++server->call_depth_;
 
+  if (server->has_slow_calls_ || !server->call_timings_.empty())
+    server->EnterCall(trace_arg, event_sym, file_path);
+
   // C calls complicate things, do not process their lines.
   static const ID id_c_call = rb_intern("c_call");
   if (SYM2ID(event_sym) != id_c_call)
-    ProcessLine(server, file_path, line);
+    ProcessLine(server, trace_arg, file_path, line);
+}
+
+// Starts timing a call if it matches a slow-call breakpoint.
+void Server::Impl::EnterCall(rb_trace_arg_t* trace_arg, VALUE event_sym,
+                             const std::string& file_path) {
+  if (active_slow_calls_version_ != slow_calls_version_)
+    SyncSlowCalls();
+  if (active_slow_calls_.empty()) {
+    call_timings_.clear();
+    return;
+  }
+
+  CallTiming timing;
+  timing.start = Clock::NowNanoseconds();
+  timing.suspended_at_start = suspended_time_;
+  timing.breakpoint_index = 0;
+  timing.klass = Qnil;
+  timing.method_id = 0;
+  timing.self = Qnil;
+
+  // Blocks and class bodies are timed as part of their method.
+  static const ID id_call = rb_intern("call");
+  static const ID id_c_call = rb_intern("c_call");
+  ID event_id = SYM2ID(event_sym);
+  if (event_id == id_call || event_id == id_c_call) {
+    ID method_id = SYM2ID(rb_tracearg_method_id(trace_arg));
+    for (auto it = active_slow_calls_.begin(), ite = active_slow_calls_.end();
+         it != ite; ++it) {
+      if (!it->def.method.empty()) {
+        if (method_id != it->method_id)
+          continue;
+        VALUE klass = rb_tracearg_defined_class(trace_arg);
+        if (klass != it->klass) {
+          // The first call of the method names its class.
+          if (it->klass != Qnil || GetMethodName(trace_arg) != it->def.method)
+            continue;
+          it->klass = klass;
+          rb_ary_push(slow_call_classes_, klass);
+        }
+      } else if (event_id == id_c_call ||
+                 !boost::istarts_with(file_path, it->def.path_prefix)) {
+        // The path of a C call is where it is called from.
+        continue;
+      }
+      timing.breakpoint_index = it->def.index;
+      timing.klass = rb_tracearg_defined_class(trace_arg);
+      timing.method_id = method_id;
+      timing.self = rb_tracearg_self(trace_arg);
+      break;
+    }
+  }
+  call_timings_.push_back(timing);
+}
+
+// Takes over the slow-call breakpoints added or removed since the last call,
+// keeping the classes already found.
+void Server::Impl::SyncSlowCalls() {
+  std::vector<ActiveSlowCall> active;
+  {
+    std::lock_guard<std::mutex> lock(break_point_mutex_);
+    for (auto it = slow_calls_.cbegin(), ite = slow_calls_.cend(); it != ite;
+         ++it) {
+      ActiveSlowCall call;
+      call.def = *it;
+      call.method_id = 0;
+      call.klass = Qnil;
+      active.push_back(call);
+    }
+    active_slow_calls_version_ = slow_calls_version_;
+  }
+  if (slow_call_classes_ == Qnil) {
+    slow_call_classes_ = rb_ary_new();
+    rb_gc_register_address(&slow_call_classes_);
+  }
+  rb_ary_clear(slow_call_classes_);
+  for (auto it = active.begin(), ite = active.end(); it != ite; ++it) {
+    if (it->def.method.empty())
+      continue;
+    size_t sep = it->def.method.find_last_of("#.");
+    if (sep == std::string::npos)
+      continue; // Never matches, method_id stays 0
+    it->method_id = rb_intern(it->def.method.c_str() + sep + 1);
+    for (auto itp = active_slow_calls_.cbegin(),
+         itpe = active_slow_calls_.cend(); itp != itpe; ++itp) {
+      if (itp->def.index == it->def.index && itp->klass != Qnil) {
+        it->klass = itp->klass;
+        rb_ary_push(slow_call_classes_, it->klass);
+      }
+    }
+  }
+  active_slow_calls_.swap(active);
+}
+
+// Ends the timing of the returning call. Returns true if it stopped.
+bool Server::Impl::LeaveCall(const std::string& file_path, int line) {
+  const CallTiming timing = call_timings_.back();
+  call_timings_.pop_back();
+  if (timing.breakpoint_index == 0)
+    return false;
+
+  long long elapsed = Clock::NowNanoseconds() - timing.start -
+                      (suspended_time_ - timing.suspended_at_start);
+  auto it = active_slow_calls_.cbegin(), ite = active_slow_calls_.cend();
+  while (it != ite && it->def.index != timing.breakpoint_index)
+    ++it;
+  if (it == ite || elapsed < it->def.threshold_ms * 1000000LL)
+    return false; // Removed in the meantime, or fast enough
+
+  std::ostringstream os;
+  os << "Slow call: "
+     << GetMethodName(timing.klass, timing.method_id, timing.self)
+     << " took " << elapsed / 1000000
+     << " ms (breakpoint " << it->def.index << ", limit "
+     << it->def.threshold_ms << " ms)\n";
+  std::string text = os.str();
+  Log(text.c_str());
+  ui_->Message(text);
+  if (!it->def.suspend)
+    return false;
+  ClearSuspensionData();
+  DoBreak(file_path, line);
+  return true;
+}
+
+VALUE Server::Impl::ReadWatchedValue(const ActiveWatchPoint& wp) const {
+  if (!wp.is_local)
+    return rb_attr_get(wp.target, wp.id);
+#if RDEBUGGER_HAS_LOCAL_VARIABLE_GET
+  static const ID id_local_variable_get = rb_intern("local_variable_get");
+  return ProtectFuncall(wp.target, id_local_variable_get, 1, ID2SYM(wp.id));
+#else
+  // AddWatchPoint refuses locals here.
+  return Qnil;
+#endif
+}
+
+// Takes over the watchpoints added or removed since the last call, keeping
+// the values already seen.
+void Server::Impl::SyncWatchPoints() {
+  std::vector<ActiveWatchPoint> active;
+  {
+    std::lock_guard<std::mutex> lock(break_point_mutex_);
+    active = watchpoints_;
+    active_watchpoints_version_ = watchpoints_version_;
+  }
+  for (auto it = active.begin(), ite = active.end(); it != ite; ++it) {
+    for (auto ito = active_watchpoints_.cbegin(),
+         itoe = active_watchpoints_.cend(); ito != itoe; ++ito) {
+      if (ito->def.index == it->def.index) {
+        it->value = ito->value;
+        it->fingerprint = ito->fingerprint;
+        it->text = ito->text;
+        break;
+      }
+    }
+  }
+  active_watchpoints_.swap(active);
+  rb_ary_clear(watch_values_);
+  for (auto it = active_watchpoints_.cbegin(),
+       ite = active_watchpoints_.cend(); it != ite; ++it) {
+    rb_ary_push(watch_values_, it->target);
+    rb_ary_push(watch_values_, it->value);
+  }
+}
+
+// Checks the watchpoints of the running frame and its self. Returns true if
+// one changed and execution stopped.
+bool Server::Impl::CheckWatchPoints(VALUE self, const std::string& file_path,
+                                    int line) {
+  if (active_watchpoints_version_ != watchpoints_version_)
+    SyncWatchPoints();
+  std::string text;
+  // Reported to the UI as a hit of the first watchpoint that changed.
+  BreakPoint bp;
+  for (size_t i = 0; i < active_watchpoints_.size(); ++i) {
+    ActiveWatchPoint& wp = active_watchpoints_[i];
+    if (wp.is_local ? wp.depth != call_depth_ : wp.target != self)
+      continue;
+    VALUE value = ReadWatchedValue(wp);
+    long long fingerprint = GetFingerprint(value);
+    if (value == wp.value && fingerprint == wp.fingerprint)
+      continue;
+    std::string value_text = GetRubyObjectAsString(value);
+    std::ostringstream os;
+    os << "Watchpoint " << wp.def.index << ": " << wp.def.variable
+       << " changed from " << wp.text << " to " << value_text << "\n";
+    text += os.str();
+    if (bp.index == 0)
+      bp.index = wp.def.index;
+    wp.value = value;
+    wp.fingerprint = fingerprint;
+    wp.text = value_text;
+    rb_ary_store(watch_values_, static_cast<long>(i * 2 + 1), value);
+  }
+  if (text.empty())
+    return false;
+  Log(text.c_str());
+  ui_->Message(text);
+  bp.file = file_path;
+  bp.line = line;
+  bp.enabled = true;
+  ClearSuspensionData();
+  DoBreak(bp);
+  return true;
+}
+
+// Locals cannot change once their frame has returned.
+void Server::Impl::DropReturnedWatchPoints() {
+  std::vector<size_t> indices;
+  for (auto it = active_watchpoints_.cbegin(),
+       ite = active_watchpoints_.cend(); it != ite; ++it) {
+    if (it->is_local && call_depth_ < it->depth)
+      indices.push_back(it->def.index);
+  }
+  if (indices.empty())
+    return;
+  std::ostringstream os;
+  {
+    std::lock_guard<std::mutex> lock(break_point_mutex_);
+    for (auto it = watchpoints_.begin(); it != watchpoints_.end(); ) {
+      if (std::find(indices.begin(), indices.end(), it->def.index) !=
+          indices.end()) {
+        os << "Watchpoint " << it->def.index << " on " << it->def.variable
+           << " removed, its frame returned\n";
+        it = watchpoints_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    has_watchpoints_ = !watchpoints_.empty();
+    ++watchpoints_version_;
+  }
+  SyncWatchPoints();
+  std::string text = os.str();
+  if (!text.empty()) {
+    Log(text.c_str());
+    ui_->Message(text);
+  }
 }
 
 void Server::Impl::ClearSuspensionData() {
@@ -432,26 +1353,276 @@ void Server::Impl::ClearSuspensionData() {
   stepover_to_call_depth_ = -1;
 }
 
+// Finds and deletes the temporary breakpoint at a line, in one step so that
+// it fires only once.
+bool Server::Impl::TakeTemporaryBreakPoint(const std::string& file_path,
+                                           size_t line,
+                                           TemporaryBreakPoint& hit) {
+  std::lock_guard<std::mutex> lock(break_point_mutex_);
+  for (auto it = temp_breakpoints_.begin(), ite = temp_breakpoints_.end();
+       it != ite; ++it) {
+    if (it->bp.line != line)
+      continue;
+    if (it->resolved ? !boost::iequals(it->bp.file, file_path) :
+        FindSubstringCaseInsensitive(file_path, it->bp.file) < 0)
+      continue;
+    hit = *it;
+    hit.bp.file = file_path;
+    temp_breakpoints_.erase(it);
+    has_temp_breakpoints_ = !temp_breakpoints_.empty();
+    return true;
+  }
+  return false;
+}
+
+// A run to line is over once execution stops, wherever that is.
+void Server::Impl::DropRunToBreakPoints() {
+  std::lock_guard<std::mutex> lock(break_point_mutex_);
+  for (auto it = temp_breakpoints_.begin(); it != temp_breakpoints_.end(); ) {
+    if (it->run_to)
+      it = temp_breakpoints_.erase(it);
+    else
+      ++it;
+  }
+  has_temp_breakpoints_ = !temp_breakpoints_.empty();
+}
+
+// Called only when a step or pause would stop, so the lock is not taken per
+// line.
+bool Server::Impl::IsStepFiltered(rb_trace_arg_t* trace_arg) {
+  if (active_step_filters_version_ != step_filters_version_) {
+    std::lock_guard<std::mutex> lock(break_point_mutex_);
+    step_filter_.Set(step_filters_);
+    active_step_filters_version_ = step_filters_version_;
+  }
+  return !step_filter_.IsEmpty() && step_filter_.IsFiltered(trace_arg);
+}
+
+// Counts a step of a repeated step and arms the next one. Returns false if
+// this is the line to stop at.
+bool Server::Impl::RepeatStep(rb_trace_arg_t* trace_arg,
+                              const std::string& file_path, int line) {
+  ++repeat_.steps;
+  if (repeat_.trace && repeat_.traced_lines < kMaxRepeatTraceLines) {
+    if (repeat_.trace_file != file_path) {
+      if (!repeat_.trace_text.empty())
+        repeat_.trace_text += "\n";
+      repeat_.trace_text += "  " + file_path + ":";
+      repeat_.trace_file = file_path;
+    }
+    repeat_.trace_text += " " + boost::lexical_cast<std::string>(line);
+    ++repeat_.traced_lines;
+  }
+
+  bool done = repeat_.remaining > 0 && --repeat_.remaining == 0;
+  if (!done && !repeat_.until.empty()) {
+    // Only the binding of the running frame is needed, not the whole stack.
+    VALUE value = EvaluateRubyExpressionAsValue(repeat_.until,
+                                                rb_tracearg_binding(trace_arg));
+    if (RTEST(rb_obj_is_kind_of(value, rb_eException))) {
+      std::string text = "Step condition failed: " +
+                         GetRubyObjectAsString(value) + "\n";
+      Log(text.c_str());
+      ui_->Message(text);
+      done = true;
+    } else {
+      done = RTEST(value);
+    }
+  }
+  if (done)
+    return false;
+
+  ClearSuspensionData();
+  if (repeat_.step_over) {
+    stepover_break_at_next_line_ = true;
+    stepover_to_call_depth_ = call_depth_;
+  } else {
+    break_at_next_line_ = true;
+  }
+  return true;
+}
+
+// Called at every stop. A repeated step ends there, wherever it stopped.
+void Server::Impl::EndRepeatedStep() {
+  if (repeat_.active.exchange(false)) {
+    // Armed for a next step that will not be taken.
+    ClearSuspensionData();
+  }
+  if (repeat_.trace_text.empty())
+    return;
+  std::ostringstream os;
+  os << "Stepped " << repeat_.steps << " lines:\n" << repeat_.trace_text;
+  if (repeat_.traced_lines < repeat_.steps)
+    os << " ...";
+  os << "\n";
+  repeat_.trace_text.clear();
+  std::string text = os.str();
+  Log(text.c_str());
+  ui_->Message(text);
+}
+
 // Performs necessary operations when a suspension point is hit.
 void Server::Impl::DoBreak(const std::string& file_path, size_t line) {
-  frames_ = GetStackFrames();
+  if (has_temp_breakpoints_)
+    DropRunToBreakPoints();
+  EndRepeatedStep();
+  CaptureStack();
   last_break_file_path_ = file_path;
   last_break_line_ = line;
   is_stopped_ = true;
+  if (watchdog_)
+    watchdog_->LeaveRuby();
+  if (profiling_)
+    line_profiler_.Pause(); // Time spent stopped is not charged to the line
+  long long break_start = Clock::NowNanoseconds();
   ui_->Break(file_path, line); // Blocked here until ui says continue
+  suspended_time_ += Clock::NowNanoseconds() - break_start;
+  if (watchdog_ && watchdog_depth_ > 0)
+    watchdog_->EnterRuby();
   ClearBreakData();
 }
 
 // Performs necessary operations when a break point is hit.
 void Server::Impl::DoBreak(const BreakPoint& bp) {
-  frames_ = GetStackFrames();
+  if (has_temp_breakpoints_)
+    DropRunToBreakPoints();
+  EndRepeatedStep();
+  CaptureStack();
   last_break_file_path_ = bp.file;
   last_break_line_ = bp.line;
   is_stopped_ = true;
+  if (watchdog_)
+    watchdog_->LeaveRuby();
+  if (profiling_)
+    line_profiler_.Pause(); // Time spent stopped is not charged to the line
+  long long break_start = Clock::NowNanoseconds();
   ui_->Break(bp); // Blocked here until ui says continue
+  suspended_time_ += Clock::NowNanoseconds() - break_start;
+  if (watchdog_ && watchdog_depth_ > 0)
+    watchdog_->EnterRuby();
   ClearBreakData();
 }
 
+bool Server::Impl::MoveInHistory(HistoryMove move,
+                                 size_t& breakpoint_index) {
+  breakpoint_index = 0;
+  const size_t size = history_.size();
+  size_t age = history_age_;
+  const size_t depth = age == 0 ? call_depth_ : history_.Get(age).depth;
+  switch (move) {
+  case HISTORY_STEP_BACK:
+    do {
+      ++age;
+    } while (age <= size && history_.Get(age).depth > depth);
+    break;
+  case HISTORY_REVERSE_CONTINUE:
+    do {
+      ++age;
+    } while (age <= size && GetHistoryBreakPoint(age) == 0);
+    // Without an earlier breakpoint hit, go as far back as possible.
+    if (age > size && size > history_age_)
+      age = size;
+    break;
+  case HISTORY_STEP:
+  case HISTORY_STEP_OVER:
+  case HISTORY_STEP_OUT:
+  case HISTORY_CONTINUE:
+    if (age == 0)
+      return false;
+    do {
+      --age;
+    } while (age > 0 &&
+             ((move == HISTORY_STEP_OVER && history_.Get(age).depth > depth) ||
+              (move == HISTORY_STEP_OUT && history_.Get(age).depth >= depth) ||
+              (move == HISTORY_CONTINUE && GetHistoryBreakPoint(age) == 0)));
+    break;
+  }
+  if (age > size || age == history_age_)
+    return false;
+
+  history_age_ = age;
+  active_frame_index_ = 0;
+  if (age == 0) {
+    history_frames_.clear();
+    history_frame_ages_.clear();
+    auto bp = GetBreakPoint(last_break_file_path_, last_break_line_);
+    if (bp != nullptr)
+      breakpoint_index = bp->index;
+  } else {
+    BuildHistoryFrames();
+    breakpoint_index = GetHistoryBreakPoint(age);
+  }
+  return true;
+}
+
+// Returns the index of the breakpoint at a line of the history, or 0.
+size_t Server::Impl::GetHistoryBreakPoint(size_t age) const {
+  const ExecutionHistory::Entry& entry = history_.Get(age);
+  auto bp = GetBreakPoint(history_.GetFile(entry), entry.line);
+  return bp == nullptr ? 0 : bp->index;
+}
+
+// The caller of a frame is at the latest older line with a smaller depth,
+// as long as that line is still in the history.
+void Server::Impl::BuildHistoryFrames() {
+  history_frames_.clear();
+  history_frame_ages_.clear();
+  size_t min_depth = static_cast<size_t>(-1);
+  for (size_t age = history_age_; age <= history_.size() && min_depth > 1;
+       ++age) {
+    const ExecutionHistory::Entry& entry = history_.Get(age);
+    if (entry.depth >= min_depth)
+      continue;
+    min_depth = entry.depth;
+    StackFrame frame;
+    frame.file = history_.GetFile(entry);
+    frame.line = entry.line;
+    frame.name = frame.file + ":" +
+        boost::lexical_cast<std::string>(entry.line) + " (history)";
+    frame.level = entry.depth;
+    frame.iseq = Qnil;
+    history_frames_.push_back(frame);
+    history_frame_ages_.push_back(age);
+  }
+}
+
+const std::string& Server::Impl::GetShownFilePath() const {
+  if (history_age_ == 0)
+    return last_break_file_path_;
+  return history_.GetFile(history_.Get(history_age_));
+}
+
+size_t Server::Impl::GetShownLine() const {
+  if (history_age_ == 0)
+    return last_break_line_;
+  return history_.Get(history_age_).line;
+}
+
+// Locals kept with the line of the active frame. Their values are the
+// objects the locals referred to then, in their current state.
+IDebugServer::VariablesVector Server::Impl::GetHistoryLocals(
+    size_t start, size_t count) const {
+  IDebugServer::VariablesVector vec;
+  if (active_frame_index_ >= history_frame_ages_.size())
+    return vec;
+  VALUE locals = history_.GetLocals(history_frame_ages_[active_frame_index_]);
+  if (locals == Qnil)
+    return vec;
+  size_t end = GetPageEnd(RARRAY_LEN(locals), start, count);
+  for (size_t i = start; i < end; ++i) {
+    VALUE pair = rb_ary_entry(locals, i);
+    VALUE val = rb_ary_entry(pair, 1);
+    Variable var;
+    var.name = GetRubyObjectAsString(rb_ary_entry(pair, 0));
+    var.object_id = val;
+    var.value = GetRubyObjectAsString(val);
+    var.type = rb_obj_classname(val);
+    var.has_children = rb_ivar_count(val) > 0;
+    vec.push_back(var);
+  }
+  return vec;
+}
+
 static int EachKeyValFunc(VALUE key, VALUE val, VALUE data) {
   Server::Impl* impl = reinterpret_cast<Server::Impl*>(data);
   std::string file_path = StringValueCStr(key);
@@ -517,25 +1688,99 @@ void Server::Impl::AddBreakPoint(BreakPoint& bp, bool is_resolved) {
   
   if (is_resolved) {
     auto& bp_map = breakpoints_[bp.line];
-    bp_map.insert(std::make_pair(bp.file, bp));
+    auto result = bp_map.insert(std::make_pair(bp.file, bp));
+    // Takes the place of a breakpoint of the previous client.
+    if (!result.second && IsDetachedBreakPoint(result.first->second))
+      result.first->second = bp;
   } else {
     unresolved_breakpoints_.push_back(bp);
   }
 }
 
-std::vector<StackFrame> Server::Impl::GetStackFrames() {
-  std::vector<StackFrame> frames;
-  rb_debug_inspector_open(&DebugInspectorFunc, &frames);
-  return frames;
+// Drops the breakpoints of a client that has detached. Ruby thread only.
+void Server::Impl::DropDetachedBreakPoints() {
+  std::lock_guard<std::mutex> lock(break_point_mutex_);
+  for (auto it = breakpoints_.begin(); it != breakpoints_.end(); ) {
+    auto& map = it->second;
+    for (auto itm = map.begin(); itm != map.end(); ) {
+      if (IsDetachedBreakPoint(itm->second))
+        itm = map.erase(itm);
+      else
+        ++itm;
+    }
+    if (map.empty())
+      it = breakpoints_.erase(it);
+    else
+      ++it;
+  }
+  unresolved_breakpoints_.erase(
+      std::remove_if(unresolved_breakpoints_.begin(),
+                     unresolved_breakpoints_.end(),
+                     [this](const BreakPoint& bp) {
+                       return IsDetachedBreakPoint(bp);
+                     }),
+      unresolved_breakpoints_.end());
+  drop_detached_breakpoints_ = false;
+}
+
+// Reads the stack into capture and returns its depth. Ruby thread only.
+size_t Server::Impl::ReadStack(StackCapture& capture,
+                               rb_trace_arg_t* trace_arg) {
+  long long start = Clock::NowNanoseconds();
+  size_t depth = capture.Read(trace_arg);
+  stack_capture_time_ += Clock::NowNanoseconds() - start;
+  ++stack_capture_count_;
+  return depth;
+}
+
+// Strings are only made for the frames the UI asks for.
+StackFrame Server::Impl::MakeStackFrame(const CapturedFrame& captured) const {
+  StackFrame frame;
+  frame.file = frame_strings_.Get(captured.file);
+  frame.line = captured.line;
+  // Same as Thread::Backtrace::Location#to_s.
+  frame.name = frame.file + ":" +
+      boost::lexical_cast<std::string>(captured.line) + ":in `" +
+      frame_strings_.Get(captured.label) + "'";
+  frame.level = captured.level;
+  frame.iseq = captured.iseq;
+  return frame;
+}
+
+// Deep stacks are common, and most stops only ever show the top frame.
+// From Ruby 2.1 reading the stack makes no Ruby objects, and bindings are
+// only made when asked for. On Ruby 2.0 every stop still makes a Location
+// and a Binding for every frame, see StackCapture.
+void Server::Impl::CaptureStack() {
+  ++stop_id_;
+  frames_.clear();
+  stack_depth_ = ReadStack(stop_capture_, event_trace_arg_);
+  ResolveFrames(1);
+}
+
+// Reads the frames of the stop up to count from the capture of the stop,
+// without reading the stack again. Needs the Ruby thread unless the frames
+// were already read.
+void Server::Impl::ResolveFrames(size_t count) {
+  if (count > stack_depth_)
+    count = stack_depth_;
+  while (frames_.size() < count)
+    frames_.push_back(stop_capture_.GetFrame(frames_.size(), frame_strings_));
+}
+
+// Returns the binding of a frame of the stop, or nil. Ruby thread only.
+VALUE Server::Impl::GetFrameBinding(size_t index) {
+  return stop_capture_.GetBinding(index);
 }
 
 VALUE Server::Impl::GetBinding(bool use_toplevel_binding) {
   VALUE binding = 0;
+  if (!use_toplevel_binding)
+    ResolveFrames(active_frame_index_ + 1);
   if (use_toplevel_binding) {
     binding = rb_const_get(rb_cObject, rb_intern("TOPLEVEL_BINDING"));
-  } else if (!frames_.empty() && active_frame_index_ < frames_.size()) {
-    const auto& cur_frame = frames_[active_frame_index_];
-    binding = cur_frame.binding;
+  } else if (active_frame_index_ < frames_.size()) {
+    binding = GetFrameBinding(active_frame_index_);
   } else {
     assert(false);
   }
@@ -556,8 +1801,6 @@ Server& Server::Instance() {
 
 void Server::Start(std::unique_ptr<IDebuggerUI> ui,
                    const std::string& str_debugger) {
-  impl_->EnableTracePoint();
-
   bool is_ide = ui->IsIDE();
 
   if (!is_ide) {
@@ -569,16 +1812,194 @@ void Server::Start(std::unique_ptr<IDebuggerUI> ui,
   }
 
   impl_->LoadBreakPoints();
+  Settings::LoadStepFilters(impl_->step_filters_);
+  ++impl_->step_filters_version_;
+
+  // history=<lines> keeps the lines the client can step back through. It is
+  // off by default, as it costs time on every line. history_locals also
+  // keeps the locals of every line. Set before the client can connect and
+  // ask for HasHistory.
+  std::smatch match;
+  size_t history_size = 0;
+  const std::regex reg_history("history=(\\d+)");
+  if (regex_search(str_debugger, match, reg_history))
+    history_size = boost::lexical_cast<size_t>(match[1]);
+  impl_->history_.Configure(history_size,
+                            boost::icontains(str_debugger, "history_locals"));
+
   impl_->ui_ = std::move(ui);
   impl_->ui_->Initialize(this, str_debugger);
-  impl_->is_stopped_ = true;
   impl_->save_breakpoints_ = !is_ide;
-  impl_->ui_->WaitForContinue();
-  impl_->ClearBreakData();
+
+  // watchdog=<ms> reports the Ruby stack when Ruby code runs for too long.
+  const std::regex reg_watchdog("watchdog=(\\d+)");
+  if (regex_search(str_debugger, match, reg_watchdog)) {
+    Impl* impl = impl_.get();
+    impl_->watchdog_.reset(new Watchdog(
+        boost::lexical_cast<unsigned>(match[1]),
+        [impl](const std::string& reason) {
+          impl->RequestStallCapture(reason);
+        }));
+  }
+
+  // record=<path> keeps the latest events in a memory-mapped ring file of
+  // record_size=<MB> megabytes.
+  const std::regex reg_record("record=(\\S+)");
+  if (regex_search(str_debugger, match, reg_record)) {
+    size_t size_mb = kDefaultRecordSizeMb;
+    const std::regex reg_record_size("record_size=(\\d+)");
+    std::smatch size_match;
+    if (regex_search(str_debugger, size_match, reg_record_size))
+      size_mb = boost::lexical_cast<size_t>(size_match[1]);
+    StartRecording(match[1], size_mb);
+  }
+
+  // In nowait mode SketchUp starts right away and nothing is traced until a
+  // client attaches.
+  bool nowait = boost::icontains(str_debugger, "nowait");
+  if (!nowait)
+    impl_->attached_ = true;
+  impl_->ApplyAttachState();
+#if !RDEBUGGER_HAS_POSTPONED_JOB
+  // Otherwise it is started when the first client detaches.
+  if (nowait)
+    impl_->StartAttachWatcher();
+#endif
+
+  if (!nowait) {
+    impl_->is_stopped_ = true;
+    impl_->ui_->WaitForContinue();
+    impl_->ClearBreakData();
+  }
 }
 
 void Server::Stop() {
-  impl_->DisableTracePoint();
+  // Unlike Detach, breakpoints are kept for the next client.
+  impl_->attached_ = false;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::Attach() {
+  impl_->attached_ = true;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::Detach() {
+  {
+    // The next client sends its own breakpoints.
+    std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+    impl_->first_client_breakpoint_index_ = impl_->last_breakpoint_index + 1;
+    impl_->drop_detached_breakpoints_ = true;
+    impl_->slow_calls_.clear();
+    impl_->has_slow_calls_ = false;
+    ++impl_->slow_calls_version_;
+    impl_->watchpoints_.clear();
+    impl_->has_watchpoints_ = false;
+    ++impl_->watchpoints_version_;
+    impl_->temp_breakpoints_.clear();
+    impl_->has_temp_breakpoints_ = false;
+  }
+  impl_->repeat_.active = false;
+  impl_->ClearSuspensionData();
+  impl_->attached_ = false;
+  impl_->RequestAttachStateUpdate();
+}
+
+bool Server::IsAttached() const {
+  return impl_->attached_;
+}
+
+void Server::StartProfiling() {
+  impl_->profiling_wanted_ = true;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::StopProfiling(const std::string& report_path) {
+  {
+    std::lock_guard<std::mutex> lock(impl_->profile_mutex_);
+    impl_->profile_report_path_ = report_path;
+  }
+  impl_->profiling_wanted_ = false;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::StartAllocationTracking() {
+  if (!AllocationTracker::IsSupported()) {
+    impl_->ui_->Message("Allocation tracking needs Ruby 2.1 or later\n");
+    return;
+  }
+  impl_->allocations_wanted_ = true;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::StopAllocationTracking() {
+  impl_->allocations_wanted_ = false;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::MarkAllocations() {
+  impl_->allocation_tracker_.Mark();
+}
+
+std::string Server::GetAllocationReport(size_t max_sites) const {
+  return impl_->allocation_tracker_.GetReport(max_sites);
+}
+
+bool Server::WriteAllocationReport(const std::string& path,
+                                   size_t max_sites) const {
+  std::ofstream file(path.c_str());
+  file << GetAllocationReport(max_sites);
+  return file.good();
+}
+
+void Server::StartGcMonitoring() {
+  if (!GcMonitor::IsSupported()) {
+    impl_->ui_->Message("GC monitoring needs Ruby 2.1 or later\n");
+    return;
+  }
+  impl_->gc_monitoring_wanted_ = true;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::StopGcMonitoring() {
+  impl_->gc_monitoring_wanted_ = false;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::ResetGcStats() {
+  impl_->gc_monitor_.Reset();
+  impl_->stack_capture_count_ = 0;
+  impl_->stack_capture_time_ = 0;
+}
+
+std::string Server::GetGcStats() const {
+  std::ostringstream os;
+  os << impl_->gc_monitor_.GetReport();
+  long long count = impl_->stack_capture_count_;
+  if (count > 0) {
+    os << "Stack capture: " << count << " reads, "
+       << impl_->stack_capture_time_ / count / 1000 << " us on average\n";
+  }
+  return os.str();
+}
+
+void Server::StartRecording(const std::string& path, size_t size_mb) {
+  {
+    std::lock_guard<std::mutex> lock(impl_->record_mutex_);
+    impl_->record_path_ = path;
+    impl_->record_size_mb_ = size_mb;
+  }
+  impl_->recording_wanted_ = true;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::StopRecording() {
+  impl_->recording_wanted_ = false;
+  impl_->RequestAttachStateUpdate();
+}
+
+void Server::FlushRecording() {
+  impl_->trace_recorder_.Flush();
 }
 
 bool Server::AddBreakPoint(BreakPoint& bp, bool assume_resolved) {
@@ -626,6 +2047,40 @@ bool Server::RemoveBreakPoint(size_t index) {
     }
   }
 
+  // Check slow-call breakpoints
+  if (!removed) {
+    std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+    auto& slow_calls = impl_->slow_calls_;
+    for (auto it = slow_calls.begin(), ite = slow_calls.end(); it != ite;
+         ++it) {
+      if (index == it->index) {
+        slow_calls.erase(it);
+        impl_->has_slow_calls_ = !slow_calls.empty();
+        ++impl_->slow_calls_version_;
+        return true;
+      }
+    }
+    auto& temp_breakpoints = impl_->temp_breakpoints_;
+    for (auto it = temp_breakpoints.begin(), ite = temp_breakpoints.end();
+         it != ite; ++it) {
+      if (index == it->bp.index) {
+        temp_breakpoints.erase(it);
+        impl_->has_temp_breakpoints_ = !temp_breakpoints.empty();
+        return true;
+      }
+    }
+    auto& watchpoints = impl_->watchpoints_;
+    for (auto it = watchpoints.begin(), ite = watchpoints.end(); it != ite;
+         ++it) {
+      if (index == it->def.index) {
+        watchpoints.erase(it);
+        impl_->has_watchpoints_ = !watchpoints.empty();
+        ++impl_->watchpoints_version_;
+        return true;
+      }
+    }
+  }
+
   if (removed) {
     impl_->SaveBreakPoints();
   }
@@ -643,43 +2098,225 @@ std::vector<BreakPoint> Server::GetBreakPoints() const {
        it != ite; ++it) {
     auto& map = it->second;
     for (auto itm = map.cbegin(), itme = map.cend(); itm != itme; ++itm) {
-      bps.push_back(itm->second);
+      if (!impl_->IsDetachedBreakPoint(itm->second))
+        bps.push_back(itm->second);
     }
   }
 
   // Add unresolved breakpoints
-  std::copy(impl_->unresolved_breakpoints_.cbegin(),
-            impl_->unresolved_breakpoints_.cend(), std::back_inserter(bps));
+  for (auto it = impl_->unresolved_breakpoints_.cbegin(),
+       ite = impl_->unresolved_breakpoints_.cend(); it != ite; ++it) {
+    if (!impl_->IsDetachedBreakPoint(*it))
+      bps.push_back(*it);
+  }
 
   // Sort by index
   std::sort(bps.begin(), bps.end(), &SortBreakPoints);
   return bps;
 }
 
+bool Server::AddTemporaryBreakPoint(BreakPoint& bp, bool run_to) {
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  impl_->ReadScriptLinesHash();
+  Impl::TemporaryBreakPoint temp;
+  // IDEs send full paths, which need no resolving.
+  temp.resolved = impl_->script_lines_hash_ == Qnil ||
+                  impl_->ResolveBreakPoint(bp);
+  temp.run_to = run_to;
+  if (bp.index == 0)
+    bp.index = ++impl_->last_breakpoint_index;
+  temp.bp = bp;
+  impl_->temp_breakpoints_.push_back(temp);
+  impl_->has_temp_breakpoints_ = true;
+  return true;
+}
+
+void Server::SetStepFilters(const StepFilters& filters) {
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  impl_->step_filters_ = filters;
+  for (auto it = impl_->step_filters_.paths.begin(),
+       ite = impl_->step_filters_.paths.end(); it != ite; ++it) {
+    boost::replace_all(*it, "\\", "/");
+  }
+  ++impl_->step_filters_version_;
+  Settings::SaveStepFilters(impl_->step_filters_);
+}
+
+StepFilters Server::GetStepFilters() const {
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  return impl_->step_filters_;
+}
+
+bool Server::AddSlowCallBreakPoint(SlowCallBreakPoint& bp) {
+  if (bp.method.empty() == bp.path_prefix.empty())
+    return false;
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  if (bp.index == 0)
+    bp.index = ++impl_->last_breakpoint_index;
+  impl_->slow_calls_.push_back(bp);
+  impl_->has_slow_calls_ = true;
+  ++impl_->slow_calls_version_;
+  return true;
+}
+
+std::vector<SlowCallBreakPoint> Server::GetSlowCallBreakPoints() const {
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  return impl_->slow_calls_;
+}
+
+bool Server::AddWatchPoint(WatchPoint& wp) {
+  if (!IsStopped() || IsInHistory() || wp.variable.empty())
+    return false;
+  Impl::ActiveWatchPoint active;
+  active.is_local = wp.variable[0] != '@';
+  active.id = rb_intern(wp.variable.c_str());
+  active.depth = 0;
+  if (active.is_local) {
+#if !RDEBUGGER_HAS_LOCAL_VARIABLE_GET
+    // Without Binding#local_variable_get the local could only be read by
+    // evaluating its name on every line of the frame.
+    return false;
+#endif
+    impl_->ResolveFrames(wp.frame + 1);
+    const std::vector<CapturedFrame>& frames = impl_->frames_;
+    if (wp.frame >= frames.size() || wp.frame >= impl_->call_depth_)
+      return false;
+    // Looked up by name, evaluating it could call a method instead.
+    VALUE binding = impl_->GetFrameBinding(wp.frame);
+    VALUE locals = EvaluateRubyExpressionAsValue("local_variables", binding);
+    if (TYPE(locals) != T_ARRAY ||
+        !RTEST(rb_ary_includes(locals, ID2SYM(active.id))))
+      return false;
+    active.target = binding;
+    active.depth = impl_->call_depth_ - wp.frame;
+  } else {
+    active.target = static_cast<VALUE>(wp.object_id);
+    if (SPECIAL_CONST_P(active.target) ||
+        !RTEST(rb_ivar_defined(active.target, active.id)))
+      return false;
+  }
+  active.value = impl_->ReadWatchedValue(active);
+  active.fingerprint = GetFingerprint(active.value);
+  active.text = GetRubyObjectAsString(active.value);
+
+  // Kept alive here until the Ruby thread takes the watchpoint over.
+  if (impl_->watch_values_ == Qnil) {
+    impl_->watch_values_ = rb_ary_new();
+    rb_gc_register_address(&impl_->watch_values_);
+  }
+  rb_ary_push(impl_->watch_values_, active.target);
+  rb_ary_push(impl_->watch_values_, active.value);
+
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  if (wp.index == 0)
+    wp.index = ++impl_->last_breakpoint_index;
+  active.def = wp;
+  impl_->watchpoints_.push_back(active);
+  impl_->has_watchpoints_ = true;
+  ++impl_->watchpoints_version_;
+  return true;
+}
+
+std::vector<WatchPoint> Server::GetWatchPoints() const {
+  std::lock_guard<std::mutex> lock(impl_->break_point_mutex_);
+  std::vector<WatchPoint> wps;
+  for (auto it = impl_->watchpoints_.cbegin(),
+       ite = impl_->watchpoints_.cend(); it != ite; ++it) {
+    wps.push_back(it->def);
+  }
+  return wps;
+}
+
 bool Server::IsStopped() const {
   return impl_->is_stopped_;
 }
 
 Variable Server::EvaluateExpression(const std::string& expr) {
  Variable eval_res;
- if (!impl_->frames_.empty() &&
-     impl_->active_frame_index_ < impl_->frames_.size()) {
-   const auto& cur_frame = impl_->frames_[impl_->active_frame_index_];
-   eval_res = EvaluateRubyExpression(expr, cur_frame.binding);
+ impl_->ResolveFrames(impl_->active_frame_index_ + 1);
+ if (impl_->history_age_ > 0) {
+   // Nothing can run in the past, only kept locals can be looked up.
+   VariablesVector locals = impl_->GetHistoryLocals(0, 0);
+   for (auto it = locals.cbegin(), ite = locals.cend(); it != ite; ++it) {
+     if (it->name == expr) {
+       eval_res = *it;
+       return eval_res;
+     }
+   }
+   eval_res.name = expr;
+   eval_res.value = "Only kept local variables can be evaluated in the history";
+ } else if (impl_->active_frame_index_ < impl_->frames_.size()) {
+   eval_res = EvaluateRubyExpression(
+       expr, impl_->GetFrameBinding(impl_->active_frame_index_));
  } else {
    eval_res.value = "Expression cannot be evaluated";
  }
  return eval_res;
 }
 
-std::vector<StackFrame> Server::GetStackFrames() const {
-  return impl_->frames_;
+std::vector<StackFrame> Server::GetStackFrames(size_t start_frame,
+                                              size_t levels) const {
+  size_t end_frame = static_cast<size_t>(-1);
+  if (levels > 0 && start_frame + levels > start_frame)
+    end_frame = start_frame + levels;
+  if (impl_->history_age_ > 0) {
+    const std::vector<StackFrame>& frames = impl_->history_frames_;
+    if (start_frame >= frames.size())
+      return std::vector<StackFrame>();
+    if (end_frame > frames.size())
+      end_frame = frames.size();
+    return std::vector<StackFrame>(frames.begin() + start_frame,
+                                   frames.begin() + end_frame);
+  }
+  impl_->ResolveFrames(end_frame);
+  std::vector<StackFrame> frames;
+  for (size_t i = start_frame; i < end_frame && i < impl_->frames_.size();
+       ++i) {
+    frames.push_back(impl_->MakeStackFrame(impl_->frames_[i]));
+  }
+  return frames;
+}
+
+size_t Server::GetStackDepth() const {
+  if (impl_->history_age_ > 0)
+    return impl_->history_frames_.size();
+  return impl_->stack_depth_;
+}
+
+size_t Server::GetStopId() const {
+  return impl_->stop_id_;
+}
+
+std::vector<StackFrame> Server::GetStackFrameChanges(size_t known_stop_id,
+                                                     size_t& unchanged) {
+  unchanged = 0;
+  if (impl_->history_age_ > 0) {
+    // Frames rebuilt from the history have nothing to compare.
+    impl_->sent_stop_id_ = 0;
+    return GetStackFrames(0, 0);
+  }
+  impl_->ResolveFrames(impl_->stack_depth_);
+  const std::vector<CapturedFrame>& frames = impl_->frames_;
+  std::vector<CapturedFrame>& sent = impl_->sent_frames_;
+  if (known_stop_id != 0 && known_stop_id == impl_->sent_stop_id_) {
+    // Stepping changes the top of the stack, the bottom stays the same.
+    while (unchanged < frames.size() && unchanged < sent.size() &&
+           IsSameFrame(frames[frames.size() - 1 - unchanged],
+                       sent[sent.size() - 1 - unchanged]))
+      ++unchanged;
+  }
+  std::vector<StackFrame> changed;
+  for (size_t i = 0; i + unchanged < frames.size(); ++i)
+    changed.push_back(impl_->MakeStackFrame(frames[i]));
+  sent = frames;
+  impl_->sent_stop_id_ = impl_->stop_id_;
+  return changed;
 }
 
 void Server::ShiftActiveFrame(bool shift_up) {
   if (IsStopped()) {
     if (shift_up) {
-      if (impl_->active_frame_index_ + 1 < impl_->frames_.size())
+      if (impl_->active_frame_index_ + 1 < GetStackDepth())
         impl_->active_frame_index_ += 1;
     } else {
       if (impl_->active_frame_index_ > 0)
@@ -697,12 +2334,15 @@ void Server::SetActiveFrameIndex(size_t index) const {
 }
 
 void Server::Step() {
-  if (IsStopped())
+  if (IsStopped()) {
+    impl_->repeat_.active = false;
     impl_->break_at_next_line_ = true;
+  }
 }
 
 void Server::StepOver() {
   if (IsStopped()) {
+    impl_->repeat_.active = false;
     impl_->stepover_break_at_next_line_ = true;
     impl_->stepover_to_call_depth_ = impl_->call_depth_;
   }
@@ -710,29 +2350,78 @@ void Server::StepOver() {
 
 void Server::StepOut() {
   if (IsStopped() && impl_->call_depth_ > 1) {
+    impl_->repeat_.active = false;
     impl_->stepout_to_call_depth_ = impl_->call_depth_ - 1;
   }
 }
 
+void Server::StepRepeatedly(bool step_over, size_t count,
+                            const std::string& until, bool trace) {
+  if (!IsStopped())
+    return;
+  if (step_over)
+    StepOver();
+  else
+    Step();
+  // A single step needs no help from the Ruby thread.
+  if (count == 1 || (count == 0 && until.empty()))
+    return;
+  Impl::RepeatedStep& repeat = impl_->repeat_;
+  repeat.step_over = step_over;
+  repeat.remaining = count;
+  repeat.until = until;
+  repeat.trace = trace;
+  repeat.steps = 0;
+  repeat.trace_text.clear();
+  repeat.trace_file.clear();
+  repeat.traced_lines = 0;
+  repeat.active = true;
+}
+
+bool Server::MoveInHistory(HistoryMove move, size_t& breakpoint_index) {
+  breakpoint_index = 0;
+  if (!IsStopped())
+    return false;
+  return impl_->MoveInHistory(move, breakpoint_index);
+}
+
+bool Server::IsInHistory() const {
+  return impl_->history_age_ > 0;
+}
+
+bool Server::HasHistory() const {
+  return impl_->history_.IsEnabled();
+}
+
+bool Server::Pause() {
+  // The line tracepoint is armed whenever a client is attached, so the flag
+  // is picked up at the next line without any extra hooks.
+  if (!IsAttached() || IsStopped())
+    return false;
+  impl_->repeat_.active = false;
+  impl_->break_at_next_line_ = true;
+  return true;
+}
+
 std::vector<std::pair<size_t, std::string>>
       Server::GetCodeLines(size_t beg_line, size_t end_line) const {
   std::vector<std::pair<size_t, std::string>> lines;
   if (IsStopped()) {
     impl_->ReadScriptLinesHash();
 
-    auto itf = impl_->script_lines_.find(impl_->last_break_file_path_);
+    auto itf = impl_->script_lines_.find(impl_->GetShownFilePath());
     if (itf != impl_->script_lines_.end()) {
       const auto& lines_vec = itf->second;
       const size_t expand_lines = 5;
       if (beg_line == 0) {
-        beg_line = impl_->last_break_line_;
+        beg_line = impl_->GetShownLine();
         if (beg_line > expand_lines)
           beg_line -= expand_lines;
         else
           beg_line = 1;
       }
       if (end_line == 0) {
-        end_line = impl_->last_break_line_ + expand_lines;
+        end_line = impl_->GetShownLine() + expand_lines;
       }
       if (end_line >= lines_vec.size() + 1)
         end_line = lines_vec.size();
@@ -747,17 +2436,18 @@ std::vector<std::pair<size_t, std::string>>
 }
 
 size_t Server::GetBreakLineNumber() const {
-  return impl_->last_break_line_;
+  return impl_->GetShownLine();
 }
 
 IDebugServer::VariablesVector Server::GetVariables(const char* type,
-    bool use_toplevel_binding) const {
+    bool use_toplevel_binding, size_t start, size_t count) const {
   VariablesVector vec;
   VALUE binding = impl_->GetBinding(use_toplevel_binding);
   if (binding != 0) {
     VALUE arr_val = EvaluateRubyExpressionAsValue(type, binding);
-    int count = RARRAY_LEN(arr_val);
-    for (int i = 0; i < count; ++i) {
+    // Only the variables of the page are evaluated.
+    size_t end = GetPageEnd(RARRAY_LEN(arr_val), start, count);
+    for (size_t i = start; i < end; ++i) {
       VALUE var_val = RARRAY_PTR(arr_val)[i];
       Variable var;
       var.name = GetRubyObjectAsString(var_val);
@@ -775,19 +2465,24 @@ IDebugServer::VariablesVector Server::GetVariables(const char* type,
   return vec;
 }
 
-IDebugServer::VariablesVector Server::GetGlobalVariables() const {
-  return GetVariables("global_variables", true);
+IDebugServer::VariablesVector Server::GetGlobalVariables(size_t start,
+    size_t count) const {
+  return GetVariables("global_variables", true, start, count);
 }
 
-IDebugServer::VariablesVector Server::GetLocalVariables() const {
-  return GetVariables("local_variables", false);
+IDebugServer::VariablesVector Server::GetLocalVariables(size_t start,
+    size_t count) const {
+  if (impl_->history_age_ > 0)
+    return impl_->GetHistoryLocals(start, count);
+  return GetVariables("local_variables", false, start, count);
 }
 
-IDebugServer::VariablesVector Server::GetInstanceVariables(size_t object_id) const {
+IDebugServer::VariablesVector Server::GetInstanceVariables(size_t object_id,
+    size_t start, size_t count) const {
   VariablesVector vec;
   VALUE var_array = rb_obj_instance_variables(object_id);
-  size_t num_vars = RARRAY_LEN(var_array);
-  for (size_t i = 0; i < num_vars; ++i) {
+  size_t end = GetPageEnd(RARRAY_LEN(var_array), start, count);
+  for (size_t i = start; i < end; ++i) {
     VALUE var_val = RARRAY_PTR(var_array)[i];
     Variable var;
     var.name = GetRubyObjectAsString(var_val);
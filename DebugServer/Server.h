@@ -23,17 +23,74 @@ public:
 
   virtual void Stop();
 
+  virtual void Attach();
+
+  virtual void Detach();
+
+  virtual bool IsAttached() const;
+
+  virtual void StartProfiling();
+
+  virtual void StopProfiling(const std::string& report_path);
+
+  virtual void StartAllocationTracking();
+
+  virtual void StopAllocationTracking();
+
+  virtual void MarkAllocations();
+
+  virtual std::string GetAllocationReport(size_t max_sites) const;
+
+  virtual bool WriteAllocationReport(const std::string& path,
+                                     size_t max_sites) const;
+
+  virtual void StartGcMonitoring();
+
+  virtual void StopGcMonitoring();
+
+  virtual void ResetGcStats();
+
+  virtual std::string GetGcStats() const;
+
+  virtual void StartRecording(const std::string& path, size_t size_mb);
+
+  virtual void StopRecording();
+
+  virtual void FlushRecording();
+
   virtual bool AddBreakPoint(BreakPoint& bp, bool assume_resolved);
 
   virtual bool RemoveBreakPoint(size_t index);
 
   virtual std::vector<BreakPoint> GetBreakPoints() const;
 
+  virtual bool AddTemporaryBreakPoint(BreakPoint& bp, bool run_to);
+
+  virtual bool AddSlowCallBreakPoint(SlowCallBreakPoint& bp);
+
+  virtual std::vector<SlowCallBreakPoint> GetSlowCallBreakPoints() const;
+
+  virtual bool AddWatchPoint(WatchPoint& wp);
+
+  virtual std::vector<WatchPoint> GetWatchPoints() const;
+
+  virtual void SetStepFilters(const StepFilters& filters);
+
+  virtual StepFilters GetStepFilters() const;
+
   virtual bool IsStopped() const;
 
   virtual Variable EvaluateExpression(const std::string& expr);
 
-  virtual std::vector<StackFrame> GetStackFrames() const;
+  virtual std::vector<StackFrame> GetStackFrames(size_t start_frame,
+                                                 size_t levels) const;
+
+  virtual size_t GetStackDepth() const;
+
+  virtual size_t GetStopId() const;
+
+  virtual std::vector<StackFrame> GetStackFrameChanges(size_t known_stop_id,
+                                                       size_t& unchanged);
 
   virtual void ShiftActiveFrame(bool shift_up);
 
@@ -47,24 +104,36 @@ public:
 
   virtual void StepOut();
 
+  virtual void StepRepeatedly(bool step_over, size_t count,
+                              const std::string& until, bool trace);
+
+  virtual bool MoveInHistory(HistoryMove move, size_t& breakpoint_index);
+
+  virtual bool IsInHistory() const;
+  virtual bool HasHistory() const;
+
+  virtual bool Pause();
+
   virtual std::vector<std::pair<size_t, std::string>>
       GetCodeLines(size_t beg_line, size_t end_line) const;
 
   virtual size_t GetBreakLineNumber() const;
 
-  virtual VariablesVector GetGlobalVariables() const;
+  virtual VariablesVector GetGlobalVariables(size_t start,
+                                             size_t count) const;
 
-  virtual VariablesVector GetLocalVariables() const;
+  virtual VariablesVector GetLocalVariables(size_t start, size_t count) const;
 
-  virtual VariablesVector GetInstanceVariables(size_t object_id) const;
+  virtual VariablesVector GetInstanceVariables(size_t object_id, size_t start,
+                                               size_t count) const;
 
   class Impl; // Forward
 private:
   Server();
   ~Server();
 
-  VariablesVector GetVariables(const char* type,
-                               bool use_toplevel_binding) const;
+  VariablesVector GetVariables(const char* type, bool use_toplevel_binding,
+                               size_t start, size_t count) const;
 
   std::unique_ptr<Impl> impl_;
 };
@@ -0,0 +1,221 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./StackCapture.h"
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+#if RDEBUGGER_HAS_PROFILE_FRAMES
+// Enough for most stacks, the buffers grow for deeper ones.
+const size_t kInitialFrames = 256;
+#endif
+
+// Frames without a path or in <main> are those of the Ruby Console, below
+// the code it runs. Ruby 2.x also lists a frame at line 0 with
+// rb_profile_frames at the very bottom, where the thread was set up.
+bool IsConsoleFrame(VALUE path, int line) {
+  return NIL_P(path) || line == 0 || strcmp(RSTRING_PTR(path), "<main>") == 0;
+}
+
+#if !RDEBUGGER_HAS_PROFILE_FRAMES
+ID GetPathId() {
+  static const ID id_path = rb_intern("path");
+  return id_path;
+}
+
+ID GetLinenoId() {
+  static const ID id_lineno = rb_intern("lineno");
+  return id_lineno;
+}
+#endif
+
+} // end anonymous namespace
+
+StackCapture::StackCapture()
+  : depth_(0),
+    trace_arg_(nullptr),
+    bindings_(Qnil),
+    has_all_bindings_(false) {
+#if RDEBUGGER_HAS_PROFILE_FRAMES
+  frames_.resize(kInitialFrames);
+  lines_.resize(kInitialFrames);
+#else
+  locations_ = Qnil;
+#endif
+}
+
+StackCapture::~StackCapture() {
+  if (bindings_ != Qnil)
+    rb_gc_unregister_address(&bindings_);
+#if !RDEBUGGER_HAS_PROFILE_FRAMES
+  if (locations_ != Qnil)
+    rb_gc_unregister_address(&locations_);
+#endif
+}
+
+void StackCapture::KeepAlive() {
+  if (bindings_ == Qnil) {
+    bindings_ = rb_ary_new();
+    rb_gc_register_address(&bindings_);
+  }
+#if !RDEBUGGER_HAS_PROFILE_FRAMES
+  if (locations_ == Qnil) {
+    locations_ = rb_ary_new();
+    rb_gc_register_address(&locations_);
+  }
+#endif
+}
+
+void StackCapture::Clear() {
+  depth_ = 0;
+  trace_arg_ = nullptr;
+  has_all_bindings_ = false;
+  if (bindings_ != Qnil && RARRAY_LEN(bindings_) > 0)
+    rb_ary_clear(bindings_);
+#if !RDEBUGGER_HAS_PROFILE_FRAMES
+  if (locations_ != Qnil && RARRAY_LEN(locations_) > 0)
+    rb_ary_clear(locations_);
+  iseqs_.clear();
+#endif
+}
+
+#if RDEBUGGER_HAS_PROFILE_FRAMES
+
+size_t StackCapture::Read(rb_trace_arg_t* trace_arg) {
+  Clear();
+  trace_arg_ = trace_arg;
+  size_t count;
+  for (;;) {
+    count = rb_profile_frames(0, static_cast<int>(frames_.size()),
+                              frames_.data(), lines_.data());
+    if (count < frames_.size())
+      break;
+    frames_.resize(frames_.size() * 2);
+    lines_.resize(lines_.size() * 2);
+  }
+  // Frames of C functions have no path from Ruby 3.0, and are not listed
+  // before.
+  size_t depth = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (NIL_P(rb_profile_frame_path(frames_[i])))
+      continue;
+    frames_[depth] = frames_[i];
+    lines_[depth] = lines_[i];
+    ++depth;
+  }
+  while (depth > 0 && IsConsoleFrame(rb_profile_frame_path(frames_[depth - 1]),
+                                     lines_[depth - 1]))
+    --depth;
+  depth_ = depth;
+  return depth_;
+}
+
+// The path and label are the strings kept with the code, so reading a frame
+// does not allocate.
+CapturedFrame StackCapture::GetFrame(size_t index,
+                                     RubyStringCache& strings) const {
+  VALUE frame = frames_[index];
+  CapturedFrame captured;
+  captured.file = strings.Intern(rb_profile_frame_path(frame));
+  captured.label = strings.Intern(rb_profile_frame_label(frame));
+  captured.line = lines_[index];
+  captured.level = depth_ - 1 - index;
+  captured.iseq = frame;
+  return captured;
+}
+
+#else
+
+size_t StackCapture::Read(rb_trace_arg_t* trace_arg) {
+  Clear();
+  trace_arg_ = trace_arg;
+  KeepAlive();
+  rb_debug_inspector_open(&InspectorFunc, this);
+  has_all_bindings_ = true;
+  return depth_;
+}
+
+// Location#path and #label return the strings kept with the code, and
+// #lineno a fixnum, so none of them allocate.
+CapturedFrame StackCapture::GetFrame(size_t index,
+                                     RubyStringCache& strings) const {
+  static const ID id_label = rb_intern("label");
+  VALUE location = RARRAY_PTR(locations_)[index];
+  CapturedFrame captured;
+  captured.file = strings.Intern(rb_funcall(location, GetPathId(), 0));
+  captured.label = strings.Intern(rb_funcall(location, id_label, 0));
+  captured.line = FIX2INT(rb_funcall(location, GetLinenoId(), 0));
+  captured.level = depth_ - 1 - index;
+  captured.iseq = iseqs_[index];
+  return captured;
+}
+
+#endif
+
+VALUE StackCapture::GetBinding(size_t index) {
+  if (index >= depth_)
+    return Qnil;
+  if (!has_all_bindings_) {
+    KeepAlive();
+    // The top frame's binding is made without opening the debug inspector.
+    if (index == 0 && trace_arg_ != nullptr) {
+      if (RARRAY_LEN(bindings_) == 0)
+        rb_ary_push(bindings_, rb_tracearg_binding(trace_arg_));
+      return RARRAY_PTR(bindings_)[0];
+    }
+    ReadBindings();
+  }
+  return rb_ary_entry(bindings_, index);
+}
+
+void StackCapture::ReadBindings() {
+  rb_ary_clear(bindings_);
+  rb_debug_inspector_open(&InspectorFunc, this);
+  has_all_bindings_ = true;
+}
+
+// The debug inspector lists the frames of C functions too, without an
+// iseq. The frames with one are those rb_profile_frames lists, in the same
+// order.
+VALUE StackCapture::InspectorFunc(const rb_debug_inspector_t* di,
+                                  void* data) {
+  auto capture = reinterpret_cast<StackCapture*>(data);
+  VALUE bt = rb_debug_inspector_backtrace_locations(di);
+  long bt_count = RARRAY_LEN(bt);
+#if RDEBUGGER_HAS_PROFILE_FRAMES
+  for (long i = 0; i < bt_count &&
+       static_cast<size_t>(RARRAY_LEN(capture->bindings_)) < capture->depth_;
+       ++i) {
+    if (NIL_P(rb_debug_inspector_frame_iseq_get(di, i)))
+      continue;
+    rb_ary_push(capture->bindings_,
+                rb_debug_inspector_frame_binding_get(di, i));
+  }
+#else
+  while (bt_count > 0) {
+    VALUE location = RARRAY_PTR(bt)[bt_count - 1];
+    if (!IsConsoleFrame(rb_funcall(location, GetPathId(), 0),
+                        FIX2INT(rb_funcall(location, GetLinenoId(), 0))))
+      break;
+    --bt_count;
+  }
+  for (long i = 0; i < bt_count; ++i) {
+    VALUE iseq = rb_debug_inspector_frame_iseq_get(di, i);
+    if (NIL_P(iseq))
+      continue;
+    rb_ary_push(capture->locations_, RARRAY_PTR(bt)[i]);
+    rb_ary_push(capture->bindings_,
+                rb_debug_inspector_frame_binding_get(di, i));
+    capture->iseqs_.push_back(iseq);
+  }
+  capture->depth_ = capture->iseqs_.size();
+#endif
+  return Qnil;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
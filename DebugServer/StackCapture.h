@@ -0,0 +1,130 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_STACKCAPTURE_H_
+#define RDEBUGGER_DEBUGSERVER_STACKCAPTURE_H_
+
+#include "./RubyFeatures.h"
+#include "./Profiler/StringTable.h"
+
+#include <ruby/ruby.h>
+#include <ruby/debug.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Interns Ruby strings that live as long as their code, such as the paths
+// and labels of frames. Strings seen before are found by object, without
+// copying them.
+class RubyStringCache {
+public:
+  RubyStringCache() {
+    strings_.Intern(std::string()); // Id 0, for nil
+  }
+
+  uint32_t Intern(VALUE str) {
+    if (NIL_P(str))
+      return 0;
+    const char* ptr = RSTRING_PTR(str);
+    size_t len = RSTRING_LEN(str);
+    auto it = ids_.find(str);
+    // The object may have been collected and its slot reused since.
+    if (it != ids_.end()) {
+      const std::string& known = strings_.Get(it->second);
+      if (known.size() == len && memcmp(known.data(), ptr, len) == 0)
+        return it->second;
+    }
+    uint32_t id = strings_.Intern(std::string(ptr, len));
+    ids_[str] = id;
+    return id;
+  }
+
+  const std::string& Get(uint32_t id) const { return strings_.Get(id); }
+
+private:
+  StringTable strings_;
+  std::unordered_map<VALUE, uint32_t> ids_;
+};
+
+// A frame of the stack, read from a StackCapture.
+struct CapturedFrame {
+  uint32_t file;  // Id in the RubyStringCache
+  uint32_t label; // Id in the RubyStringCache
+  int line;
+  // As in StackFrame.
+  size_t level;
+  VALUE iseq;
+};
+
+// Reads the Ruby frames of the running thread's stack, below the frames of
+// the Ruby Console. Frames of C functions are left out.
+//
+// From Ruby 2.1 the stack is read with rb_profile_frames into buffers that
+// are reused from read to read, so a read allocates no Ruby objects. The
+// debug inspector, which makes a Location and a Binding for every frame of
+// the stack, is only opened when the binding of a frame below the top is
+// asked for, and then once per read. From Ruby 3.2 the frames of blocks
+// carry the label of their method.
+//
+// Ruby 2.0 has no rb_profile_frames. Every read opens the debug inspector
+// there and pays for all the Locations and Bindings.
+class StackCapture {
+public:
+  StackCapture();
+  ~StackCapture();
+
+  // Reads the stack and returns its depth. The binding of trace_arg, if
+  // given, is that of the top frame, and is made only if asked for. It must
+  // stay valid until Clear. Ruby thread only.
+  size_t Read(rb_trace_arg_t* trace_arg);
+
+  size_t depth() const { return depth_; }
+
+  // Returns frame index of the last read, the top one being 0. Ruby thread
+  // only.
+  CapturedFrame GetFrame(size_t index, RubyStringCache& strings) const;
+
+  // Returns the binding of frame index of the last read, or nil. Ruby thread
+  // only.
+  VALUE GetBinding(size_t index);
+
+  // Forgets the last read, and lets the GC have its bindings.
+  void Clear();
+
+private:
+  StackCapture(const StackCapture&);
+  StackCapture& operator=(const StackCapture&);
+
+  void KeepAlive();
+  void ReadBindings();
+
+  static VALUE InspectorFunc(const rb_debug_inspector_t* di, void* data);
+
+  size_t depth_;
+  rb_trace_arg_t* trace_arg_;
+  // Bindings made for the last read, top first. Registered with the GC.
+  VALUE bindings_;
+  // Whether bindings_ has those of all the frames, not just the top one.
+  bool has_all_bindings_;
+#if RDEBUGGER_HAS_PROFILE_FRAMES
+  // Frames and lines of the last read, top first, up to depth_.
+  std::vector<VALUE> frames_;
+  std::vector<int> lines_;
+#else
+  // Locations of the last read, top first. Registered with the GC.
+  VALUE locations_;
+  std::vector<VALUE> iseqs_;
+#endif
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_STACKCAPTURE_H_
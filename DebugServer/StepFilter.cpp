@@ -0,0 +1,134 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./StepFilter.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <cctype>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+char NormalizeChar(char c) {
+  return c == '\\' ? '/' : static_cast<char>(tolower(
+      static_cast<unsigned char>(c)));
+}
+
+// Matches the whole text, case insensitive, with '/' and '\' equal.
+bool MatchGlob(const std::string& pattern, const std::string& text) {
+  size_t p = 0, t = 0;
+  // Position after the last '*' and the text position it was tried at.
+  size_t star = std::string::npos, star_text = 0;
+  while (t < text.size()) {
+    if (p < pattern.size() && pattern[p] == '*') {
+      star = ++p;
+      star_text = t;
+    } else if (p < pattern.size() &&
+               (pattern[p] == '?' ||
+                NormalizeChar(pattern[p]) == NormalizeChar(text[t]))) {
+      ++p;
+      ++t;
+    } else if (star != std::string::npos) {
+      p = star;
+      t = ++star_text;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*')
+    ++p;
+  return p == pattern.size();
+}
+
+} // end anonymous namespace
+
+StepFilter::StepFilter()
+  : last_path_(Qnil),
+    last_file_(kNoFile),
+    keep_alive_(Qnil)
+{}
+
+StepFilter::~StepFilter() {
+}
+
+void StepFilter::Set(const StepFilters& filters) {
+  if (keep_alive_ == Qnil) {
+    keep_alive_ = rb_ary_new();
+    rb_gc_register_address(&keep_alive_);
+  }
+  filters_ = filters;
+  for (size_t i = 0; i < skip_files_.size(); ++i) {
+    skip_files_[i] = IsPathFiltered(paths_.Get(static_cast<uint32_t>(i)));
+  }
+  skip_classes_.clear();
+}
+
+uint32_t StepFilter::GetFileId(rb_trace_arg_t* trace_arg) {
+  VALUE path = rb_tracearg_path(trace_arg);
+  if (path == last_path_)
+    return last_file_;
+  uint32_t id;
+  auto it = file_ids_.find(path);
+  if (it != file_ids_.end()) {
+    id = it->second;
+  } else {
+    std::string str = NIL_P(path) ? std::string() :
+        std::string(RSTRING_PTR(path), RSTRING_LEN(path));
+    id = paths_.Intern(str);
+    if (id >= skip_files_.size())
+      skip_files_.push_back(IsPathFiltered(str));
+    file_ids_.insert(std::make_pair(path, id));
+    rb_ary_push(keep_alive_, path);
+  }
+  last_path_ = path;
+  last_file_ = id;
+  return id;
+}
+
+bool StepFilter::IsPathFiltered(const std::string& path) const {
+  for (auto it = filters_.paths.cbegin(), ite = filters_.paths.cend();
+       it != ite; ++it) {
+    if (MatchGlob(*it, path))
+      return true;
+  }
+  return false;
+}
+
+bool StepFilter::IsClassFiltered(rb_trace_arg_t* trace_arg) {
+  VALUE klass = rb_tracearg_defined_class(trace_arg);
+  auto it = skip_classes_.find(klass);
+  if (it != skip_classes_.end())
+    return it->second;
+
+  bool skip = false;
+  VALUE named = klass;
+  if (RB_TYPE_P(named, T_ICLASS)) {
+    // Methods of included modules may report the include class.
+    named = RBASIC(named)->klass;
+  } else if (RB_TYPE_P(named, T_CLASS) && FL_TEST(named, FL_SINGLETON)) {
+    // Singleton methods are filtered with their class or module.
+    VALUE self = rb_tracearg_self(trace_arg);
+    named = RB_TYPE_P(self, T_CLASS) || RB_TYPE_P(self, T_MODULE) ?
+        self : rb_obj_class(self);
+  }
+  if (RB_TYPE_P(named, T_CLASS) || RB_TYPE_P(named, T_MODULE)) {
+    std::string name = rb_class2name(named);
+    for (auto itf = filters_.classes.cbegin(), itfe = filters_.classes.cend();
+         itf != itfe; ++itf) {
+      if (name == *itf || boost::starts_with(name, *itf + "::")) {
+        skip = true;
+        break;
+      }
+    }
+  }
+  skip_classes_.insert(std::make_pair(klass, skip));
+  rb_ary_push(keep_alive_, klass);
+  return skip;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,72 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_STEPFILTER_H_
+#define RDEBUGGER_DEBUGSERVER_STEPFILTER_H_
+
+#include <Common/StepFilters.h>
+#include <DebugServer/Profiler/StringTable.h>
+
+#include <ruby/ruby.h>
+#include <ruby/debug.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Decides whether stepping may stop at a line. Path filters are matched once
+// per file when the file is first seen, or when the filters change, and kept
+// as a skip flag indexed by file id. Consecutive lines nearly always come
+// from the same file, so a line usually costs a pointer compare and a flag
+// read. Class filters are cached per class the same way. All methods must
+// be called on the Ruby thread.
+class StepFilter {
+public:
+  StepFilter();
+  ~StepFilter();
+
+  void Set(const StepFilters& filters);
+
+  bool IsEmpty() const { return filters_.empty(); }
+
+  // Returns true if the line of a line, call or return event is in filtered
+  // code.
+  bool IsFiltered(rb_trace_arg_t* trace_arg) {
+    if (!filters_.paths.empty() && skip_files_[GetFileId(trace_arg)])
+      return true;
+    return !filters_.classes.empty() && IsClassFiltered(trace_arg);
+  }
+
+private:
+  StepFilter(const StepFilter&);
+  StepFilter& operator=(const StepFilter&);
+
+  static const uint32_t kNoFile = 0xffffffff;
+
+  uint32_t GetFileId(rb_trace_arg_t* trace_arg);
+  bool IsPathFiltered(const std::string& path) const;
+  bool IsClassFiltered(rb_trace_arg_t* trace_arg);
+
+  StepFilters filters_;
+
+  StringTable paths_;
+  std::unordered_map<VALUE, uint32_t> file_ids_;
+  // Indexed by file id.
+  std::vector<char> skip_files_;
+  VALUE last_path_;
+  uint32_t last_file_;
+
+  std::unordered_map<VALUE, bool> skip_classes_;
+
+  // Keeps the path strings and classes used as map keys alive.
+  VALUE keep_alive_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_STEPFILTER_H_
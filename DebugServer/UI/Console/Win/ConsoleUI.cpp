@@ -8,6 +8,7 @@
 #include <DebugServer/IDebugServer.h>
 #include <Common/BreakPoint.h>
 #include <Common/StackFrame.h>
+#include <Common/StepFilters.h>
 
 #include <boost/lexical_cast.hpp>
 
@@ -36,11 +37,18 @@ void PrintHelp() {
   "Commands\n"
   "  b[reak] file:line          set breakpoint to some position\n"
   "  b[reak]                    list breakpoints\n"
+  "  tb[reak] file:line         set breakpoint removed when first hit\n"
   "  del[ete]                   delete a breakpoint\n"
   "  c[ont]                     run until program ends or hits a breakpoint\n"
+  "  runto file:line            run until some position or a breakpoint\n"
   "  s[tep]                     step (into methods) one line\n"
   "  s[tep] o[ut]               step out of the current method\n"
   "  n[ext]                     go over one line, stepping over methods\n"
+  "  s[tep]|n[ext] [trace] [count] [until expression]\n"
+  "                             step count times or until expression is true\n"
+  "  filter                     list step filters\n"
+  "  filter path|class <name>   do not step into files or classes\n"
+  "  filter clear               delete all step filters\n"
   "  w[here]                    display frames\n"
   "  f[rame]                    alias for where\n"
   "  l[ist]                     list program\n"
@@ -153,13 +161,19 @@ bool ConsoleUI::EvaluateCommand(const std::string& str_command) {
 
   static const std::regex reg_brk_list("^\\s*b(?:reak)?$");
   static const std::regex reg_brk("^\\s*b(?:reak)?\\s+(?:(.+):)?([^.:]+)$");
+  static const std::regex reg_tbrk("^\\s*tb(?:reak)?\\s+(?:(.+):)?([^.:]+)$");
+  static const std::regex reg_run_to("^\\s*runto\\s+(?:(.+):)?([^.:]+)$");
   static const std::regex reg_brk_del("^\\s*del(?:ete)?(?:\\s+(\\d+))?$");
+  static const std::regex reg_filter(
+      "^\\s*filter(?:\\s+(path|class)\\s+(.+)|\\s+(clear))?$");
   static const std::regex reg_cont("^\\s*c(?:ont)?$");
   static const std::regex reg_help("^\\s*h(?:elp)?$");
   static const std::regex reg_where("^\\s*w(?:here)?$");
   static const std::regex reg_frame("^\\s*f(?:rame)?$");
   static const std::regex reg_step("^\\s*s(?:tep)?\\s?");
-  static const std::regex reg_next("^\\s*n(?:ext)?$");
+  static const std::regex reg_next("^\\s*n(?:ext)?(?:\\s+(.+))?$");
+  static const std::regex reg_repeat(
+      "^(trace\\s*)?(\\d+)?\\s*(?:until\\s+(.+))?$");
   static const std::regex reg_list("^\\s*l(?:ist)?$");
   static const std::regex reg_up("^\\s*up?$");
   static const std::regex reg_down("^\\s*down?$");
@@ -198,37 +212,91 @@ bool ConsoleUI::EvaluateCommand(const std::string& str_command) {
         is_legal_command = true;
       } catch(boost::bad_lexical_cast&) {}
     }
+  } else if (regex_match(str_command, what, reg_tbrk) ||
+             regex_match(str_command, what, reg_run_to)) {
+    // Add temporary breakpoint, or run to a line through one
+    bool run_to = !regex_match(str_command, reg_tbrk);
+    BreakPoint bp;
+    bp.file = what[1];
+    try {
+      bp.line = boost::lexical_cast<size_t>(what[2]);
+      bp.enabled = true;
+      if (server_->AddTemporaryBreakPoint(bp, run_to)) {
+        if (run_to) {
+          signal_server_can_continue = true;
+        } else {
+          WriteText("Added temporary breakpoint:");
+          WriteBreakPoint(bp);
+        }
+      } else {
+        WriteText("Cannot add breakpoint");
+      }
+      is_legal_command = true;
+    } catch(boost::bad_lexical_cast&) {}
+  } else if (regex_match(str_command, what, reg_filter)) {
+    // Change or list step filters
+    StepFilters filters = server_->GetStepFilters();
+    if (what[1] == "path") {
+      filters.paths.push_back(what[2]);
+    } else if (what[1] == "class") {
+      filters.classes.push_back(what[2]);
+    } else if (what[3].matched) {
+      filters = StepFilters();
+    }
+    if (what[1].matched || what[3].matched) {
+      server_->SetStepFilters(filters);
+      filters = server_->GetStepFilters();
+    }
+    for (size_t i = 0; i < filters.paths.size(); ++i)
+      std::cout << "  path " << filters.paths[i] << "\n";
+    for (size_t i = 0; i < filters.classes.size(); ++i)
+      std::cout << "  class " << filters.classes[i] << "\n";
+    is_legal_command = true;
   } else if (regex_match(str_command, reg_cont)) {
     signal_server_can_continue = true;
     is_legal_command = true;
   } else if (regex_search(str_command, what, reg_step)) {
     std::string suffix = what.suffix();
     static const std::regex reg_out("^o(ut)?$");
+    std::smatch repeat;
     if (regex_match(suffix, reg_out)) {
       server_->StepOut();
-    } else {
-      server_->Step();
+      signal_server_can_continue = true;
+      is_legal_command = true;
+    } else if (regex_match(suffix, repeat, reg_repeat)) {
+      size_t count = repeat[2].matched ?
+          boost::lexical_cast<size_t>(repeat[2]) : 0;
+      server_->StepRepeatedly(false, count, repeat[3], repeat[1].matched);
+      signal_server_can_continue = true;
+      is_legal_command = true;
+    }
+  } else if (regex_match(str_command, what, reg_next)) {
+    std::string suffix = what[1];
+    std::smatch repeat;
+    if (regex_match(suffix, repeat, reg_repeat)) {
+      size_t count = repeat[2].matched ?
+          boost::lexical_cast<size_t>(repeat[2]) : 0;
+      server_->StepRepeatedly(true, count, repeat[3], repeat[1].matched);
+      signal_server_can_continue = true;
+      is_legal_command = true;
     }
-    signal_server_can_continue = true;
-    is_legal_command = true;
-  } else if (regex_match(str_command, reg_next)) {
-    server_->StepOver();
-    signal_server_can_continue = true;
-    is_legal_command = true;
   } else if (regex_match(str_command, reg_help)) {
     PrintHelp();
     is_legal_command = true;
-  } else if (regex_match(str_command, reg_up)) {
-    server_->ShiftActiveFrame(true);
-    WriteFrames();
-    is_legal_command = true;
-  } else if (regex_match(str_command, reg_down)) {
-    server_->ShiftActiveFrame(false);
-    WriteFrames();
-    is_legal_command = true;
-  } else if (regex_match(str_command, reg_where) ||
+  } else if (regex_match(str_command, reg_up) ||
+             regex_match(str_command, reg_down) ||
+             regex_match(str_command, reg_where) ||
              regex_match(str_command, reg_frame)) {
-    WriteFrames();
+    if (regex_match(str_command, reg_up))
+      server_->ShiftActiveFrame(true);
+    else if (regex_match(str_command, reg_down))
+      server_->ShiftActiveFrame(false);
+    // Frames below the top one are read in the server thread.
+    if (server_->IsStopped()) {
+      need_what_from_server_ = NEED_FRAMES;
+      need_server_response_ = true;
+      write_prompt = false;
+    }
     is_legal_command = true;
   } else if (regex_match(str_command, reg_list)) {
     WriteCodeLines();
@@ -312,6 +380,8 @@ void ConsoleUI::WaitForContinue() {
       } else if (need_what_from_server_ == NEED_LOCAL_VARS) {
         IDebugServer::VariablesVector var_vec = server_->GetLocalVariables();
         WriteVariables(var_vec);
+      } else if (need_what_from_server_ == NEED_FRAMES) {
+        WriteFrames();
       }
       WritePrompt();
     }
@@ -339,6 +409,11 @@ void ConsoleUI::Break(const std::string& file, size_t line) {
   WaitForContinue();
 }
 
+void ConsoleUI::Message(const std::string& text) {
+  std::unique_lock<std::mutex> lock(console_output_mutex_);
+  WriteText(text.c_str());
+}
+
 void ConsoleUI::WriteCodeLines()
 {
   auto code_lines = server_->GetCodeLines(0, 0);
@@ -32,6 +32,8 @@ public:
 
   virtual void Break(const std::string& file, size_t line);
 
+  virtual void Message(const std::string& text);
+
 private:
   void ConsoleThreadFunc();
   bool EvaluateCommand(const std::string& str_command);
@@ -51,8 +53,8 @@ private:
   bool server_can_continue_;
 
   std::atomic<bool> need_server_response_;
-  enum { NEED_NOTHING, NEED_EVAL, NEED_GLOBAL_VARS, NEED_LOCAL_VARS }
-      need_what_from_server_;
+  enum { NEED_NOTHING, NEED_EVAL, NEED_GLOBAL_VARS, NEED_LOCAL_VARS,
+         NEED_FRAMES } need_what_from_server_;
   std::string expression_to_evaluate_;
 };
 
@@ -0,0 +1,1127 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./DAP.h"
+#include "./Json.h"
+
+#include <DebugServer/IDebugServer.h>
+#include <DebugServer/Log.h>
+#include <DebugServer/UI/Transport.h>
+#include <Common/BreakPoint.h>
+#include <Common/StackFrame.h>
+#include <Common/StepFilters.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <regex>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// The Ruby debugger only supports the main thread.
+const int kThreadId = 1;
+
+std::string FileBaseName(const std::string& path) {
+  size_t pos = path.find_last_of("/\\");
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+// Returns the value of the Content-Length field of a message header, or 0 if
+// it has none. Field names are case-insensitive.
+size_t ParseContentLength(const char* header, size_t size) {
+  static const char kField[] = "content-length:";
+  const size_t field_size = sizeof(kField) - 1;
+  const char* end = header + size;
+  for (const char* line = header; line < end; ) {
+    const char* line_end = std::find(line, end, '\n');
+    const char* p = line;
+    size_t i = 0;
+    while (i < field_size && p < line_end &&
+           std::tolower(static_cast<unsigned char>(*p)) == kField[i]) {
+      ++p;
+      ++i;
+    }
+    if (i == field_size) {
+      while (p < line_end && (*p == ' ' || *p == '\t'))
+        ++p;
+      size_t length = 0;
+      for (; p < line_end && *p >= '0' && *p <= '9'; ++p) {
+        if (length > (std::numeric_limits<size_t>::max() - 9) / 10)
+          return 0;
+        length = length * 10 + (*p - '0');
+      }
+      return length;
+    }
+    line = line_end < end ? line_end + 1 : end;
+  }
+  return 0;
+}
+
+} // end anonymous namespace
+
+// One client connection. Lives on the i/o service thread; anything needing
+// the Ruby VM is handed to the Ruby thread through DAP::RunOnServerThread and
+// the reply is posted back here.
+class DAP::Session : public std::enable_shared_from_this<DAP::Session> {
+public:
+  Session(DAP& owner, std::unique_ptr<Transport> transport);
+
+  void wait();
+  void stopped(const char* reason, size_t breakpoint_index);
+  void suspended();
+  void output(const std::string& text);
+
+private:
+  // Requests are kept alive by the handlers that answer them
+  // asynchronously.
+  typedef std::shared_ptr<JsonValue> Request;
+
+  // What a variablesReference handed out to the client refers to.
+  struct VariableScope {
+    enum Kind { LOCALS, GLOBALS, OBJECT };
+    Kind kind;
+    size_t frame;
+    size_t object_id;
+  };
+
+  void start(const boost::system::error_code& err);
+  void readHeader();
+  void handleHeader(const boost::system::error_code& err, size_t bytes);
+  void handleBody(const boost::system::error_code& err);
+  void disconnect();
+  void dispatch(const Request& request);
+
+  void beginResponse(const JsonValue& request, bool success);
+  void beginEvent(const char* event);
+  void send(bool droppable = false);
+  void sendEmptyResponse(const JsonValue& request);
+  void sendError(const JsonValue& request, const char* message);
+  void writeVariable(const Variable& var);
+  size_t addScope(VariableScope::Kind kind, size_t frame, size_t object_id);
+
+  void onInitialize(const Request& request);
+  void onLaunch(const Request& request);
+  void onSetBreakpoints(const Request& request);
+  void onSetSlowCallBreakpoints(const Request& request);
+  void onDataBreakpointInfo(const Request& request);
+  void onSetDataBreakpoints(const Request& request);
+  void onSetStepFilters(const Request& request);
+  void onConfigurationDone(const Request& request);
+  void onThreads(const Request& request);
+  void onStackTrace(const Request& request);
+  void onStackTraceChanges(const Request& request);
+  void onScopes(const Request& request);
+  void onVariables(const Request& request);
+  void onEvaluate(const Request& request);
+  void onContinue(const Request& request);
+  void onRunTo(const Request& request);
+  void onNext(const Request& request);
+  void onPause(const Request& request);
+  void onProfile(const Request& request);
+  void onAllocations(const Request& request);
+  void onStats(const Request& request);
+  void onRecord(const Request& request);
+  void onStepIn(const Request& request);
+  void onStepOut(const Request& request);
+  void onStepRepeatedly(const Request& request);
+  void onStepBack(const Request& request);
+  void onReverseContinue(const Request& request);
+  void moveInHistory(const Request& request, HistoryMove move);
+  void onDisconnect(const Request& request);
+
+  void sendVariables(const Request& request,
+                     const IDebugServer::VariablesVector& vars);
+  void sendEvaluation(const Request& request, const Variable& var);
+  void sendStackTrace(const Request& request, size_t start_frame,
+                      const std::vector<StackFrame>& frames, size_t depth);
+  void sendStackTraceChanges(const Request& request, size_t stop_id,
+                             const std::vector<StackFrame>& frames,
+                             size_t unchanged);
+  void writeStackFrame(size_t id, const StackFrame& frame);
+  void sendDataBreakpoints(const Request& request,
+                           const std::vector<WatchPoint>& wps,
+                           const std::vector<bool>& added);
+
+private:
+  DAP& owner_;
+  IDebugServer* server_;
+  std::unique_ptr<Transport> transport_;
+  boost::asio::streambuf read_buffer_;
+  size_t content_length_;
+  OutputQueue output_;
+  bool reading_paused_;
+  // Set between a pause request and the resulting stop.
+  bool pause_requested_;
+  bool connected_;
+  JsonWriter json_;
+  long long seq_;
+  std::vector<VariableScope> scopes_;
+  // Breakpoint indices set by the client, per source path.
+  std::map<std::string, std::vector<size_t>> source_breakpoints_;
+  // Slow-call breakpoint indices set by the client.
+  std::vector<size_t> slow_call_breakpoints_;
+  // Watchpoint indices set by the client as data breakpoints.
+  std::vector<size_t> data_breakpoints_;
+};
+
+DAP::DAP()
+  : server_can_continue_(false)
+{}
+
+DAP::~DAP() {
+  io_service_.stop();
+  service_thread_.join();
+}
+
+void DAP::Initialize(IDebugServer* server, const std::string& str_debugger) {
+  server_ = server;
+
+  output_options_ = OutputQueue::ParseOptions(str_debugger);
+
+  // The session exists before the server can call Message or Break, which
+  // post handlers bound to it.
+  std::unique_ptr<Transport> transport =
+      Transport::Create(io_service_, str_debugger);
+  Log(("Debugger listening on " + transport->GetDescription() + "\n").c_str());
+  session_ = std::make_shared<Session>(*this, std::move(transport));
+
+  // Start the i/o service thread.
+  service_thread_ = std::thread(std::bind(&DAP::RunService, this));
+}
+
+void DAP::WaitForContinue() {
+  std::unique_lock<std::mutex> lock(server_wait_mutex_);
+  server_can_continue_ = false;
+  while (true) {
+    // Serve everything the client asked for before letting Ruby run.
+    while (!server_jobs_.empty()) {
+      std::function<void(void)> job = std::move(server_jobs_.front());
+      server_jobs_.pop_front();
+      lock.unlock();
+      job();
+      lock.lock();
+    }
+    // Nobody will tell us to continue once the client is gone.
+    if (server_can_continue_ || !server_->IsAttached())
+      break;
+    server_wait_cond_.wait(lock);
+  }
+  Log("Let SketchUp start\n");
+}
+
+void DAP::Break(BreakPoint bp) {
+  io_service_.post(std::bind(&DAP::Session::stopped, session_.get(),
+                             "breakpoint", bp.index));
+  WaitForContinue();
+}
+
+void DAP::Break(const std::string& file, size_t line) {
+  io_service_.post(std::bind(&DAP::Session::suspended, session_.get()));
+  WaitForContinue();
+}
+
+void DAP::Message(const std::string& text) {
+  io_service_.post(std::bind(&DAP::Session::output, session_.get(), text));
+}
+
+void DAP::RunService() {
+  session_->wait();
+  io_service_.run();
+}
+
+void DAP::RunOnServerThread(std::function<void(void)> job) {
+  std::lock_guard<std::mutex> lock(server_wait_mutex_);
+  server_jobs_.push_back(std::move(job));
+  server_wait_cond_.notify_all();
+}
+
+void DAP::ResumeServer() {
+  std::lock_guard<std::mutex> lock(server_wait_mutex_);
+  server_can_continue_ = true;
+  server_wait_cond_.notify_all();
+}
+
+DAP::Session::Session(DAP& owner, std::unique_ptr<Transport> transport)
+  : owner_(owner)
+  , server_(owner.server_)
+  , transport_(std::move(transport))
+  , content_length_(0)
+  , output_(*transport_, owner.output_options_)
+  , reading_paused_(false)
+  , pause_requested_(false)
+  , connected_(false)
+  , seq_(0)
+{}
+
+void DAP::Session::wait() {
+  transport_->AsyncAccept(std::bind(&Session::start, this,
+                                    std::placeholders::_1));
+}
+
+void DAP::Session::start(const boost::system::error_code& err) {
+  if (err) {
+    std::ostringstream os;
+    os << "Accepting the client connection failed: " << err << "\n";
+    Log(os.str().c_str());
+    return;
+  }
+  Log("Client connected\n");
+  server_->Attach();
+  connected_ = true;
+  output_.Open();
+  output_.SetDrainedHandler([this]() {
+    if (reading_paused_) {
+      reading_paused_ = false;
+      readHeader();
+    }
+  });
+  readHeader();
+}
+
+void DAP::Session::disconnect() {
+  Log("Client disconnected\n");
+  // Stop tracing and let SketchUp go if it is waiting for us, then wait for
+  // the next client.
+  server_->Detach();
+  connected_ = false;
+  owner_.ResumeServer();
+  transport_->Close();
+  read_buffer_.consume(read_buffer_.size());
+  reading_paused_ = false;
+  scopes_.clear();
+  source_breakpoints_.clear();
+  slow_call_breakpoints_.clear();
+  data_breakpoints_.clear();
+  wait();
+}
+
+void DAP::Session::readHeader() {
+  if (output_.IsReadingPaused()) {
+    Log("Client is not reading replies, pausing request processing\n");
+    reading_paused_ = true;
+    return;
+  }
+  transport_->AsyncReadUntil(read_buffer_, "\r\n\r\n",
+      std::bind(&Session::handleHeader, this, std::placeholders::_1,
+                std::placeholders::_2));
+}
+
+void DAP::Session::handleHeader(const boost::system::error_code& err,
+                                size_t bytes) {
+  if (err) {
+    std::ostringstream os;
+    os << err;
+    Log(os.str().c_str());
+    disconnect();
+    return;
+  }
+  const char* header =
+      boost::asio::buffer_cast<const char*>(read_buffer_.data());
+  content_length_ = ParseContentLength(header, bytes);
+  read_buffer_.consume(bytes);
+
+  if (read_buffer_.size() >= content_length_) {
+    handleBody(boost::system::error_code());
+  } else {
+    transport_->AsyncRead(read_buffer_,
+        content_length_ - read_buffer_.size(),
+        std::bind(&Session::handleBody, this, std::placeholders::_1));
+  }
+}
+
+void DAP::Session::handleBody(const boost::system::error_code& err) {
+  if (err) {
+    std::ostringstream os;
+    os << err;
+    Log(os.str().c_str());
+    disconnect();
+    return;
+  }
+  const char* body = boost::asio::buffer_cast<const char*>(read_buffer_.data());
+  Request request = std::make_shared<JsonValue>();
+  bool parsed = JsonReader::Parse(body, body + content_length_, *request);
+  read_buffer_.consume(content_length_);
+  if (parsed) {
+    dispatch(request);
+  } else {
+    Log("Malformed DAP message\n");
+  }
+  readHeader();
+}
+
+void DAP::Session::dispatch(const Request& request) {
+  struct Command {
+    const char* name;
+    void (DAP::Session::*handler)(const Request& request);
+  };
+  static const Command commands[] = {
+    { "initialize", &Session::onInitialize },
+    { "launch", &Session::onLaunch },
+    { "attach", &Session::onLaunch },
+    { "setBreakpoints", &Session::onSetBreakpoints },
+    { "setSlowCallBreakpoints", &Session::onSetSlowCallBreakpoints },
+    { "dataBreakpointInfo", &Session::onDataBreakpointInfo },
+    { "setDataBreakpoints", &Session::onSetDataBreakpoints },
+    { "setStepFilters", &Session::onSetStepFilters },
+    { "configurationDone", &Session::onConfigurationDone },
+    { "threads", &Session::onThreads },
+    { "stackTrace", &Session::onStackTrace },
+    { "stackTraceChanges", &Session::onStackTraceChanges },
+    { "scopes", &Session::onScopes },
+    { "variables", &Session::onVariables },
+    { "evaluate", &Session::onEvaluate },
+    { "continue", &Session::onContinue },
+    { "runTo", &Session::onRunTo },
+    { "next", &Session::onNext },
+    { "pause", &Session::onPause },
+    { "profile", &Session::onProfile },
+    { "allocations", &Session::onAllocations },
+    { "stats", &Session::onStats },
+    { "record", &Session::onRecord },
+    { "stepIn", &Session::onStepIn },
+    { "stepOut", &Session::onStepOut },
+    { "stepRepeatedly", &Session::onStepRepeatedly },
+    { "stepBack", &Session::onStepBack },
+    { "reverseContinue", &Session::onReverseContinue },
+    { "disconnect", &Session::onDisconnect },
+  };
+
+  const std::string& command = (*request)["command"].AsString();
+  Log("\nRequest from client => ");
+  Log(command.c_str());
+  Log("\n");
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i) {
+    if (command == commands[i].name) {
+      try {
+        (this->*commands[i].handler)(request);
+      } catch (const boost::bad_lexical_cast&) {
+        // A number in the arguments does not fit.
+        Log("Malformed DAP request arguments\n");
+        sendError(*request, "Malformed arguments");
+      }
+      return;
+    }
+  }
+  sendError(*request, "Unsupported request");
+}
+
+void DAP::Session::beginResponse(const JsonValue& request, bool success) {
+  json_.Clear();
+  json_.BeginObject()
+       .Member("seq", ++seq_)
+       .Member("type", "response")
+       .Member("request_seq", request["seq"].AsInteger())
+       .Member("command", request["command"].AsString())
+       .Member("success", success);
+}
+
+void DAP::Session::beginEvent(const char* event) {
+  json_.Clear();
+  json_.BeginObject()
+       .Member("seq", ++seq_)
+       .Member("type", "event")
+       .Member("event", event);
+}
+
+void DAP::Session::send(bool droppable) {
+  json_.EndObject();
+  const std::string& body = json_.str();
+  std::string message = "Content-Length: ";
+  message += boost::lexical_cast<std::string>(body.size());
+  message += "\r\n\r\n";
+  message += body;
+  output_.Send(std::move(message), droppable);
+}
+
+void DAP::Session::sendEmptyResponse(const JsonValue& request) {
+  beginResponse(request, true);
+  send();
+}
+
+void DAP::Session::sendError(const JsonValue& request, const char* message) {
+  beginResponse(request, false);
+  json_.Member("message", message);
+  send();
+}
+
+size_t DAP::Session::addScope(VariableScope::Kind kind, size_t frame,
+                              size_t object_id) {
+  VariableScope scope = { kind, frame, object_id };
+  scopes_.push_back(scope);
+  return scopes_.size(); // references start at 1, 0 means none
+}
+
+void DAP::Session::writeVariable(const Variable& var) {
+  json_.BeginObject()
+       .Member("name", var.name)
+       .Member("value", var.value)
+       .Member("type", var.type)
+       .Member("variablesReference", var.has_children ?
+           addScope(VariableScope::OBJECT, 0, var.object_id) : 0)
+       .EndObject();
+}
+
+void DAP::Session::stopped(const char* reason, size_t breakpoint_index) {
+  // Variable references are only valid while stopped at one place. A pause
+  // is answered by whichever stop comes first.
+  scopes_.clear();
+  pause_requested_ = false;
+  beginEvent("stopped");
+  json_.Key("body").BeginObject()
+       .Member("reason", reason)
+       .Member("threadId", kThreadId)
+       .Member("allThreadsStopped", true);
+  if (breakpoint_index != 0) {
+    json_.Key("hitBreakpointIds").BeginArray()
+         .Int(static_cast<long long>(breakpoint_index)).EndArray();
+  }
+  json_.EndObject();
+  send();
+}
+
+void DAP::Session::suspended() {
+  stopped(pause_requested_ ? "pause" : "step", 0);
+}
+
+void DAP::Session::output(const std::string& text) {
+  if (!connected_)
+    return;
+  beginEvent("output");
+  json_.Key("body").BeginObject()
+       .Member("category", "console")
+       .Member("output", text + "\n")
+       .EndObject();
+  send(true);
+}
+
+void DAP::Session::onInitialize(const Request& request) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject()
+       .Member("supportsConfigurationDoneRequest", true)
+       .Member("supportsEvaluateForHovers", true)
+       .Member("supportsDelayedStackTraceLoading", true)
+       .Member("supportsStepBack", server_->HasHistory())
+       .Member("supportsDataBreakpoints", true)
+       .EndObject();
+  send();
+  beginEvent("initialized");
+  send();
+  if (!transport_->GetNotice().empty())
+    output(transport_->GetNotice());
+}
+
+void DAP::Session::onLaunch(const Request& request) {
+  // SketchUp is already running, launch and attach just connect to it.
+  sendEmptyResponse(*request);
+}
+
+void DAP::Session::onSetBreakpoints(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  std::string path = args["source"]["path"].AsString();
+  boost::replace_all(path, "\\", "/");
+
+  // The request replaces all breakpoints of the source.
+  auto& indices = source_breakpoints_[path];
+  for (size_t i = 0; i < indices.size(); ++i) {
+    server_->RemoveBreakPoint(indices[i]);
+  }
+  indices.clear();
+
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("breakpoints").BeginArray();
+  const JsonValue& bps = args["breakpoints"];
+  for (size_t i = 0; i < bps.size(); ++i) {
+    BreakPoint bp;
+    bp.file = path;
+    bp.line = static_cast<size_t>(bps.Item(i)["line"].AsInteger());
+    bp.enabled = true;
+    bool added = bp.line > 0 && server_->AddBreakPoint(bp, true);
+    if (added)
+      indices.push_back(bp.index);
+    json_.BeginObject()
+         .Member("id", bp.index)
+         .Member("verified", added)
+         .Member("line", bp.line)
+         .EndObject();
+  }
+  json_.EndArray().EndObject();
+  send();
+}
+
+// Custom request: arguments are { "paths": [glob, ...],
+// "classes": [name, ...] }. Replaces the step filters, which persist across
+// sessions, and responds with them.
+void DAP::Session::onSetStepFilters(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  StepFilters filters;
+  const JsonValue& paths = args["paths"];
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!paths.Item(i).AsString().empty())
+      filters.paths.push_back(paths.Item(i).AsString());
+  }
+  const JsonValue& classes = args["classes"];
+  for (size_t i = 0; i < classes.size(); ++i) {
+    if (!classes.Item(i).AsString().empty())
+      filters.classes.push_back(classes.Item(i).AsString());
+  }
+  server_->SetStepFilters(filters);
+  filters = server_->GetStepFilters();
+
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("paths").BeginArray();
+  for (size_t i = 0; i < filters.paths.size(); ++i) {
+    json_.String(filters.paths[i]);
+  }
+  json_.EndArray().Key("classes").BeginArray();
+  for (size_t i = 0; i < filters.classes.size(); ++i) {
+    json_.String(filters.classes[i]);
+  }
+  json_.EndArray().EndObject();
+  send();
+}
+
+// Custom request. Each breakpoint has a threshold in milliseconds and either
+// a method ("Class#name" or "Class.name") or a path prefix. With logOnly the
+// slow call is reported as output without stopping.
+void DAP::Session::onSetSlowCallBreakpoints(const Request& request) {
+  // The request replaces all slow-call breakpoints.
+  for (size_t i = 0; i < slow_call_breakpoints_.size(); ++i) {
+    server_->RemoveBreakPoint(slow_call_breakpoints_[i]);
+  }
+  slow_call_breakpoints_.clear();
+
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("breakpoints").BeginArray();
+  const JsonValue& bps = (*request)["arguments"]["breakpoints"];
+  for (size_t i = 0; i < bps.size(); ++i) {
+    const JsonValue& item = bps.Item(i);
+    SlowCallBreakPoint bp;
+    long long threshold = item["threshold"].AsInteger(-1);
+    bp.threshold_ms = static_cast<unsigned>(threshold);
+    bp.method = item["method"].AsString();
+    bp.path_prefix = item["path"].AsString();
+    boost::replace_all(bp.path_prefix, "\\", "/");
+    bp.suspend = !item["logOnly"].AsBool();
+    bool added = threshold >= 0 && server_->AddSlowCallBreakPoint(bp);
+    if (added)
+      slow_call_breakpoints_.push_back(bp.index);
+    json_.BeginObject()
+         .Member("id", bp.index)
+         .Member("verified", added)
+         .EndObject();
+  }
+  json_.EndArray().EndObject();
+  send();
+}
+
+// Data breakpoints are watchpoints. Their ids are "local:<frame>:<name>"
+// for locals and "ivar:<object_id>:<name>" for instance variables, so they
+// stay meaningful after the variable references are gone.
+void DAP::Session::onDataBreakpointInfo(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  size_t reference =
+      static_cast<size_t>(args["variablesReference"].AsInteger());
+  const std::string& name = args["name"].AsString();
+  std::ostringstream data_id;
+  if (reference > 0 && reference <= scopes_.size() && !name.empty()) {
+    const VariableScope& scope = scopes_[reference - 1];
+    if (scope.kind == VariableScope::LOCALS)
+      data_id << "local:" << scope.frame << ":" << name;
+    else if (scope.kind == VariableScope::OBJECT && name[0] == '@')
+      data_id << "ivar:" << scope.object_id << ":" << name;
+  }
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject();
+  if (data_id.str().empty()) {
+    json_.Key("dataId").Null()
+         .Member("description",
+                 "Only locals and instance variables can be watched");
+  } else {
+    json_.Member("dataId", data_id.str())
+         .Member("description", name)
+         .Key("accessTypes").BeginArray().String("write").EndArray();
+  }
+  json_.EndObject();
+  send();
+}
+
+void DAP::Session::onSetDataBreakpoints(const Request& request) {
+  // The request replaces all data breakpoints.
+  for (size_t i = 0; i < data_breakpoints_.size(); ++i) {
+    server_->RemoveBreakPoint(data_breakpoints_[i]);
+  }
+  data_breakpoints_.clear();
+
+  std::vector<WatchPoint> wps;
+  const JsonValue& bps = (*request)["arguments"]["breakpoints"];
+  static const std::regex reg_data_id("(local|ivar):(\\d+):(.+)");
+  for (size_t i = 0; i < bps.size(); ++i) {
+    const std::string& data_id = bps.Item(i)["dataId"].AsString();
+    WatchPoint wp;
+    std::smatch match;
+    if (regex_match(data_id, match, reg_data_id)) {
+      wp.variable = match[3];
+      size_t number = boost::lexical_cast<size_t>(match[2]);
+      if (match[1] == "local")
+        wp.frame = number;
+      else
+        wp.object_id = number;
+    }
+    wps.push_back(wp);
+  }
+
+  // Current values can only be read while stopped, on the Ruby thread.
+  if (!server_->IsStopped()) {
+    sendDataBreakpoints(request, wps, std::vector<bool>(wps.size(), false));
+    return;
+  }
+  auto self = shared_from_this();
+  IDebugServer* server = server_;
+  boost::asio::io_service& service = owner_.io_service_;
+  owner_.RunOnServerThread([=, &service]() mutable {
+    std::vector<bool> added;
+    for (size_t i = 0; i < wps.size(); ++i) {
+      added.push_back(!wps[i].variable.empty() &&
+                      server->AddWatchPoint(wps[i]));
+    }
+    service.post(std::bind(&Session::sendDataBreakpoints, self, request, wps,
+                           added));
+  });
+}
+
+void DAP::Session::sendDataBreakpoints(const Request& request,
+                                       const std::vector<WatchPoint>& wps,
+                                       const std::vector<bool>& added) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("breakpoints").BeginArray();
+  for (size_t i = 0; i < wps.size(); ++i) {
+    if (added[i])
+      data_breakpoints_.push_back(wps[i].index);
+    json_.BeginObject()
+         .Member("id", wps[i].index)
+         .Member("verified", static_cast<bool>(added[i]))
+         .EndObject();
+  }
+  json_.EndArray().EndObject();
+  send();
+}
+
+void DAP::Session::onConfigurationDone(const Request& request) {
+  sendEmptyResponse(*request);
+  // Equivalent of RDIP's start command, SketchUp waits for this.
+  owner_.ResumeServer();
+}
+
+void DAP::Session::onThreads(const Request& request) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("threads").BeginArray()
+       .BeginObject().Member("id", kThreadId).Member("name", "main")
+       .EndObject()
+       .EndArray().EndObject();
+  send();
+}
+
+void DAP::Session::onStackTrace(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  size_t start_frame = static_cast<size_t>(args["startFrame"].AsInteger(0));
+  size_t levels = static_cast<size_t>(args["levels"].AsInteger(0));
+  if (!server_->IsStopped()) {
+    sendStackTrace(request, start_frame, std::vector<StackFrame>(), 0);
+    return;
+  }
+  // Frames below the top one are read in the server thread, only as many as
+  // the client pages in.
+  auto self = shared_from_this();
+  IDebugServer* server = server_;
+  boost::asio::io_service& service = owner_.io_service_;
+  owner_.RunOnServerThread([=, &service]() {
+    std::vector<StackFrame> frames = server->GetStackFrames(start_frame,
+                                                            levels);
+    size_t depth = server->GetStackDepth();
+    service.post(std::bind(&Session::sendStackTrace, self, request,
+                           start_frame, frames, depth));
+  });
+}
+
+void DAP::Session::sendStackTrace(const Request& request, size_t start_frame,
+                                  const std::vector<StackFrame>& frames,
+                                  size_t depth) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("stackFrames").BeginArray();
+  for (size_t i = 0; i < frames.size(); ++i)
+    writeStackFrame(start_frame + i, frames[i]);
+  json_.EndArray().Member("totalFrames", depth).EndObject();
+  send();
+}
+
+// Custom request: arguments are { "knownStop": stop }, the stop of the last
+// stackTraceChanges response, or 0. The body has the top frames of the
+// current stop down to those the client already has, "unchanged", the
+// number of frames below them the client keeps from its known stop, and
+// "stop", the id to pass next time.
+void DAP::Session::onStackTraceChanges(const Request& request) {
+  long long known_stop = (*request)["arguments"]["knownStop"].AsInteger(0);
+  if (!server_->IsStopped() || known_stop < 0) {
+    sendStackTraceChanges(request, 0, std::vector<StackFrame>(), 0);
+    return;
+  }
+  auto self = shared_from_this();
+  IDebugServer* server = server_;
+  boost::asio::io_service& service = owner_.io_service_;
+  owner_.RunOnServerThread([=, &service]() {
+    size_t unchanged = 0;
+    std::vector<StackFrame> frames = server->GetStackFrameChanges(
+        static_cast<size_t>(known_stop), unchanged);
+    service.post(std::bind(&Session::sendStackTraceChanges, self, request,
+                           server->GetStopId(), frames, unchanged));
+  });
+}
+
+void DAP::Session::sendStackTraceChanges(const Request& request,
+                                         size_t stop_id,
+                                         const std::vector<StackFrame>& frames,
+                                         size_t unchanged) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("stackFrames").BeginArray();
+  for (size_t i = 0; i < frames.size(); ++i)
+    writeStackFrame(i, frames[i]);
+  json_.EndArray()
+       .Member("unchanged", unchanged)
+       .Member("totalFrames", frames.size() + unchanged)
+       .Member("stop", stop_id)
+       .EndObject();
+  send();
+}
+
+void DAP::Session::writeStackFrame(size_t id, const StackFrame& frame) {
+  json_.BeginObject()
+       .Member("id", id)
+       .Member("name", frame.name)
+       .Key("source").BeginObject()
+         .Member("name", FileBaseName(frame.file))
+         .Member("path", frame.file)
+       .EndObject()
+       .Member("line", frame.line)
+       .Member("column", 1)
+       .EndObject();
+}
+
+void DAP::Session::onScopes(const Request& request) {
+  size_t frame =
+      static_cast<size_t>((*request)["arguments"]["frameId"].AsInteger());
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("scopes").BeginArray()
+       .BeginObject()
+         .Member("name", "Locals")
+         .Member("variablesReference",
+                 addScope(VariableScope::LOCALS, frame, 0))
+         .Member("expensive", false)
+       .EndObject()
+       .BeginObject()
+         .Member("name", "Globals")
+         .Member("variablesReference",
+                 addScope(VariableScope::GLOBALS, 0, 0))
+         .Member("expensive", true)
+       .EndObject()
+       .EndArray().EndObject();
+  send();
+}
+
+void DAP::Session::onVariables(const Request& request) {
+  size_t reference = static_cast<size_t>(
+      (*request)["arguments"]["variablesReference"].AsInteger());
+  if (reference == 0 || reference > scopes_.size() ||
+      !server_->IsStopped()) {
+    sendError(*request, "Variables are not available");
+    return;
+  }
+  VariableScope scope = scopes_[reference - 1];
+  // Only the requested page is evaluated.
+  const JsonValue& args = (*request)["arguments"];
+  size_t start = static_cast<size_t>(args["start"].AsInteger(0));
+  size_t count = static_cast<size_t>(args["count"].AsInteger(0));
+  auto self = shared_from_this();
+  IDebugServer* server = server_;
+  boost::asio::io_service& service = owner_.io_service_;
+  owner_.RunOnServerThread([=, &service]() {
+    IDebugServer::VariablesVector vars;
+    if (scope.kind == VariableScope::LOCALS) {
+      server->SetActiveFrameIndex(scope.frame);
+      vars = server->GetLocalVariables(start, count);
+    } else if (scope.kind == VariableScope::GLOBALS) {
+      vars = server->GetGlobalVariables(start, count);
+    } else {
+      vars = server->GetInstanceVariables(scope.object_id, start, count);
+    }
+    service.post(std::bind(&Session::sendVariables, self, request, vars));
+  });
+}
+
+void DAP::Session::sendVariables(const Request& request,
+                                 const IDebugServer::VariablesVector& vars) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Key("variables").BeginArray();
+  for (auto it = vars.cbegin(), ite = vars.cend(); it != ite; ++it) {
+    writeVariable(*it);
+  }
+  json_.EndArray().EndObject();
+  send();
+}
+
+void DAP::Session::onEvaluate(const Request& request) {
+  if (!server_->IsStopped()) {
+    sendError(*request, "Expressions can only be evaluated while stopped");
+    return;
+  }
+  const JsonValue& args = (*request)["arguments"];
+  std::string expr = args["expression"].AsString();
+  bool has_frame = !args["frameId"].IsNull();
+  size_t frame = static_cast<size_t>(args["frameId"].AsInteger());
+  auto self = shared_from_this();
+  IDebugServer* server = server_;
+  boost::asio::io_service& service = owner_.io_service_;
+  owner_.RunOnServerThread([=, &service]() {
+    if (has_frame)
+      server->SetActiveFrameIndex(frame);
+    Variable var = server->EvaluateExpression(expr);
+    service.post(std::bind(&Session::sendEvaluation, self, request, var));
+  });
+}
+
+void DAP::Session::sendEvaluation(const Request& request, const Variable& var) {
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject()
+       .Member("result", var.value)
+       .Member("type", var.type)
+       .Member("variablesReference", var.has_children ?
+           addScope(VariableScope::OBJECT, 0, var.object_id) : 0)
+       .EndObject();
+  send();
+}
+
+void DAP::Session::onContinue(const Request& request) {
+  if (server_->IsInHistory()) {
+    moveInHistory(request, HISTORY_CONTINUE);
+    return;
+  }
+  beginResponse(*request, true);
+  json_.Key("body").BeginObject().Member("allThreadsContinued", true)
+       .EndObject();
+  send();
+  owner_.ResumeServer();
+}
+
+// Custom request: arguments are { "source": { "path": path }, "line": line }.
+// Resumes and stops at the line through a breakpoint that is removed on its
+// first hit, or at any breakpoint reached before it.
+void DAP::Session::onRunTo(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  BreakPoint bp;
+  bp.file = args["source"]["path"].AsString();
+  boost::replace_all(bp.file, "\\", "/");
+  bp.line = static_cast<size_t>(args["line"].AsInteger());
+  bp.enabled = true;
+  if (bp.line == 0 || !server_->AddTemporaryBreakPoint(bp, true)) {
+    sendError(*request, "Invalid location");
+    return;
+  }
+  sendEmptyResponse(*request);
+  owner_.ResumeServer();
+}
+
+void DAP::Session::onNext(const Request& request) {
+  if (server_->IsInHistory()) {
+    moveInHistory(request, HISTORY_STEP_OVER);
+    return;
+  }
+  server_->StepOver();
+  sendEmptyResponse(*request);
+  owner_.ResumeServer();
+}
+
+void DAP::Session::onPause(const Request& request) {
+  if (server_->Pause())
+    pause_requested_ = true;
+  sendEmptyResponse(*request);
+}
+
+// Custom request: arguments are { "action": "start" } or
+// { "action": "stop", "path": report_path }.
+void DAP::Session::onProfile(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  const std::string& action = args["action"].AsString();
+  if (action == "start") {
+    server_->StartProfiling();
+  } else if (action == "stop" && !args["path"].AsString().empty()) {
+    // An output event is sent once the report is written.
+    server_->StopProfiling(args["path"].AsString());
+  } else {
+    sendError(*request, "Invalid profile arguments");
+    return;
+  }
+  sendEmptyResponse(*request);
+}
+
+// Custom request: arguments are { "action": "start" | "stop" | "mark" |
+// "report", "count": max_sites, "path": report_path }. Reports are returned
+// in the "report" field of the body, and also written to path if given.
+void DAP::Session::onAllocations(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  const std::string& action = args["action"].AsString();
+  if (action == "start") {
+    server_->StartAllocationTracking();
+  } else if (action == "stop") {
+    server_->StopAllocationTracking();
+  } else if (action == "mark") {
+    server_->MarkAllocations();
+  } else if (action == "report") {
+    size_t count = args["count"].IsNull() ?
+        20 : static_cast<size_t>(args["count"].AsInteger());
+    const std::string& path = args["path"].AsString();
+    if (!path.empty() && !server_->WriteAllocationReport(path, count)) {
+      sendError(*request, "Could not write allocation report");
+      return;
+    }
+    beginResponse(*request, true);
+    json_.Key("body").BeginObject()
+        .Key("report").String(server_->GetAllocationReport(count))
+        .EndObject();
+    send();
+    return;
+  } else {
+    sendError(*request, "Invalid allocations arguments");
+    return;
+  }
+  sendEmptyResponse(*request);
+}
+
+// Custom request: arguments are { "action": "gcStart" | "gcStop" |
+// "gcReset" | "report" }. Reports are returned in the "report" field.
+void DAP::Session::onStats(const Request& request) {
+  const std::string& action = (*request)["arguments"]["action"].AsString();
+  if (action == "gcStart") {
+    server_->StartGcMonitoring();
+  } else if (action == "gcStop") {
+    server_->StopGcMonitoring();
+  } else if (action == "gcReset") {
+    server_->ResetGcStats();
+  } else if (action == "report" || action.empty()) {
+    beginResponse(*request, true);
+    json_.Key("body").BeginObject()
+        .Key("report").String(server_->GetGcStats() + output_.GetReport())
+        .EndObject();
+    send();
+    return;
+  } else {
+    sendError(*request, "Invalid stats arguments");
+    return;
+  }
+  sendEmptyResponse(*request);
+}
+
+// Custom request. Starts recording to arguments.path, with an optional ring
+// size in arguments.sizeMb, or stops or flushes the recording.
+void DAP::Session::onRecord(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  const std::string& action = args["action"].AsString();
+  if (action == "start") {
+    const std::string& path = args["path"].AsString();
+    long long size_mb = args["sizeMb"].AsInteger(64);
+    if (path.empty() || size_mb <= 0) {
+      sendError(*request, "Invalid record arguments");
+      return;
+    }
+    server_->StartRecording(path, static_cast<size_t>(size_mb));
+  } else if (action == "stop") {
+    server_->StopRecording();
+  } else if (action == "flush") {
+    server_->FlushRecording();
+  } else {
+    sendError(*request, "Invalid record arguments");
+    return;
+  }
+  sendEmptyResponse(*request);
+}
+
+void DAP::Session::onStepIn(const Request& request) {
+  if (server_->IsInHistory()) {
+    moveInHistory(request, HISTORY_STEP);
+    return;
+  }
+  server_->Step();
+  sendEmptyResponse(*request);
+  owner_.ResumeServer();
+}
+
+void DAP::Session::onStepOut(const Request& request) {
+  if (server_->IsInHistory()) {
+    moveInHistory(request, HISTORY_STEP_OUT);
+    return;
+  }
+  server_->StepOut();
+  sendEmptyResponse(*request);
+  owner_.ResumeServer();
+}
+
+// Custom request: arguments are { "stepOver": bool, "count": steps,
+// "until": expression, "trace": bool }. The steps are taken without stopping
+// in between, only the last line gets a stopped event. With trace, the lines
+// passed are sent as an output event first.
+void DAP::Session::onStepRepeatedly(const Request& request) {
+  const JsonValue& args = (*request)["arguments"];
+  long long count = args["count"].AsInteger(0);
+  const std::string& until = args["until"].AsString();
+  if (count < 0 || (count == 0 && until.empty())) {
+    sendError(*request, "Invalid step arguments");
+    return;
+  }
+  if (server_->IsInHistory()) {
+    sendError(*request, "Steps cannot be repeated in the execution history");
+    return;
+  }
+  server_->StepRepeatedly(args["stepOver"].AsBool(),
+                          static_cast<size_t>(count), until,
+                          args["trace"].AsBool());
+  sendEmptyResponse(*request);
+  owner_.ResumeServer();
+}
+
+void DAP::Session::onStepBack(const Request& request) {
+  moveInHistory(request, HISTORY_STEP_BACK);
+}
+
+void DAP::Session::onReverseContinue(const Request& request) {
+  moveInHistory(request, HISTORY_REVERSE_CONTINUE);
+}
+
+// Answers a step or continue request from the execution history. Ruby stays
+// stopped, so the stopped event follows right away.
+void DAP::Session::moveInHistory(const Request& request, HistoryMove move) {
+  size_t breakpoint_index = 0;
+  if (!server_->MoveInHistory(move, breakpoint_index)) {
+    sendError(*request, "No further position in the execution history");
+    return;
+  }
+  sendEmptyResponse(*request);
+  stopped(breakpoint_index != 0 ? "breakpoint" : "step", breakpoint_index);
+}
+
+void DAP::Session::onDisconnect(const Request& request) {
+  sendEmptyResponse(*request);
+  // Same as RDIP's exit: let SketchUp continue and stop debugging.
+  owner_.ResumeServer();
+  server_->Stop();
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
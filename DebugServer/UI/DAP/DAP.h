@@ -0,0 +1,70 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_DAP_DAP_H_
+#define RDEBUGGER_DEBUGSERVER_UI_DAP_DAP_H_
+
+#include <DebugServer/UI/IDebuggerUI.h>
+#include <DebugServer/UI/OutputQueue.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/asio/io_service.hpp>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// https://microsoft.github.io/debug-adapter-protocol/
+// Debug Adapter Protocol implementation, served over TCP. Lets clients such as
+// VS Code page through frames and variables instead of receiving whole dumps.
+class DAP : public IDebuggerUI {
+public:
+  DAP();
+  ~DAP();
+
+  virtual void Initialize(IDebugServer* server,
+                          const std::string& str_debugger);
+
+  virtual bool IsIDE() { return true; }
+
+  virtual void WaitForContinue();
+
+  virtual void Break(BreakPoint bp);
+
+  virtual void Break(const std::string& file, size_t line);
+
+  virtual void Message(const std::string& text);
+
+private:
+  class Session;
+
+  void RunService();
+
+  // Queues a job to be run on the Ruby thread while it waits for the client.
+  void RunOnServerThread(std::function<void(void)> job);
+
+  // Lets the Ruby thread continue execution.
+  void ResumeServer();
+
+private:
+  boost::asio::io_service io_service_;
+  std::thread service_thread_;
+  std::condition_variable server_wait_cond_;
+  std::mutex server_wait_mutex_;
+  bool server_can_continue_;
+  std::deque<std::function<void(void)>> server_jobs_;
+  OutputQueue::Options output_options_;
+
+  std::shared_ptr<Session> session_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_DAP_DAP_H_
@@ -0,0 +1,369 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Json.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+const JsonValue& NullValue() {
+  static const JsonValue null_value;
+  return null_value;
+}
+
+// Nesting limit, protects the recursive parser from hostile input.
+const int kMaxDepth = 64;
+
+void AppendUtf8(std::string& str, unsigned long cp) {
+  if (cp < 0x80) {
+    str += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    str += static_cast<char>(0xc0 | (cp >> 6));
+    str += static_cast<char>(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    str += static_cast<char>(0xe0 | (cp >> 12));
+    str += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    str += static_cast<char>(0x80 | (cp & 0x3f));
+  } else {
+    str += static_cast<char>(0xf0 | (cp >> 18));
+    str += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    str += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    str += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+bool ParseHex4(const char* p, unsigned long& value) {
+  value = 0;
+  for (int i = 0; i < 4; ++i) {
+    char c = p[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9')
+      value |= c - '0';
+    else if (c >= 'a' && c <= 'f')
+      value |= c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      value |= c - 'A' + 10;
+    else
+      return false;
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+const JsonValue& JsonValue::Item(size_t index) const {
+  if (type_ != ARRAY_VALUE || index >= items_.size())
+    return NullValue();
+  return items_[index];
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const {
+  if (type_ == OBJECT_VALUE) {
+    for (auto it = members_.cbegin(), ite = members_.cend(); it != ite; ++it) {
+      if (it->first == key)
+        return it->second;
+    }
+  }
+  return NullValue();
+}
+
+bool JsonReader::Parse(const char* begin, const char* end, JsonValue& value) {
+  JsonReader reader(begin, end);
+  if (!reader.ParseValue(value, 0))
+    return false;
+  reader.SkipSpace();
+  return reader.p_ == reader.end_;
+}
+
+void JsonReader::SkipSpace() {
+  while (p_ != end_ &&
+         (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n'))
+    ++p_;
+}
+
+bool JsonReader::ParseLiteral(const char* literal) {
+  size_t n = std::strlen(literal);
+  if (static_cast<size_t>(end_ - p_) < n || std::memcmp(p_, literal, n) != 0)
+    return false;
+  p_ += n;
+  return true;
+}
+
+bool JsonReader::ParseValue(JsonValue& value, int depth) {
+  if (depth > kMaxDepth)
+    return false;
+  SkipSpace();
+  if (p_ == end_)
+    return false;
+  switch (*p_) {
+    case '{': {
+      ++p_;
+      value.type_ = JsonValue::OBJECT_VALUE;
+      SkipSpace();
+      if (p_ != end_ && *p_ == '}') {
+        ++p_;
+        return true;
+      }
+      while (true) {
+        SkipSpace();
+        value.members_.push_back(std::make_pair(std::string(), JsonValue()));
+        auto& member = value.members_.back();
+        if (!ParseString(member.first))
+          return false;
+        SkipSpace();
+        if (p_ == end_ || *p_ != ':')
+          return false;
+        ++p_;
+        if (!ParseValue(member.second, depth + 1))
+          return false;
+        SkipSpace();
+        if (p_ == end_)
+          return false;
+        if (*p_ == '}') {
+          ++p_;
+          return true;
+        }
+        if (*p_ != ',')
+          return false;
+        ++p_;
+      }
+    }
+    case '[': {
+      ++p_;
+      value.type_ = JsonValue::ARRAY_VALUE;
+      SkipSpace();
+      if (p_ != end_ && *p_ == ']') {
+        ++p_;
+        return true;
+      }
+      while (true) {
+        value.items_.push_back(JsonValue());
+        if (!ParseValue(value.items_.back(), depth + 1))
+          return false;
+        SkipSpace();
+        if (p_ == end_)
+          return false;
+        if (*p_ == ']') {
+          ++p_;
+          return true;
+        }
+        if (*p_ != ',')
+          return false;
+        ++p_;
+      }
+    }
+    case '"':
+      value.type_ = JsonValue::STRING_VALUE;
+      return ParseString(value.string_);
+    case 't':
+      value.type_ = JsonValue::BOOL_VALUE;
+      value.bool_ = true;
+      return ParseLiteral("true");
+    case 'f':
+      value.type_ = JsonValue::BOOL_VALUE;
+      value.bool_ = false;
+      return ParseLiteral("false");
+    case 'n':
+      value.type_ = JsonValue::NULL_VALUE;
+      return ParseLiteral("null");
+    default:
+      return ParseNumber(value);
+  }
+}
+
+bool JsonReader::ParseString(std::string& str) {
+  if (p_ == end_ || *p_ != '"')
+    return false;
+  ++p_;
+  while (p_ != end_) {
+    // Copy runs of plain characters in one go.
+    const char* run = p_;
+    while (p_ != end_ && *p_ != '"' && *p_ != '\\')
+      ++p_;
+    str.append(run, p_ - run);
+    if (p_ == end_)
+      return false;
+    if (*p_ == '"') {
+      ++p_;
+      return true;
+    }
+    // Escape sequence
+    if (++p_ == end_)
+      return false;
+    char c = *p_++;
+    switch (c) {
+      case '"': str += '"'; break;
+      case '\\': str += '\\'; break;
+      case '/': str += '/'; break;
+      case 'b': str += '\b'; break;
+      case 'f': str += '\f'; break;
+      case 'n': str += '\n'; break;
+      case 'r': str += '\r'; break;
+      case 't': str += '\t'; break;
+      case 'u': {
+        unsigned long cp;
+        if (end_ - p_ < 4 || !ParseHex4(p_, cp))
+          return false;
+        p_ += 4;
+        if (cp >= 0xd800 && cp < 0xdc00) {
+          // High surrogate, must be followed by a low one.
+          unsigned long low;
+          if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u' ||
+              !ParseHex4(p_ + 2, low) || low < 0xdc00 || low >= 0xe000)
+            return false;
+          p_ += 6;
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        }
+        AppendUtf8(str, cp);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+bool JsonReader::ParseNumber(JsonValue& value) {
+  const char* start = p_;
+  if (p_ != end_ && *p_ == '-')
+    ++p_;
+  while (p_ != end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' ||
+                        *p_ == 'e' || *p_ == 'E' || *p_ == '+' || *p_ == '-'))
+    ++p_;
+  if (p_ == start)
+    return false;
+  std::string text(start, p_);
+  char* parse_end = nullptr;
+  value.type_ = JsonValue::NUMBER_VALUE;
+  value.number_ = std::strtod(text.c_str(), &parse_end);
+  return parse_end == text.c_str() + text.size();
+}
+
+void JsonWriter::Clear() {
+  out_.clear();
+  first_.clear();
+  after_key_ = false;
+}
+
+void JsonWriter::BeginValue() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (!first_.empty()) {
+    if (first_.back())
+      first_.back() = false;
+    else
+      out_ += ',';
+  }
+}
+
+JsonWriter& JsonWriter::BeginObject() {
+  BeginValue();
+  out_ += '{';
+  first_.push_back(true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+  out_ += '}';
+  first_.pop_back();
+  return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray() {
+  BeginValue();
+  out_ += '[';
+  first_.push_back(true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+  out_ += ']';
+  first_.pop_back();
+  return *this;
+}
+
+JsonWriter& JsonWriter::Key(const char* key) {
+  String(key);
+  out_ += ':';
+  after_key_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::String(const char* s) {
+  return String(s, std::strlen(s));
+}
+
+JsonWriter& JsonWriter::String(const char* s, size_t length) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  BeginValue();
+  out_ += '"';
+  const char* end = s + length;
+  while (s != end) {
+    const char* run = s;
+    while (s != end && *s != '"' && *s != '\\' &&
+           static_cast<unsigned char>(*s) >= 0x20)
+      ++s;
+    out_.append(run, s - run);
+    if (s == end)
+      break;
+    char c = *s++;
+    switch (c) {
+      case '"': out_.append("\\\"", 2); break;
+      case '\\': out_.append("\\\\", 2); break;
+      case '\n': out_.append("\\n", 2); break;
+      case '\r': out_.append("\\r", 2); break;
+      case '\t': out_.append("\\t", 2); break;
+      default:
+        out_.append("\\u00", 4);
+        out_ += kHexDigits[(c >> 4) & 0xf];
+        out_ += kHexDigits[c & 0xf];
+        break;
+    }
+  }
+  out_ += '"';
+  return *this;
+}
+
+JsonWriter& JsonWriter::Int(long long value) {
+  BeginValue();
+  char digits[24];
+  char* p = digits + sizeof(digits);
+  unsigned long long magnitude = value < 0 ?
+      0ULL - static_cast<unsigned long long>(value) :
+      static_cast<unsigned long long>(value);
+  do {
+    *--p = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    *--p = '-';
+  out_.append(p, digits + sizeof(digits) - p);
+  return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+  BeginValue();
+  if (value)
+    out_.append("true", 4);
+  else
+    out_.append("false", 5);
+  return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+  BeginValue();
+  out_.append("null", 4);
+  return *this;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,143 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_DAP_JSON_H_
+#define RDEBUGGER_DEBUGSERVER_UI_DAP_JSON_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// A parsed JSON value. Lookups of missing members or out of range items
+// return a null value so that optional protocol fields can be read without
+// checking every level.
+class JsonValue {
+public:
+  enum Type {
+    NULL_VALUE,
+    BOOL_VALUE,
+    NUMBER_VALUE,
+    STRING_VALUE,
+    ARRAY_VALUE,
+    OBJECT_VALUE
+  };
+
+  JsonValue() : type_(NULL_VALUE), bool_(false), number_(0) {}
+
+  Type type() const { return type_; }
+
+  bool IsNull() const { return type_ == NULL_VALUE; }
+
+  bool AsBool(bool default_value = false) const {
+    return type_ == BOOL_VALUE ? bool_ : default_value;
+  }
+
+  long long AsInteger(long long default_value = 0) const {
+    return type_ == NUMBER_VALUE ? static_cast<long long>(number_) :
+                                   default_value;
+  }
+
+  // Returns an empty string if the value is not a string.
+  const std::string& AsString() const { return string_; }
+
+  // Number of array items or object members.
+  size_t size() const {
+    return type_ == ARRAY_VALUE ? items_.size() : members_.size();
+  }
+
+  const JsonValue& Item(size_t index) const;
+
+  const JsonValue& operator[](const char* key) const;
+
+private:
+  friend class JsonReader;
+
+  Type type_;
+  bool bool_;
+  double number_;
+  std::string string_;
+  std::vector<JsonValue> items_;
+  std::vector<std::pair<std::string, JsonValue>> members_;
+};
+
+// Parses JSON text straight out of a receive buffer.
+class JsonReader {
+public:
+  // Returns false if the text is not a single well-formed JSON value.
+  static bool Parse(const char* begin, const char* end, JsonValue& value);
+
+private:
+  JsonReader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  bool ParseValue(JsonValue& value, int depth);
+  bool ParseString(std::string& str);
+  bool ParseNumber(JsonValue& value);
+  bool ParseLiteral(const char* literal);
+  void SkipSpace();
+
+  const char* p_;
+  const char* end_;
+};
+
+// Writes JSON text into a reusable buffer. Separators are inserted
+// automatically, so calls map one to one onto the emitted structure.
+class JsonWriter {
+public:
+  JsonWriter() : after_key_(false) {}
+
+  // Empties the buffer, keeping its capacity.
+  void Clear();
+
+  const std::string& str() const { return out_; }
+
+  JsonWriter& BeginObject();
+  JsonWriter& EndObject();
+  JsonWriter& BeginArray();
+  JsonWriter& EndArray();
+  JsonWriter& Key(const char* key);
+  JsonWriter& String(const char* s, size_t length);
+  JsonWriter& String(const std::string& s) {
+    return String(s.data(), s.size());
+  }
+  JsonWriter& String(const char* s);
+  JsonWriter& Int(long long value);
+  JsonWriter& Bool(bool value);
+  JsonWriter& Null();
+
+  // Shorthands for a key followed by a value.
+  JsonWriter& Member(const char* key, const std::string& value) {
+    return Key(key).String(value);
+  }
+  JsonWriter& Member(const char* key, const char* value) {
+    return Key(key).String(value);
+  }
+  JsonWriter& Member(const char* key, long long value) {
+    return Key(key).Int(value);
+  }
+  JsonWriter& Member(const char* key, int value) {
+    return Key(key).Int(value);
+  }
+  JsonWriter& Member(const char* key, size_t value) {
+    return Key(key).Int(static_cast<long long>(value));
+  }
+  JsonWriter& Member(const char* key, bool value) {
+    return Key(key).Bool(value);
+  }
+
+private:
+  void BeginValue();
+
+  std::string out_;
+  // One entry per open object/array, true until its first element.
+  std::vector<bool> first_;
+  bool after_key_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_DAP_JSON_H_
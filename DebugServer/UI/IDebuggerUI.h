@@ -34,6 +34,10 @@ public:
   // Called by the server when a file/line breakpoint is hit during execution.
   virtual void Break(const std::string& file, size_t line) = 0;
 
+  // Called by the server to show a message without stopping, e.g. a stall
+  // report. Execution continues right away.
+  virtual void Message(const std::string& text) = 0;
+
 protected:
   IDebuggerUI() : server_(nullptr) {}
 
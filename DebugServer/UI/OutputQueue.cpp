@@ -0,0 +1,171 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./OutputQueue.h"
+
+#include <DebugServer/Log.h>
+#include <DebugServer/UI/Transport.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <regex>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Upper bound on the number of messages combined into one gather-write.
+const size_t kMaxBuffersPerWrite = 64;
+
+} // end anonymous namespace
+
+OutputQueue::Options OutputQueue::ParseOptions(
+    const std::string& str_debugger) {
+  Options options;
+  std::smatch match;
+  const std::regex reg_nodelay("nodelay=([01])");
+  if (regex_search(str_debugger, match, reg_nodelay)) {
+    options.no_delay = match[1] == "1";
+  }
+  const std::regex reg_hwm("hwm=(\\d+)");
+  if (regex_search(str_debugger, match, reg_hwm)) {
+    options.high_water_mark = boost::lexical_cast<size_t>(match[1]);
+  }
+  const std::regex reg_overflow("overflow=(pause|close)");
+  if (regex_search(str_debugger, match, reg_overflow)) {
+    options.overflow_policy = match[1] == "close" ?
+        OVERFLOW_CLOSE : OVERFLOW_PAUSE_READING;
+  }
+  return options;
+}
+
+OutputQueue::OutputQueue(Transport& transport, const Options& options)
+  : transport_(transport),
+    options_(options),
+    pending_bytes_(0),
+    write_in_progress_(false),
+    over_high_water_(false),
+    bytes_queued_(0),
+    messages_queued_(0),
+    bytes_written_(0),
+    messages_dropped_(0)
+{}
+
+void OutputQueue::Open() {
+  pending_.clear();
+  in_flight_.clear();
+  pending_bytes_ = 0;
+  write_in_progress_ = false;
+  over_high_water_ = false;
+
+  transport_.SetNoDelay(options_.no_delay);
+}
+
+void OutputQueue::Send(std::string message, bool droppable) {
+  if (message.empty())
+    return;
+  // Pausing the reading of commands stops replies, but not messages such as
+  // stall reports, which keep coming for as long as Ruby runs.
+  if (droppable &&
+      pending_bytes_ + message.size() > options_.high_water_mark) {
+    if (messages_dropped_++ == 0)
+      Log("Debugger output queue is full, dropping messages\n");
+    return;
+  }
+  pending_bytes_ += message.size();
+  bytes_queued_ += message.size();
+  ++messages_queued_;
+  pending_.push_back(std::move(message));
+
+  if (!over_high_water_ && pending_bytes_ > options_.high_water_mark) {
+    over_high_water_ = true;
+    Log("Debugger output queue is above its high-water mark\n");
+    if (options_.overflow_policy == OVERFLOW_CLOSE) {
+      transport_.Close();
+      return;
+    }
+  }
+  // Stops are not dropped, and the peer still does not read them.
+  if (pending_bytes_ > 2 * options_.high_water_mark) {
+    Log("Debugger output queue is full, closing the connection\n");
+    transport_.Close();
+    return;
+  }
+
+  if (!write_in_progress_)
+    StartWrite();
+}
+
+std::string OutputQueue::GetReport() const {
+  std::ostringstream os;
+  os << "Output: " << messages_queued_ << " messages, " << bytes_queued_
+     << " bytes queued, " << bytes_written_ << " bytes written, "
+     << pending_bytes_ << " bytes pending, " << messages_dropped_
+     << " messages dropped\n";
+  return os.str();
+}
+
+bool OutputQueue::IsReadingPaused() const {
+  return over_high_water_ &&
+         options_.overflow_policy == OVERFLOW_PAUSE_READING;
+}
+
+void OutputQueue::SetDrainedHandler(std::function<void(void)> handler) {
+  drained_handler_ = handler;
+}
+
+void OutputQueue::StartWrite() {
+  // Take everything that accumulated since the last write and send it as one
+  // gather-write.
+  while (!pending_.empty() && in_flight_.size() < kMaxBuffersPerWrite) {
+    in_flight_.push_back(std::move(pending_.front()));
+    pending_.pop_front();
+  }
+  if (in_flight_.empty())
+    return;
+
+  std::vector<boost::asio::const_buffer> buffers;
+  buffers.reserve(in_flight_.size());
+  for (const auto& msg : in_flight_) {
+    buffers.push_back(boost::asio::buffer(msg));
+  }
+  write_in_progress_ = true;
+  transport_.AsyncWrite(buffers,
+      std::bind(&OutputQueue::HandleWrite, this, std::placeholders::_1,
+                std::placeholders::_2));
+}
+
+void OutputQueue::HandleWrite(const boost::system::error_code& err,
+                              size_t bytes) {
+  write_in_progress_ = false;
+  bytes_written_ += bytes;
+  for (const auto& msg : in_flight_) {
+    pending_bytes_ -= msg.size();
+  }
+  in_flight_.clear();
+
+  if (err) {
+    // The connection is gone, the reader side reports it.
+    pending_.clear();
+    pending_bytes_ = 0;
+    std::ostringstream os;
+    os << "Debugger output write failed: " << err << "\n";
+    Log(os.str().c_str());
+    return;
+  }
+
+  if (over_high_water_ && pending_bytes_ <= options_.high_water_mark / 2) {
+    over_high_water_ = false;
+    if (drained_handler_)
+      drained_handler_();
+  }
+
+  if (!pending_.empty())
+    StartWrite();
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,98 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_OUTPUTQUEUE_H_
+#define RDEBUGGER_DEBUGSERVER_UI_OUTPUTQUEUE_H_
+
+#include <boost/system/error_code.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+class Transport;
+
+// Queue of outgoing protocol messages for a debugger connection. Messages are
+// written with chained async_write calls; everything queued while a write is
+// in flight goes out together in the next gather-write. All methods must be
+// called on the i/o service thread.
+class OutputQueue {
+public:
+  // What to do when the amount of unsent data exceeds the high-water mark.
+  enum OverflowPolicy {
+    // Stop reading commands from the peer until the queue drains.
+    OVERFLOW_PAUSE_READING,
+    // Drop the connection.
+    OVERFLOW_CLOSE
+  };
+
+  struct Options {
+    Options()
+      : no_delay(true),
+        high_water_mark(4 * 1024 * 1024),
+        overflow_policy(OVERFLOW_PAUSE_READING) {}
+
+    bool no_delay;
+    size_t high_water_mark;
+    OverflowPolicy overflow_policy;
+  };
+
+  // Reads the queue settings from a debugger init string:
+  // nodelay=0|1, hwm=<bytes>, overflow=pause|close
+  static Options ParseOptions(const std::string& str_debugger);
+
+  OutputQueue(Transport& transport, const Options& options);
+
+  // Applies the transport options and clears any state left from a previous
+  // connection. Call once the client has connected.
+  void Open();
+
+  // Queues a message and starts writing if no write is in flight. A
+  // droppable message, one the peer did not ask for, is dropped instead if
+  // it would take the queue above the high-water mark. The connection is
+  // closed if the queue grows to twice the high-water mark.
+  void Send(std::string message, bool droppable = false);
+
+  // Returns true if the peer should not be asked for more work until the
+  // queue drains.
+  bool IsReadingPaused() const;
+
+  // Sets a handler called when the queue drops below the low-water mark
+  // after having exceeded the high-water mark.
+  void SetDrainedHandler(std::function<void(void)> handler);
+
+  const Options& GetOptions() const { return options_; }
+
+  // Returns the totals since the queue was created, and the bytes not yet
+  // written, for the stats.
+  std::string GetReport() const;
+
+private:
+  void StartWrite();
+  void HandleWrite(const boost::system::error_code& err, size_t bytes);
+
+  Transport& transport_;
+  Options options_;
+  std::deque<std::string> pending_;
+  std::vector<std::string> in_flight_;
+  size_t pending_bytes_;
+  bool write_in_progress_;
+  bool over_high_water_;
+  std::function<void(void)> drained_handler_;
+
+  std::atomic<unsigned long long> bytes_queued_;
+  std::atomic<unsigned long long> messages_queued_;
+  std::atomic<unsigned long long> bytes_written_;
+  std::atomic<unsigned long long> messages_dropped_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_OUTPUTQUEUE_H_
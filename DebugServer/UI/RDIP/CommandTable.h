@@ -0,0 +1,115 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_RDIP_COMMANDTABLE_H_
+#define RDEBUGGER_DEBUGSERVER_UI_RDIP_COMMANDTABLE_H_
+
+#include "./CommandTokenizer.h"
+
+#include <Common/BreakPoint.h>
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// The commands an IDE can send. RDIP dispatches on them, and the command
+// parsing benchmark looks them up the same way.
+enum RdipCommand {
+  RDIP_BREAK,
+  RDIP_TBREAK,
+  RDIP_RUNTO,
+  RDIP_DELETE,
+  RDIP_SLOW,
+  RDIP_WATCH,
+  RDIP_FILTER,
+  RDIP_START,
+  RDIP_CONT,
+  RDIP_EXIT,
+  RDIP_WHERE,
+  RDIP_THREAD,
+  RDIP_FRAME,
+  RDIP_STEP,
+  RDIP_FINISH,
+  RDIP_NEXT,
+  RDIP_BACK,
+  RDIP_RCONT,
+  RDIP_INTERRUPT,
+  RDIP_PAUSE,
+  RDIP_PROFILE,
+  RDIP_ALLOC,
+  RDIP_STATS,
+  RDIP_RECORD,
+  RDIP_VAR,
+  RDIP_COMMAND_COUNT,
+  RDIP_UNKNOWN = RDIP_COMMAND_COUNT
+};
+
+// Returns the command named by the first word of a command, or RDIP_UNKNOWN.
+inline RdipCommand FindRdipCommand(boost::string_ref keyword) {
+  struct Keyword {
+    const char* name;
+    const char* abbreviation;
+  };
+  // In RdipCommand order.
+  static const Keyword keywords[] = {
+    { "break", "b" },
+    { "tbreak", "tb" },
+    { "runto", nullptr },
+    { "delete", "del" },
+    { "slow", nullptr },
+    { "watch", nullptr },
+    { "filter", nullptr },
+    { "start", nullptr },
+    { "cont", "c" },
+    { "exit", "exi" },
+    { "where", "w" },
+    { "thread", "th" },
+    { "frame", "f" },
+    { "step", "s" },
+    { "finish", "finis" },
+    { "next", "n" },
+    { "back", nullptr },
+    { "rcont", nullptr },
+    { "interrupt", "i" },
+    { "pause", nullptr },
+    { "profile", "prof" },
+    { "alloc", nullptr },
+    { "stats", nullptr },
+    { "record", "rec" },
+    { "var", "v" },
+  };
+  static_assert(sizeof(keywords) / sizeof(keywords[0]) == RDIP_COMMAND_COUNT,
+                "One keyword per command");
+  for (size_t i = 0; i < RDIP_COMMAND_COUNT; ++i) {
+    if (CommandTokenizer::IsKeyword(keyword, keywords[i].name,
+                                    keywords[i].abbreviation))
+      return static_cast<RdipCommand>(i);
+  }
+  return RDIP_UNKNOWN;
+}
+
+// Parses the [file:]line of the breakpoint commands.
+inline bool ParseRdipLocation(boost::string_ref location, BreakPoint& bp) {
+  size_t colon = location.rfind(':');
+  boost::string_ref file, line;
+  if (colon == boost::string_ref::npos) {
+    line = location;
+  } else {
+    file = location.substr(0, colon);
+    line = location.substr(colon + 1);
+  }
+  if (!CommandTokenizer::ParseUnsigned(line, bp.line))
+    return false;
+  bp.file.assign(file.begin(), file.end());
+  boost::replace_all(bp.file, "\\", "/");
+  bp.enabled = true;
+  return true;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_RDIP_COMMANDTABLE_H_
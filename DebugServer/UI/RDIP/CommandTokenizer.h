@@ -0,0 +1,100 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_RDIP_COMMANDTOKENIZER_H_
+#define RDEBUGGER_DEBUGSERVER_UI_RDIP_COMMANDTOKENIZER_H_
+
+#include <boost/utility/string_ref.hpp>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Splits a single debugger command into whitespace separated tokens. Works
+// on a view of the text, nothing is copied.
+class CommandTokenizer {
+public:
+  explicit CommandTokenizer(boost::string_ref text) : text_(text) {}
+
+  // Returns the next token, or an empty one if there are no more.
+  boost::string_ref Next() {
+    SkipSpace();
+    size_t n = 0;
+    while (n < text_.size() && !IsSpace(text_[n]))
+      ++n;
+    boost::string_ref token = text_.substr(0, n);
+    text_.remove_prefix(n);
+    return token;
+  }
+
+  // Returns the remaining text without leading and trailing whitespace and
+  // consumes it.
+  boost::string_ref Rest() {
+    SkipSpace();
+    boost::string_ref rest = Trim(text_);
+    text_.clear();
+    return rest;
+  }
+
+  bool AtEnd() {
+    SkipSpace();
+    return text_.empty();
+  }
+
+  // Returns true if token is either the full keyword or its abbreviation.
+  static bool IsKeyword(boost::string_ref token, const char* full,
+                        const char* abbreviation) {
+    return token == full ||
+           (abbreviation != nullptr && token == abbreviation);
+  }
+
+  // Parses a whole token as an unsigned number in the given base.
+  static bool ParseUnsigned(boost::string_ref token, size_t& value,
+                            unsigned base = 10) {
+    if (token.empty())
+      return false;
+    size_t result = 0;
+    for (size_t i = 0; i < token.size(); ++i) {
+      char c = token[i];
+      unsigned digit;
+      if (c >= '0' && c <= '9')
+        digit = c - '0';
+      else if (c >= 'a' && c <= 'f')
+        digit = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        digit = c - 'A' + 10;
+      else
+        return false;
+      if (digit >= base)
+        return false;
+      result = result * base + digit;
+    }
+    value = result;
+    return true;
+  }
+
+  static boost::string_ref Trim(boost::string_ref s) {
+    while (!s.empty() && IsSpace(s.front()))
+      s.remove_prefix(1);
+    while (!s.empty() && IsSpace(s.back()))
+      s.remove_suffix(1);
+    return s;
+  }
+
+private:
+  static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  void SkipSpace() {
+    while (!text_.empty() && IsSpace(text_.front()))
+      text_.remove_prefix(1);
+  }
+
+  boost::string_ref text_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_RDIP_COMMANDTOKENIZER_H_
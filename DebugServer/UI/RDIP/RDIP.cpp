@@ -7,25 +7,29 @@
 
 #include <DebugServer/IDebugServer.h>
 #include <DebugServer/Log.h>
+#include <DebugServer/UI/OutputQueue.h>
+#include <DebugServer/UI/Transport.h>
+#include <DebugServer/UI/RDIP/CommandTable.h>
+#include <DebugServer/UI/RDIP/CommandTokenizer.h>
+#include <DebugServer/UI/RDIP/XmlBuffer.h>
 #include <Common/BreakPoint.h>
 #include <Common/StackFrame.h>
-#include <boost/asio/ip/tcp.hpp>
+#include <Common/StepFilters.h>
 #include <boost/asio/streambuf.hpp>
 #include <boost/asio.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
-#include <boost/format.hpp>
 
 #include <cassert>
 #include <memory>
-#include <regex>
 
 namespace SketchUp {
 namespace RubyDebugger {
 
 class RDIP::Connection : public std::enable_shared_from_this<RDIP::Connection> {
 public:
-  Connection(boost::asio::io_service& service, int port, IDebugServer* server,
+  Connection(std::unique_ptr<Transport> transport,
+             const OutputQueue::Options& output_options,
+             IDebugServer* server,
              std::condition_variable& serverWaitCond,
              std::mutex& serverWaitMutex,
              bool& serverCanContinue,
@@ -35,21 +39,58 @@ public:
   void wait();
   void stopAtBreakpoint(BreakPoint bp);
   void suspendAt(const std::string& file, size_t line);
+  void message(const std::string& text);
 
 private:
   void start(const boost::system::error_code& err);
-  void handleCommand(const boost::system::error_code& err);
-  void evaluateCommand(const std::string& cmd);
+  void readCommand();
+  void handleCommand(const boost::system::error_code& err, size_t bytes);
+  void evaluateCommand(boost::string_ref cmd);
+  void logUnknownCommand(boost::string_ref cmd);
+  void resumeServer();
+  void disconnect();
+  void onBreak(CommandTokenizer& args);
+  void onTemporaryBreak(CommandTokenizer& args);
+  void onRunTo(CommandTokenizer& args);
+  void onDelete(CommandTokenizer& args);
+  void onSlow(CommandTokenizer& args);
+  void onWatch(CommandTokenizer& args);
+  void onFilter(CommandTokenizer& args);
+  void onContinue(CommandTokenizer& args);
+  void onExit(CommandTokenizer& args);
+  void onWhere(CommandTokenizer& args);
+  void getFrames(size_t start_frame, size_t levels);
+  void getFrameChanges(size_t known_stop_id);
+  void sendFrames(bool changes);
+  void onThread(CommandTokenizer& args);
+  void onFrame(CommandTokenizer& args);
+  void onStep(CommandTokenizer& args);
+  void onFinish(CommandTokenizer& args);
+  void onNext(CommandTokenizer& args);
+  void stepRepeatedly(CommandTokenizer& args, bool step_over);
+  void onBack(CommandTokenizer& args);
+  void onReverseContinue(CommandTokenizer& args);
+  void showHistoryMove(HistoryMove move);
+  void onInterrupt(CommandTokenizer& args);
+  void onProfile(CommandTokenizer& args);
+  void onAlloc(CommandTokenizer& args);
+  void onStats(CommandTokenizer& args);
+  void onRecord(CommandTokenizer& args);
+  void onVar(CommandTokenizer& args);
   void getVariables(bool local);
   void getInstanceVariables(size_t object_id);
   void evalExpression();
   void sendVariables(std::string kind);
+  void addWatchPoint();
+  void sendWatchPointAdded();
 
 private:
-  boost::asio::ip::tcp::socket socket_;
-  boost::asio::ip::tcp::acceptor acceptor_;
+  std::unique_ptr<Transport> transport_;
   boost::asio::streambuf read_buffer_;
-  boost::asio::streambuf write_buffer_;
+  OutputQueue output_;
+  XmlBuffer xml_;
+  bool reading_paused_;
+  bool connected_;
   IDebugServer* server_;
   std::condition_variable &server_wait_cond_;
   std::mutex &server_wait_mutex_;
@@ -59,6 +100,16 @@ private:
   std::string expression_to_eval_;
   std::mutex variables_to_send_mutex_;
   IDebugServer::VariablesVector variables_to_send_;
+  // Frames read on the server thread, and the index of the first one.
+  std::vector<StackFrame> frames_to_send_;
+  size_t first_frame_to_send_;
+  // For where changes, the stop of the frames and the number of frames
+  // below them the IDE already has.
+  size_t frames_stop_id_;
+  size_t unchanged_frames_;
+  // Watchpoint added on the server thread, and whether that worked.
+  WatchPoint watchpoint_;
+  bool watchpoint_added_;
 };
 
 RDIP::RDIP()
@@ -74,22 +125,28 @@ RDIP::~RDIP() {
 void RDIP::Initialize(IDebugServer* server, const std::string& str_debugger) {
   server_ = server;
   
-  // Parse the port number if given.
-  int port = 1234;
-  const std::regex reg_port("port=(\\d+)");
-  std::smatch match;
-  if (regex_search(str_debugger, match, reg_port)) {
-    port = boost::lexical_cast<int>(match[1]);
-  }
+  output_options_ = OutputQueue::ParseOptions(str_debugger);
+
+  // The connection exists before the server can call Message or Break,
+  // which post handlers bound to it. The transport (TCP port or Unix domain
+  // socket) is selected by the init string.
+  std::unique_ptr<Transport> transport =
+      Transport::Create(io_service_, str_debugger);
+  Log(("Debugger listening on " + transport->GetDescription() + "\n").c_str());
+  connection_ = std::make_shared<Connection>(std::move(transport),
+      output_options_, server_,
+      server_wait_cond_, server_wait_mutex_, server_can_continue_, server_response_,
+      process_server_response_);
 
   // Start the i/o service thread.
-  service_thread_ = std::thread(std::bind(&RDIP::RunService, this, port));
+  service_thread_ = std::thread(std::bind(&RDIP::RunService, this));
 }
 
 void RDIP::WaitForContinue() {
   std::unique_lock<std::mutex> lock(server_wait_mutex_);
   server_can_continue_ = false;
-  while(!server_can_continue_) {
+  // Nobody will tell us to continue once the IDE is gone.
+  while(!server_can_continue_ && server_->IsAttached()) {
     if (server_response_) {
       server_response_();
       if (process_server_response_)
@@ -111,11 +168,12 @@ void RDIP::Break(const std::string& file, size_t line) {
   WaitForContinue();
 }
 
-void RDIP::RunService(int port) {
+void RDIP::Message(const std::string& text) {
+  io_service_.post(std::bind(&RDIP::Connection::message, connection_.get(), text));
+}
+
+void RDIP::RunService() {
   signal_set_.async_wait(std::bind(&RDIP::HandleFatalFailure, this, std::placeholders::_1, std::placeholders::_2));
-  connection_ = std::make_shared<Connection>(io_service_, port, server_,
-      server_wait_cond_, server_wait_mutex_, server_can_continue_, server_response_,
-      process_server_response_);
   connection_->wait();
   io_service_.run();
 }
@@ -123,224 +181,708 @@ void RDIP::RunService(int port) {
 void RDIP::HandleFatalFailure(const boost::system::error_code& err, int signal)
 {}
 
-using boost::asio::ip::tcp;
-using boost::asio::ip::address;
-
-RDIP::Connection::Connection(boost::asio::io_service& service, int port,
+RDIP::Connection::Connection(std::unique_ptr<Transport> transport,
+                             const OutputQueue::Options& output_options,
                              IDebugServer* server,
                              std::condition_variable& serverWaitCond,
                              std::mutex& serverWaitMutex,
                              bool& serverCanContinue,
                              std::function<void(void)>& serverResponse,
                              std::function<void(void)>& processServerResponse)
-  : socket_(service)
-  , acceptor_(service, tcp::endpoint(tcp::v4(), port))
+  : transport_(std::move(transport))
+  , output_(*transport_, output_options)
+  , reading_paused_(false)
+  , connected_(false)
   , server_(server)
   , server_wait_cond_(serverWaitCond)
   , server_wait_mutex_(serverWaitMutex)
   , server_can_continue_(serverCanContinue)
   , server_response_(serverResponse)
   , process_server_response_(processServerResponse)
+  , first_frame_to_send_(0)
+  , frames_stop_id_(0)
+  , unchanged_frames_(0)
+  , watchpoint_added_(false)
 {}
 
 void RDIP::Connection::wait() {
-  acceptor_.async_accept(socket_, std::bind(&Connection::start, this, std::placeholders::_1));
+  transport_->AsyncAccept(std::bind(&Connection::start, this, std::placeholders::_1));
 }
 
 void RDIP::Connection::start(const boost::system::error_code& err) {
-  async_read_until(socket_, read_buffer_, "\n", std::bind(&Connection::handleCommand, this, std::placeholders::_1));
+  if (err) {
+    std::ostringstream os;
+    os << "Accepting the IDE connection failed: " << err << "\n";
+    Log(os.str().c_str());
+    return;
+  }
+  Log("IDE connected\n");
+  server_->Attach();
+  connected_ = true;
+  output_.Open();
+  // Resume reading commands once a backed up IDE has caught up.
+  output_.SetDrainedHandler([this]() {
+    if (reading_paused_) {
+      reading_paused_ = false;
+      readCommand();
+    }
+  });
+  if (!transport_->GetNotice().empty())
+    message(transport_->GetNotice());
+  readCommand();
+}
+
+void RDIP::Connection::readCommand() {
+  if (output_.IsReadingPaused()) {
+    Log("IDE is not reading replies, pausing command processing\n");
+    reading_paused_ = true;
+    return;
+  }
+  transport_->AsyncReadUntil(read_buffer_, "\n", std::bind(&Connection::handleCommand, this, std::placeholders::_1, std::placeholders::_2));
 }
 
-void RDIP::Connection::handleCommand(const boost::system::error_code& err) {
+void RDIP::Connection::handleCommand(const boost::system::error_code& err,
+                                     size_t bytes) {
   if(!err) {
-    std::ostringstream out;
-    out << &read_buffer_;
-    std::string str = out.str();
+    // Parse the line in place. The command handlers copy whatever they need
+    // to keep before the buffer is consumed.
+    const char* line = boost::asio::buffer_cast<const char*>(read_buffer_.data());
+    boost::string_ref str(line, bytes);
     Log("\nCommand from IDE => ");
-    Log(str.c_str());
-    std::vector<std::string> commands;
-    boost::split(commands, str, boost::is_any_of(";"));
-    for(const auto& cmd : commands) {
-      evaluateCommand(boost::trim_copy(cmd));
+    Log(std::string(line, bytes).c_str());
+    while (!str.empty()) {
+      size_t sep = str.find(';');
+      boost::string_ref cmd = str.substr(0, sep);
+      evaluateCommand(CommandTokenizer::Trim(cmd));
+      if (sep == boost::string_ref::npos)
+        break;
+      str.remove_prefix(sep + 1);
     }
-    //assert(write(mSocket, boost::asio::buffer("<message>some text</message>\n")) > 0);
-    async_read_until(socket_, read_buffer_, "\n", std::bind(&Connection::handleCommand, this, std::placeholders::_1));
+    read_buffer_.consume(bytes);
+    readCommand();
   } else {
     std::ostringstream os;
     os << err;
     Log(os.str().c_str());
+    disconnect();
+  }
+}
+
+void RDIP::Connection::disconnect() {
+  Log("IDE disconnected\n");
+  // Stop tracing and let SketchUp go if it is waiting for us, then wait for
+  // the next IDE.
+  server_->Detach();
+  connected_ = false;
+  resumeServer();
+  transport_->Close();
+  read_buffer_.consume(read_buffer_.size());
+  reading_paused_ = false;
+  wait();
+}
+
+void RDIP::Connection::evaluateCommand(boost::string_ref cmd) {
+  typedef void (RDIP::Connection::*Handler)(CommandTokenizer& args);
+  // In RdipCommand order.
+  static const Handler handlers[] = {
+    &Connection::onBreak,
+    &Connection::onTemporaryBreak,
+    &Connection::onRunTo,
+    &Connection::onDelete,
+    &Connection::onSlow,
+    &Connection::onWatch,
+    &Connection::onFilter,
+    &Connection::onContinue,
+    &Connection::onContinue,
+    &Connection::onExit,
+    &Connection::onWhere,
+    &Connection::onThread,
+    &Connection::onFrame,
+    &Connection::onStep,
+    &Connection::onFinish,
+    &Connection::onNext,
+    &Connection::onBack,
+    &Connection::onReverseContinue,
+    &Connection::onInterrupt,
+    &Connection::onInterrupt,
+    &Connection::onProfile,
+    &Connection::onAlloc,
+    &Connection::onStats,
+    &Connection::onRecord,
+    &Connection::onVar,
+  };
+  static_assert(sizeof(handlers) / sizeof(handlers[0]) == RDIP_COMMAND_COUNT,
+                "One handler per command");
+
+  CommandTokenizer args(cmd);
+  RdipCommand command = FindRdipCommand(args.Next());
+  if (command == RDIP_UNKNOWN) {
+    logUnknownCommand(cmd);
+    return;
   }
+  (this->*handlers[command])(args);
+}
+
+void RDIP::Connection::logUnknownCommand(boost::string_ref cmd) {
+  Log("Unknown command : ");
+  Log(std::string(cmd.begin(), cmd.end()).c_str());
+  Log("\n");
+}
+
+void RDIP::Connection::resumeServer() {
+  std::lock_guard<std::mutex> lock(server_wait_mutex_);
+  server_can_continue_ = true;
+  server_wait_cond_.notify_all();
 }
 
-static std::string encodeXml(const std::string& str) {
-  std::string encoded = boost::replace_all_copy(str, "&", "&amp;");
-  boost::replace_all(encoded, "\"", "&quot;");
-  boost::replace_all(encoded, "<", "&lt;");
-  boost::replace_all(encoded, ">", "&gt;");
-  boost::replace_all(encoded, "'", "&apos;");
-  return encoded;
-}
-
-void RDIP::Connection::evaluateCommand(const std::string& cmd) {
-  static const std::regex reg_brk("^\\s*b(?:reak)?\\s+(?:(.+):)?([^.:]+)$");
-  static const std::regex reg_brk_del("^\\s*del(?:ete)?(?:\\s+(\\d+))?$");
-  static const std::regex reg_start("^\\s*start$");
-  static const std::regex reg_exit("^\\s*exit?$");
-  static const std::regex reg_cont("^\\s*c(?:ont)?$");
-  static const std::regex reg_where("^\\s*w(?:here)?$");
-  static const std::regex reg_frame("^\\s*f(?:rame)? ([0-9]+)$");
-  static const std::regex reg_step("^\\s*s(?:tep)?\\s?");
-  static const std::regex reg_next("^\\s*n(?:ext)?$");
-  static const std::regex reg_finish("^\\s*finish?$");
-  static const std::regex reg_var_inspect("v inspect\\s+");
-  static const std::regex reg_thr_lst("^\\s*th(?:read)? l(?:ist)?$");
-  static const std::regex reg_var_local("^\\s*v(?:ar)? l(?:ocal)?$");
-  static const std::regex reg_var_global("^\\s*v(?:ar)? g(?:lobal)?$");
-  static const std::regex reg_var_instance("^\\s*v(?:ar)? i(?:nstance)? (.+)$");
-
-  std::smatch what;
-  if(regex_match(cmd, what, reg_brk)) {
-    if(what.size() == 3) {
-      BreakPoint bp;
-      bp.file = what[1];
-      boost::replace_all(bp.file, "\\", "/");
-      std::string s2 = what[2];
-      bp.line = std::atoi(s2.c_str());
-      bp.enabled = true;
-      if(server_->AddBreakPoint(bp, true)) {
-        std::ostringstream reply;
-        reply << "<breakpointAdded no=\"" << bp.index << "\" location=\"" << bp.file << ":" << bp.line << "\"/>\n";
-        write(socket_, boost::asio::buffer(reply.str()));
-        Log(reply.str().c_str());
-        Log("    => Breakpoint added\n");
-      } else {
-        Log("Adding breakpoint failed\n.");
-      }
+// b[reak] [file:]line
+void RDIP::Connection::onBreak(CommandTokenizer& args) {
+  BreakPoint bp;
+  if (!ParseRdipLocation(args.Rest(), bp)) {
+    Log("Adding breakpoint failed\n.");
+    return;
+  }
+  if(server_->AddBreakPoint(bp, true)) {
+    std::ostringstream reply;
+    reply << "<breakpointAdded no=\"" << bp.index << "\" location=\"" << bp.file << ":" << bp.line << "\"/>\n";
+    Log(reply.str().c_str());
+    output_.Send(reply.str());
+    Log("    => Breakpoint added\n");
+  } else {
+    Log("Adding breakpoint failed\n.");
+  }
+}
+
+// tb[reak] [file:]line
+void RDIP::Connection::onTemporaryBreak(CommandTokenizer& args) {
+  BreakPoint bp;
+  if (!ParseRdipLocation(args.Rest(), bp) ||
+      !server_->AddTemporaryBreakPoint(bp, false)) {
+    Log("Adding temporary breakpoint failed\n");
+    return;
+  }
+  std::ostringstream reply;
+  reply << "<breakpointAdded no=\"" << bp.index << "\" location=\""
+        << bp.file << ":" << bp.line << "\"/>\n";
+  Log(reply.str().c_str());
+  output_.Send(reply.str());
+}
+
+// runto [file:]line
+void RDIP::Connection::onRunTo(CommandTokenizer& args) {
+  BreakPoint bp;
+  if (!ParseRdipLocation(args.Rest(), bp) ||
+      !server_->AddTemporaryBreakPoint(bp, true)) {
+    Log("Run to line failed\n");
+    return;
+  }
+  // Reaching the line is reported with <suspended>, like a step.
+  resumeServer();
+}
+
+// del[ete] index
+void RDIP::Connection::onDelete(CommandTokenizer& args) {
+  size_t bp_index = 0;
+  if (!CommandTokenizer::ParseUnsigned(args.Next(), bp_index) ||
+      !args.AtEnd()) {
+    Log("Breakpoint could not be deleted\n");
+    return;
+  }
+  if (server_->RemoveBreakPoint(bp_index)) {
+    std::ostringstream reply;
+    reply << "<breakpointDeleted no=\"" << bp_index << "\" />\n";
+    Log(reply.str().c_str());
+    output_.Send(reply.str());
+    Log("    => Breakpoint deleted\n");
+  } else {
+    Log("Breakpoint could not be deleted\n");
+  }
+}
+
+// slow ms method Class#name [log] | slow ms path path_prefix [log]
+void RDIP::Connection::onSlow(CommandTokenizer& args) {
+  size_t threshold_ms = 0;
+  if (!CommandTokenizer::ParseUnsigned(args.Next(), threshold_ms)) {
+    Log("Adding slow-call breakpoint failed\n");
+    return;
+  }
+  SlowCallBreakPoint bp;
+  bp.threshold_ms = static_cast<unsigned>(threshold_ms);
+  boost::string_ref kind = args.Next();
+  boost::string_ref target = args.Next();
+  if (CommandTokenizer::IsKeyword(kind, "method", nullptr)) {
+    bp.method.assign(target.begin(), target.end());
+  } else if (CommandTokenizer::IsKeyword(kind, "path", nullptr)) {
+    bp.path_prefix.assign(target.begin(), target.end());
+    boost::replace_all(bp.path_prefix, "\\", "/");
+  } else {
+    Log("Unknown slow command\n");
+    return;
+  }
+  if (!args.AtEnd()) {
+    if (!CommandTokenizer::IsKeyword(args.Next(), "log", nullptr)) {
+      Log("Unknown slow command\n");
+      return;
     }
-  } else if (regex_match(cmd, what, reg_brk_del)) {
-    if (what.size() == 2) {
-      size_t bp_index = boost::lexical_cast<size_t>(what[1]);
-      if (server_->RemoveBreakPoint(bp_index)) {
-        std::ostringstream reply;
-        reply << "<breakpointDeleted no=\"" << bp_index << "\" />\n";
-        write(socket_, boost::asio::buffer(reply.str()));
-        Log(reply.str().c_str());
-        Log("    => Breakpoint deleted\n");
-      } else {
-        Log("Breakpoint could not be deleted\n");
-      }
+    bp.suspend = false;
+  }
+  if (server_->AddSlowCallBreakPoint(bp)) {
+    std::ostringstream reply;
+    reply << "<breakpointAdded no=\"" << bp.index << "\" location=\""
+          << (bp.method.empty() ? bp.path_prefix : bp.method) << "\"/>\n";
+    Log(reply.str().c_str());
+    output_.Send(reply.str());
+  } else {
+    Log("Adding slow-call breakpoint failed\n");
+  }
+}
+
+// filter [path glob | class name | clear]
+// Changes the step filters and replies with all of them as a message.
+void RDIP::Connection::onFilter(CommandTokenizer& args) {
+  StepFilters filters = server_->GetStepFilters();
+  if (!args.AtEnd()) {
+    boost::string_ref kind = args.Next();
+    std::string target = args.Rest().to_string();
+    if (CommandTokenizer::IsKeyword(kind, "path", nullptr) &&
+        !target.empty()) {
+      filters.paths.push_back(target);
+    } else if (CommandTokenizer::IsKeyword(kind, "class", nullptr) &&
+               !target.empty()) {
+      filters.classes.push_back(target);
+    } else if (CommandTokenizer::IsKeyword(kind, "clear", nullptr)) {
+      filters = StepFilters();
+    } else {
+      Log("Unknown filter command\n");
+      return;
     }
-  } else if(regex_match(cmd, what, reg_start) || 
-            regex_match(cmd, what, reg_cont)) {
-    std::lock_guard<std::mutex> lock(server_wait_mutex_);
-    server_can_continue_ = true;
-    server_wait_cond_.notify_all();
-  } else if(regex_match(cmd, what, reg_exit)) {
-    // Stop debugging. First let SU continue in case it's at a breakpoint.
-    std::lock_guard<std::mutex> lock(server_wait_mutex_);
-    server_can_continue_ = true;
-    server_wait_cond_.notify_all();
-    // Now call Stop. It's unclear if it is ok to do this from the RDIP thread
-    // but it appears to work.
-    server_->Stop();
-  } else if(regex_match(cmd, what, reg_where)) {
-    auto frames = server_->GetStackFrames();
-    std::string str_send = "<frames>\n";
-
-    size_t activeFrameIdx = server_->GetActiveFrameIndex();
-    for(size_t i = 0; i < frames.size(); ++i) {
-      const StackFrame& frame = frames[i];
-      std::string file = encodeXml(frame.file);
-      if(activeFrameIdx != i) {
-        boost::format fmt("<frame no=\"%1%\" file=\"%2%\" line=\"%3%\"/>");
-        fmt % i % file % frame.line;
-        str_send += fmt.str();
-      } else {
-        boost::format fmt("<frame no=\"%1%\" file=\"%2%\" line=\"%3%\" current=\"yes\"/>");
-        fmt % i % file % frame.line;
-        str_send += fmt.str();
-      }
+    server_->SetStepFilters(filters);
+    filters = server_->GetStepFilters();
+  }
+  std::string text = "Step filters:\n";
+  for (auto it = filters.paths.cbegin(), ite = filters.paths.cend();
+       it != ite; ++it) {
+    text += "  path " + *it + "\n";
+  }
+  for (auto it = filters.classes.cbegin(), ite = filters.classes.cend();
+       it != ite; ++it) {
+    text += "  class " + *it + "\n";
+  }
+  message(text);
+}
+
+// watch @name object_id | watch name [frame]
+void RDIP::Connection::onWatch(CommandTokenizer& args) {
+  boost::string_ref name = args.Next();
+  if (name.empty()) {
+    Log("Missing watch variable\n");
+    return;
+  }
+  WatchPoint wp;
+  wp.variable.assign(name.begin(), name.end());
+  if (name[0] == '@') {
+    if (!CommandTokenizer::ParseUnsigned(args.Next(), wp.object_id, 16)) {
+      Log("Invalid object id\n");
+      return;
     }
-    str_send += "</frames>\n";
-    Log(str_send.c_str());
-    write(socket_, boost::asio::buffer(str_send));
-  } else if(regex_match(cmd, what, reg_thr_lst)) {
-    std::string str_send = "<threads>\n";
-    std::ostringstream reply;
-    reply << "<thread id=\"1\" status=\"run\"/>\n";
-    reply << "</threads>\n";
-    str_send += reply.str();
-    write(socket_, boost::asio::buffer(str_send));
-  } else if(regex_match(cmd, what, reg_frame)) {
-    if(what.size() == 2) {
-      size_t frameIndex = boost::lexical_cast<size_t>(what[1]);
-      server_->SetActiveFrameIndex(frameIndex);
+  } else {
+    wp.frame = server_->GetActiveFrameIndex();
+    if (!args.AtEnd() &&
+        !CommandTokenizer::ParseUnsigned(args.Next(), wp.frame)) {
+      Log("Invalid frame index\n");
+      return;
     }
   }
-  else if(regex_match(cmd, what, reg_step)) {
-    server_->Step();
-    std::lock_guard<std::mutex> lock(server_wait_mutex_);
-    server_can_continue_ = true;
-    server_wait_cond_.notify_all();
-  } else if(regex_match(cmd, what, reg_finish)) {
-    server_->StepOut();
-    std::lock_guard<std::mutex> lock(server_wait_mutex_);
-    server_can_continue_ = true;
-    server_wait_cond_.notify_all();
-  } else if(regex_match(cmd, what, reg_next)) {
-    server_->StepOver();
-    std::lock_guard<std::mutex> lock(server_wait_mutex_);
-    server_can_continue_ = true;
-    server_wait_cond_.notify_all();
-  } else if(regex_search(cmd, what, reg_var_inspect)) {
-    expression_to_eval_ = what.suffix();
+  if (!server_->IsStopped()) {
+    Log("Watchpoints can only be added while stopped\n");
+    return;
+  }
+  // The current value must be read in the server thread.
+  watchpoint_ = wp;
+  server_response_ = std::bind(&RDIP::Connection::addWatchPoint, this);
+  process_server_response_ =
+      std::bind(&RDIP::Connection::sendWatchPointAdded, this);
+  server_wait_cond_.notify_all();
+}
+
+// start, c[ont]
+void RDIP::Connection::onContinue(CommandTokenizer& args) {
+  if (server_->IsInHistory()) {
+    showHistoryMove(HISTORY_CONTINUE);
+    return;
+  }
+  resumeServer();
+}
+
+// exi[t]
+void RDIP::Connection::onExit(CommandTokenizer& args) {
+  // Stop debugging. First let SU continue in case it's at a breakpoint.
+  resumeServer();
+  // Now call Stop. It's unclear if it is ok to do this from the RDIP thread
+  // but it appears to work.
+  server_->Stop();
+}
+
+// w[here] [start_frame [levels]], w[here] changes known_stop_id
+void RDIP::Connection::onWhere(CommandTokenizer& args) {
+  size_t start_frame = 0;
+  size_t levels = 0;
+  size_t known_stop_id = 0;
+  bool changes = false;
+  boost::string_ref first = args.Next();
+  if (CommandTokenizer::IsKeyword(first, "changes", nullptr)) {
+    changes = true;
+    if (!CommandTokenizer::ParseUnsigned(args.Next(), known_stop_id)) {
+      Log("Invalid stop id\n");
+      return;
+    }
+  } else if (!first.empty() &&
+      (!CommandTokenizer::ParseUnsigned(first, start_frame) ||
+       (!args.AtEnd() &&
+        !CommandTokenizer::ParseUnsigned(args.Next(), levels)))) {
+    Log("Unknown where command\n");
+    return;
+  }
+  if (!server_->IsStopped()) {
+    {
+      std::lock_guard<std::mutex> lock(variables_to_send_mutex_);
+      frames_to_send_.clear();
+      first_frame_to_send_ = 0;
+      frames_stop_id_ = 0;
+      unchanged_frames_ = 0;
+    }
+    sendFrames(changes);
+    return;
+  }
+  // Frames below the top one are read in the server thread.
+  if (changes) {
+    server_response_ = std::bind(&RDIP::Connection::getFrameChanges, this,
+                                 known_stop_id);
+  } else {
+    server_response_ = std::bind(&RDIP::Connection::getFrames, this,
+                                 start_frame, levels);
+  }
+  process_server_response_ = std::bind(&RDIP::Connection::sendFrames, this,
+                                       changes);
+  server_wait_cond_.notify_all();
+}
+
+void RDIP::Connection::getFrames(size_t start_frame, size_t levels) {
+  std::lock_guard<std::mutex> lock(variables_to_send_mutex_);
+  frames_to_send_ = server_->GetStackFrames(start_frame, levels);
+  first_frame_to_send_ = start_frame;
+}
+
+// Only the top of the stack changes from step to step. The IDE keeps the
+// bottom frames it got for known_stop_id.
+void RDIP::Connection::getFrameChanges(size_t known_stop_id) {
+  std::lock_guard<std::mutex> lock(variables_to_send_mutex_);
+  frames_to_send_ = server_->GetStackFrameChanges(known_stop_id,
+                                                  unchanged_frames_);
+  first_frame_to_send_ = 0;
+  frames_stop_id_ = server_->GetStopId();
+}
+
+// With changes, <frames> has the stop id to pass to the next where changes,
+// and the number of frames below the ones sent that the IDE keeps.
+void RDIP::Connection::sendFrames(bool changes) {
+  std::lock_guard<std::mutex> lock(variables_to_send_mutex_);
+  xml_.Clear();
+  xml_.Append("<frames");
+  if (changes) {
+    xml_.Attribute("stop", frames_stop_id_)
+        .Attribute("unchanged", unchanged_frames_);
+  }
+  xml_.Append(">\n");
+
+  size_t activeFrameIdx = server_->GetActiveFrameIndex();
+  for(size_t i = 0; i < frames_to_send_.size(); ++i) {
+    const StackFrame& frame = frames_to_send_[i];
+    size_t no = first_frame_to_send_ + i;
+    xml_.Append("<frame").Attribute("no", no).Attribute("file", frame.file)
+        .Attribute("line", frame.line);
+    if(activeFrameIdx == no)
+      xml_.Append(" current=\"yes\"");
+    xml_.Append("/>");
+  }
+  xml_.Append("</frames>\n");
+  Log(xml_.str().c_str());
+  output_.Send(xml_.str());
+  frames_to_send_.clear();
+}
+
+// th[read] l[ist]
+void RDIP::Connection::onThread(CommandTokenizer& args) {
+  if (!CommandTokenizer::IsKeyword(args.Next(), "list", "l")) {
+    Log("Unknown thread command\n");
+    return;
+  }
+  output_.Send("<threads>\n<thread id=\"1\" status=\"run\"/>\n</threads>\n");
+}
+
+// f[rame] index
+void RDIP::Connection::onFrame(CommandTokenizer& args) {
+  size_t frameIndex = 0;
+  if (CommandTokenizer::ParseUnsigned(args.Next(), frameIndex))
+    server_->SetActiveFrameIndex(frameIndex);
+}
+
+// s[tep] [trace] [count] [until expression]
+void RDIP::Connection::onStep(CommandTokenizer& args) {
+  if (server_->IsInHistory()) {
+    showHistoryMove(HISTORY_STEP);
+    return;
+  }
+  if (!args.AtEnd()) {
+    stepRepeatedly(args, false);
+    return;
+  }
+  server_->Step();
+  resumeServer();
+}
+
+// finis[h]
+void RDIP::Connection::onFinish(CommandTokenizer& args) {
+  if (server_->IsInHistory()) {
+    showHistoryMove(HISTORY_STEP_OUT);
+    return;
+  }
+  server_->StepOut();
+  resumeServer();
+}
+
+// n[ext] [trace] [count] [until expression]
+void RDIP::Connection::onNext(CommandTokenizer& args) {
+  if (server_->IsInHistory()) {
+    showHistoryMove(HISTORY_STEP_OVER);
+    return;
+  }
+  if (!args.AtEnd()) {
+    stepRepeatedly(args, true);
+    return;
+  }
+  server_->StepOver();
+  resumeServer();
+}
+
+// The steps are taken on the Ruby thread, the IDE only gets the last stop.
+void RDIP::Connection::stepRepeatedly(CommandTokenizer& args,
+                                      bool step_over) {
+  bool trace = false;
+  size_t count = 0;
+  std::string until;
+  boost::string_ref token = args.Next();
+  if (CommandTokenizer::IsKeyword(token, "trace", nullptr)) {
+    trace = true;
+    token = args.Next();
+  }
+  if (CommandTokenizer::ParseUnsigned(token, count))
+    token = args.Next();
+  if (CommandTokenizer::IsKeyword(token, "until", nullptr)) {
+    until = args.Rest().to_string();
+    if (until.empty()) {
+      Log("Missing step condition\n");
+      return;
+    }
+  } else if (!token.empty()) {
+    Log("Unknown step command\n");
+    return;
+  }
+  server_->StepRepeatedly(step_over, count, until, trace);
+  resumeServer();
+}
+
+// back
+void RDIP::Connection::onBack(CommandTokenizer& args) {
+  showHistoryMove(HISTORY_STEP_BACK);
+}
+
+// rcont
+void RDIP::Connection::onReverseContinue(CommandTokenizer& args) {
+  showHistoryMove(HISTORY_REVERSE_CONTINUE);
+}
+
+// Moves through the execution history and reports the new position the way
+// a step or a breakpoint would. Ruby stays stopped.
+void RDIP::Connection::showHistoryMove(HistoryMove move) {
+  size_t breakpoint_index = 0;
+  if (!server_->MoveInHistory(move, breakpoint_index))
+    message("No further position in the execution history\n");
+  // The IDE waits for a stop after every step or continue, even if the
+  // position did not change. The top frame can be read from any thread.
+  std::vector<StackFrame> frames = server_->GetStackFrames(0, 1);
+  if (frames.empty())
+    return;
+  if (breakpoint_index != 0) {
+    BreakPoint bp;
+    bp.index = breakpoint_index;
+    bp.file = frames[0].file;
+    bp.line = frames[0].line;
+    stopAtBreakpoint(bp);
+  } else {
+    suspendAt(frames[0].file, frames[0].line);
+  }
+}
+
+// i[nterrupt], pause
+void RDIP::Connection::onInterrupt(CommandTokenizer& args) {
+  // The Ruby thread reports the location with <suspended> once it gets there.
+  server_->Pause();
+}
+
+// prof[ile] start | stop report_path
+void RDIP::Connection::onProfile(CommandTokenizer& args) {
+  boost::string_ref what = args.Next();
+  if (CommandTokenizer::IsKeyword(what, "start", nullptr)) {
+    server_->StartProfiling();
+  } else if (CommandTokenizer::IsKeyword(what, "stop", nullptr)) {
+    boost::string_ref path = args.Rest();
+    if (path.empty()) {
+      Log("Missing profile report path\n");
+      return;
+    }
+    // A <message> is sent once the report is written.
+    server_->StopProfiling(std::string(path.begin(), path.end()));
+  } else {
+    Log("Unknown profile command\n");
+  }
+}
+
+// alloc start | stop | mark | report [count] | dump report_path [count]
+void RDIP::Connection::onAlloc(CommandTokenizer& args) {
+  const size_t kDefaultSites = 20;
+  boost::string_ref what = args.Next();
+  if (CommandTokenizer::IsKeyword(what, "start", nullptr)) {
+    server_->StartAllocationTracking();
+  } else if (CommandTokenizer::IsKeyword(what, "stop", nullptr)) {
+    server_->StopAllocationTracking();
+  } else if (CommandTokenizer::IsKeyword(what, "mark", nullptr)) {
+    server_->MarkAllocations();
+  } else if (CommandTokenizer::IsKeyword(what, "report", nullptr)) {
+    size_t count = kDefaultSites;
+    CommandTokenizer::ParseUnsigned(args.Next(), count);
+    message(server_->GetAllocationReport(count));
+  } else if (CommandTokenizer::IsKeyword(what, "dump", nullptr)) {
+    boost::string_ref path = args.Next();
+    if (path.empty()) {
+      Log("Missing allocation report path\n");
+      return;
+    }
+    size_t count = kDefaultSites;
+    CommandTokenizer::ParseUnsigned(args.Next(), count);
+    std::string str_path(path.begin(), path.end());
+    message(server_->WriteAllocationReport(str_path, count) ?
+        "Allocation report written to " + str_path + "\n" :
+        "Could not write allocation report to " + str_path + "\n");
+  } else {
+    Log("Unknown alloc command\n");
+  }
+}
+
+// stats [gc start | gc stop | gc reset]
+void RDIP::Connection::onStats(CommandTokenizer& args) {
+  if (args.AtEnd()) {
+    message(server_->GetGcStats() + output_.GetReport());
+    return;
+  }
+  if (!CommandTokenizer::IsKeyword(args.Next(), "gc", nullptr)) {
+    Log("Unknown stats command\n");
+    return;
+  }
+  boost::string_ref what = args.Next();
+  if (CommandTokenizer::IsKeyword(what, "start", nullptr))
+    server_->StartGcMonitoring();
+  else if (CommandTokenizer::IsKeyword(what, "stop", nullptr))
+    server_->StopGcMonitoring();
+  else if (CommandTokenizer::IsKeyword(what, "reset", nullptr))
+    server_->ResetGcStats();
+  else
+    Log("Unknown stats gc command\n");
+}
+
+// rec[ord] start path [size_mb] | stop | flush
+void RDIP::Connection::onRecord(CommandTokenizer& args) {
+  const size_t kDefaultSizeMb = 64;
+  boost::string_ref what = args.Next();
+  if (CommandTokenizer::IsKeyword(what, "start", nullptr)) {
+    boost::string_ref path = args.Next();
+    if (path.empty()) {
+      Log("Missing trace recording path\n");
+      return;
+    }
+    size_t size_mb = kDefaultSizeMb;
+    CommandTokenizer::ParseUnsigned(args.Next(), size_mb);
+    server_->StartRecording(std::string(path.begin(), path.end()), size_mb);
+  } else if (CommandTokenizer::IsKeyword(what, "stop", nullptr)) {
+    server_->StopRecording();
+  } else if (CommandTokenizer::IsKeyword(what, "flush", nullptr)) {
+    server_->FlushRecording();
+  } else {
+    Log("Unknown record command\n");
+  }
+}
+
+// v[ar] l[ocal] | g[lobal] | i[nstance] object_id, v inspect expression
+void RDIP::Connection::onVar(CommandTokenizer& args) {
+  boost::string_ref what = args.Next();
+  if (CommandTokenizer::IsKeyword(what, "inspect", nullptr)) {
+    boost::string_ref expr = args.Rest();
+    expression_to_eval_.assign(expr.begin(), expr.end());
     server_response_ = std::bind(&RDIP::Connection::evalExpression, this);
     process_server_response_ = std::bind(&RDIP::Connection::sendVariables, this, "watch");
     server_wait_cond_.notify_all();
-  } else if(regex_match(cmd, what, reg_var_local)) {
+  } else if (CommandTokenizer::IsKeyword(what, "local", "l")) {
     // Local variables must be retrieved in the server thread. Wake it up
     // and have it call us.
     server_response_ = std::bind(&RDIP::Connection::getVariables, this, true);
     process_server_response_ = std::bind(&RDIP::Connection::sendVariables, this, "local");
     server_wait_cond_.notify_all();
-  } else if(regex_match(cmd, what, reg_var_global)) {
+  } else if (CommandTokenizer::IsKeyword(what, "global", "g")) {
     // Global variables must be retrieved in the server thread. Wake it up
     // and have it call us.
     server_response_ = std::bind(&RDIP::Connection::getVariables, this, false);
     process_server_response_ = std::bind(&RDIP::Connection::sendVariables, this, "global");
     server_wait_cond_.notify_all();
-  } else if(regex_match(cmd, what, reg_var_instance)) {
+  } else if (CommandTokenizer::IsKeyword(what, "instance", "i")) {
     size_t objectID = 0;
-    std::string str_what = what[1];
-    sscanf(str_what.c_str(), "%x", &objectID);
+    if (!CommandTokenizer::ParseUnsigned(args.Rest(), objectID, 16)) {
+      Log("Invalid object id\n");
+      return;
+    }
     server_response_ = std::bind(&RDIP::Connection::getInstanceVariables, this, objectID);
     process_server_response_ = std::bind(&RDIP::Connection::sendVariables, this, "instance");
     server_wait_cond_.notify_all();
   } else {
-    Log("Unknown command : ");
-    Log(cmd.c_str());
-    Log("\n");
+    Log("Unknown var command\n");
   }
 }
 
 void RDIP::Connection::stopAtBreakpoint(BreakPoint bp) {
-  std::ostringstream ss;
-  ss << "<breakpoint file=\"" << bp.file << "\" line=\"" << bp.line << "\" threadId=\"1\"/>\n";
+  xml_.Clear();
+  xml_.Append("<breakpoint").Attribute("file", bp.file)
+      .Attribute("line", bp.line).Append(" threadId=\"1\"/>\n");
   Log("sending stopAtBreakpoint => ");
 
-  auto str = ss.str();
-  Log(str.c_str());
-  write(socket_, boost::asio::buffer(str));
+  Log(xml_.str().c_str());
+  output_.Send(xml_.str());
 }
 
 void RDIP::Connection::suspendAt(const std::string& file, size_t line) {
-  std::ostringstream ss;
-  ss << "<suspended file=\"" << encodeXml(file) << "\" line=\"" << line << "\" threadId=\"1\" frames=\"1\"/>\n";
+  xml_.Clear();
+  xml_.Append("<suspended").Attribute("file", file).Attribute("line", line)
+      .Append(" threadId=\"1\" frames=\"1\"/>\n");
   Log("sending suspendAt => ");
 
-  auto str = ss.str();
-  Log(str.c_str());
-  write(socket_, boost::asio::buffer(str));
+  Log(xml_.str().c_str());
+  output_.Send(xml_.str());
+}
+
+void RDIP::Connection::message(const std::string& text) {
+  if (!connected_)
+    return;
+  xml_.Clear();
+  xml_.Append("<message>").AppendEscaped(text).Append("</message>\n");
+  output_.Send(xml_.str(), true);
 }
 
 void RDIP::Connection::getVariables(bool local) {
@@ -357,21 +899,38 @@ void RDIP::Connection::getInstanceVariables(size_t object_id) {
 void RDIP::Connection::sendVariables(std::string kind) {
   std::lock_guard<std::mutex> lock(variables_to_send_mutex_);
   Log("sending variables\n");
-  std::string send_str = "<variables>\n";
-  for(const auto var : variables_to_send_) {
-    boost::format fmt("<variable name=\"%s\" kind=\"%s\" value=\"%s\" type=\"%s\" hasChildren=\"%s\" objectId=\"%x\"/>\n");
-    std::string value = encodeXml(var.value);
-    std::string name = encodeXml(var.name);
-    fmt % name % kind % value % var.type %
-          (var.has_children ? "true" : "false") % var.object_id;
-    send_str += fmt.str();
-  }
-  send_str += "</variables>\n";
-  Log(send_str.c_str());
-  write(socket_, boost::asio::buffer(send_str));
+  xml_.Clear();
+  xml_.Append("<variables>\n");
+  for(const auto& var : variables_to_send_) {
+    xml_.Append("<variable").Attribute("name", var.name)
+        .Attribute("kind", kind).Attribute("value", var.value)
+        .Attribute("type", var.type)
+        .Append(var.has_children ? " hasChildren=\"true\"" :
+                                   " hasChildren=\"false\"")
+        .HexAttribute("objectId", var.object_id).Append("/>\n");
+  }
+  xml_.Append("</variables>\n");
+  Log(xml_.str().c_str());
+  output_.Send(xml_.str());
   variables_to_send_.clear();
 }
 
+void RDIP::Connection::addWatchPoint() {
+  watchpoint_added_ = server_->AddWatchPoint(watchpoint_);
+}
+
+void RDIP::Connection::sendWatchPointAdded() {
+  if (!watchpoint_added_) {
+    Log("Adding watchpoint failed\n");
+    return;
+  }
+  xml_.Clear();
+  xml_.Append("<breakpointAdded").Attribute("no", watchpoint_.index)
+      .Attribute("location", watchpoint_.variable).Append("/>\n");
+  Log(xml_.str().c_str());
+  output_.Send(xml_.str());
+}
+
 void RDIP::Connection::evalExpression() {
   std::lock_guard<std::mutex> lock(variables_to_send_mutex_);
   variables_to_send_.clear();
@@ -7,6 +7,7 @@
 #define RDEBUGGER_DEBUGSERVER_UI_CONSOLE_WIN_RDIP_H_
 
 #include <DebugServer/UI/IDebuggerUI.h>
+#include <DebugServer/UI/OutputQueue.h>
 
 #include <atomic>
 #include <functional>
@@ -37,10 +38,12 @@ public:
 
   virtual void Break(const std::string& file, size_t line);
 
+  virtual void Message(const std::string& text);
+
 private:
     class Connection;
 
-    void RunService(int port);
+    void RunService();
     void HandleFatalFailure(const boost::system::error_code& err, int signal);
     void HandleConnection(const boost::system::error_code& err);
 
@@ -51,6 +54,7 @@ private:
     std::condition_variable server_wait_cond_;
     std::mutex server_wait_mutex_;
     bool server_can_continue_;
+    OutputQueue::Options output_options_;
 
     std::shared_ptr<Connection> connection_;
     std::function<void(void)> server_response_;
@@ -0,0 +1,113 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./XmlBuffer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RDEBUGGER_XML_USE_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+inline bool NeedsEscape(char c) {
+  return c == '&' || c == '"' || c == '<' || c == '>' || c == '\'';
+}
+
+inline const char* EntityFor(char c) {
+  switch (c) {
+    case '&': return "&amp;";
+    case '"': return "&quot;";
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    default: return "&apos;";
+  }
+}
+
+#ifdef RDEBUGGER_XML_USE_SSE2
+inline unsigned FirstSetBit(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Returns the position of the first character needing escaping in [s, end),
+// or end if there is none.
+const char* FindSpecial(const char* s, const char* end) {
+#ifdef RDEBUGGER_XML_USE_SSE2
+  const __m128i amp = _mm_set1_epi8('&');
+  const __m128i quot = _mm_set1_epi8('"');
+  const __m128i lt = _mm_set1_epi8('<');
+  const __m128i gt = _mm_set1_epi8('>');
+  const __m128i apos = _mm_set1_epi8('\'');
+  while (end - s >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, quot)),
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lt),
+                                  _mm_cmpeq_epi8(chunk, gt)),
+                     _mm_cmpeq_epi8(chunk, apos)));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+    if (mask != 0)
+      return s + FirstSetBit(mask);
+    s += 16;
+  }
+#endif
+  while (s != end && !NeedsEscape(*s))
+    ++s;
+  return s;
+}
+
+} // end anonymous namespace
+
+XmlBuffer& XmlBuffer::AppendEscaped(const char* s, size_t length) {
+  const char* end = s + length;
+  while (s != end) {
+    const char* special = FindSpecial(s, end);
+    buffer_.append(s, special - s);
+    if (special == end)
+      break;
+    Append(EntityFor(*special));
+    s = special + 1;
+  }
+  return *this;
+}
+
+XmlBuffer& XmlBuffer::AppendDecimal(unsigned long long value) {
+  char digits[24];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  buffer_.append(p, digits + sizeof(digits) - p);
+  return *this;
+}
+
+XmlBuffer& XmlBuffer::AppendHex(unsigned long long value) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  char digits[16];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = kHexDigits[value & 0xf];
+    value >>= 4;
+  } while (value != 0);
+  buffer_.append(p, digits + sizeof(digits) - p);
+  return *this;
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,82 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_RDIP_XMLBUFFER_H_
+#define RDEBUGGER_DEBUGSERVER_UI_RDIP_XMLBUFFER_H_
+
+#include <cstring>
+#include <string>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Output buffer used to build RDIP replies. It is meant to be kept around and
+// cleared between replies so its storage is reused. Text is escaped in a
+// single pass and integers are formatted without going through streams.
+class XmlBuffer {
+public:
+  XmlBuffer() {}
+
+  // Empties the buffer, keeping its capacity.
+  void Clear() { buffer_.clear(); }
+
+  const std::string& str() const { return buffer_; }
+
+  XmlBuffer& Append(const char* s) {
+    buffer_.append(s, std::strlen(s));
+    return *this;
+  }
+
+  XmlBuffer& Append(const std::string& s) {
+    buffer_.append(s);
+    return *this;
+  }
+
+  // Appends the text, replacing &, ", <, > and ' with entity references.
+  XmlBuffer& AppendEscaped(const std::string& s) {
+    return AppendEscaped(s.data(), s.size());
+  }
+
+  XmlBuffer& AppendEscaped(const char* s, size_t length);
+
+  XmlBuffer& AppendDecimal(unsigned long long value);
+
+  XmlBuffer& AppendHex(unsigned long long value);
+
+  // Appends  name="value" with a leading space and the value escaped.
+  XmlBuffer& Attribute(const char* name, const std::string& value) {
+    AppendAttributeName(name);
+    AppendEscaped(value);
+    buffer_ += '"';
+    return *this;
+  }
+
+  XmlBuffer& Attribute(const char* name, unsigned long long value) {
+    AppendAttributeName(name);
+    AppendDecimal(value);
+    buffer_ += '"';
+    return *this;
+  }
+
+  XmlBuffer& HexAttribute(const char* name, unsigned long long value) {
+    AppendAttributeName(name);
+    AppendHex(value);
+    buffer_ += '"';
+    return *this;
+  }
+
+private:
+  void AppendAttributeName(const char* name) {
+    buffer_ += ' ';
+    Append(name);
+    buffer_.append("=\"", 2);
+  }
+
+  std::string buffer_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_RDIP_XMLBUFFER_H_
@@ -0,0 +1,166 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Transport.h"
+
+#include <DebugServer/Log.h>
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <regex>
+
+#ifndef WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Transport over any asio stream protocol.
+template <typename Protocol>
+class StreamTransport : public Transport {
+public:
+  StreamTransport(boost::asio::io_service& service,
+                  const typename Protocol::endpoint& endpoint,
+                  const std::string& description,
+                  const std::string& notice)
+    : socket_(service),
+      acceptor_(service, endpoint),
+      description_(description),
+      notice_(notice) {}
+
+  virtual void AsyncAccept(AcceptHandler handler) {
+    acceptor_.async_accept(socket_, handler);
+  }
+
+  virtual void AsyncReadUntil(boost::asio::streambuf& buffer,
+                              const char* delimiter, IoHandler handler) {
+    boost::asio::async_read_until(socket_, buffer, delimiter, handler);
+  }
+
+  virtual void AsyncRead(boost::asio::streambuf& buffer, size_t bytes,
+                         IoHandler handler) {
+    boost::asio::async_read(socket_, buffer,
+                            boost::asio::transfer_exactly(bytes), handler);
+  }
+
+  virtual void AsyncWrite(const std::vector<boost::asio::const_buffer>& buffers,
+                          IoHandler handler) {
+    boost::asio::async_write(socket_, buffers, handler);
+  }
+
+  virtual void SetNoDelay(bool no_delay) {
+    SetNoDelay(socket_, no_delay);
+  }
+
+  virtual void Close() {
+    boost::system::error_code err;
+    socket_.close(err);
+  }
+
+  virtual std::string GetDescription() const {
+    return description_;
+  }
+
+  virtual const std::string& GetNotice() const {
+    return notice_;
+  }
+
+protected:
+  void CloseAcceptor() {
+    boost::system::error_code err;
+    acceptor_.close(err);
+  }
+
+private:
+  template <typename Socket>
+  static void SetNoDelay(Socket&, bool) {}
+
+  static void SetNoDelay(boost::asio::ip::tcp::socket& socket, bool no_delay) {
+    boost::system::error_code err;
+    socket.set_option(boost::asio::ip::tcp::no_delay(no_delay), err);
+  }
+
+  typename Protocol::socket socket_;
+  typename Protocol::acceptor acceptor_;
+  std::string description_;
+  std::string notice_;
+};
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+// Removes the socket file at the path. Anything else there is left alone,
+// for bind to report.
+void RemoveSocketFile(const std::string& path) {
+#ifndef WIN32
+  struct stat info;
+  if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+    unlink(path.c_str());
+#endif
+}
+
+typedef boost::asio::local::stream_protocol Local;
+
+// Unix domain socket transport. Owns the socket file, which would otherwise
+// be left behind.
+class LocalTransport : public StreamTransport<Local> {
+public:
+  LocalTransport(boost::asio::io_service& service, const std::string& path)
+    : StreamTransport<Local>(service, CreateEndpoint(path), "unix:" + path,
+                             std::string()),
+      path_(path) {}
+
+  virtual ~LocalTransport() {
+    CloseAcceptor();
+    RemoveSocketFile(path_);
+  }
+
+private:
+  // A file left behind by a session that did not shut down would make bind
+  // fail.
+  static Local::endpoint CreateEndpoint(const std::string& path) {
+    RemoveSocketFile(path);
+    return Local::endpoint(path);
+  }
+
+  std::string path_;
+};
+#endif
+
+} // end anonymous namespace
+
+std::unique_ptr<Transport> Transport::Create(boost::asio::io_service& service,
+                                             const std::string& str_debugger) {
+  std::smatch match;
+  std::string notice;
+  const std::regex reg_socket("socket=(\\S+)");
+  if (regex_search(str_debugger, match, reg_socket)) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    return std::unique_ptr<Transport>(new LocalTransport(service, match[1]));
+#else
+    notice = "Unix domain sockets are not supported here, socket= was "
+             "ignored and the debugger listens on TCP";
+#endif
+  }
+
+  int port = 1234;
+  const std::regex reg_port("port=(\\d+)");
+  if (regex_search(str_debugger, match, reg_port)) {
+    port = boost::lexical_cast<int>(match[1]);
+  }
+  typedef boost::asio::ip::tcp Tcp;
+  std::string description = "tcp:" + boost::lexical_cast<std::string>(port);
+  if (!notice.empty()) {
+    notice += " (" + description + ")";
+    Log((notice + "\n").c_str());
+  }
+  return std::unique_ptr<Transport>(new StreamTransport<Tcp>(
+      service, Tcp::endpoint(Tcp::v4(), port), description, notice));
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,70 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_UI_TRANSPORT_H_
+#define RDEBUGGER_DEBUGSERVER_UI_TRANSPORT_H_
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/streambuf.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Stream connection a debugger front end listens on and talks to its client
+// through. Hides whether it is a TCP or a Unix domain socket.
+class Transport {
+public:
+  typedef std::function<void(const boost::system::error_code&)> AcceptHandler;
+  typedef std::function<void(const boost::system::error_code&, size_t)>
+      IoHandler;
+
+  virtual ~Transport() {}
+
+  // Creates the transport selected in the debugger init string:
+  // socket=<path> listens on a Unix domain socket, otherwise TCP is used on
+  // port=<port> (default 1234). Where Unix domain sockets are not supported,
+  // socket= falls back to TCP and GetNotice says so. A socket file is
+  // removed when the transport is destroyed.
+  static std::unique_ptr<Transport> Create(boost::asio::io_service& service,
+                                           const std::string& str_debugger);
+
+  // Waits for a client to connect.
+  virtual void AsyncAccept(AcceptHandler handler) = 0;
+
+  // Reads until the delimiter has been received.
+  virtual void AsyncReadUntil(boost::asio::streambuf& buffer,
+                              const char* delimiter, IoHandler handler) = 0;
+
+  // Reads exactly the given number of bytes.
+  virtual void AsyncRead(boost::asio::streambuf& buffer, size_t bytes,
+                         IoHandler handler) = 0;
+
+  // Writes all buffers.
+  virtual void AsyncWrite(const std::vector<boost::asio::const_buffer>& buffers,
+                          IoHandler handler) = 0;
+
+  // Enables or disables Nagle's algorithm where it applies.
+  virtual void SetNoDelay(bool no_delay) = 0;
+
+  // Closes the client connection.
+  virtual void Close() = 0;
+
+  // Human readable endpoint, for logging.
+  virtual std::string GetDescription() const = 0;
+
+  // Something about the transport the client should be told when it
+  // connects, or an empty string.
+  virtual const std::string& GetNotice() const = 0;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_UI_TRANSPORT_H_
@@ -0,0 +1,80 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Watchdog.h"
+#include "./Clock.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+Watchdog::Watchdog(unsigned threshold_ms, StallHandler handler)
+  : threshold_ms_(threshold_ms),
+    handler_(handler),
+    heartbeat_(0),
+    busy_since_(0),
+    stop_(false) {
+  thread_ = std::thread(std::bind(&Watchdog::ThreadFunc, this));
+}
+
+Watchdog::~Watchdog() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_cond_.notify_all();
+  thread_.join();
+}
+
+void Watchdog::EnterRuby() {
+  busy_since_.store(Clock::NowMilliseconds(), std::memory_order_relaxed);
+}
+
+void Watchdog::ThreadFunc() {
+  // Check a few times per threshold period.
+  const std::chrono::milliseconds tick(threshold_ms_ >= 40 ?
+                                       threshold_ms_ / 4 : 10);
+  unsigned last_beat = heartbeat_;
+  long long last_beat_time = Clock::NowMilliseconds();
+  long long reported_since = 0;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    stop_cond_.wait_for(lock, tick);
+    if (stop_)
+      break;
+
+    long long now = Clock::NowMilliseconds();
+    unsigned beat = heartbeat_.load(std::memory_order_relaxed);
+    if (beat != last_beat) {
+      last_beat = beat;
+      last_beat_time = now;
+    }
+
+    long long since = busy_since_.load(std::memory_order_relaxed);
+    if (since == 0 || since == reported_since)
+      continue;
+
+    // Beats from before Ruby was entered do not count.
+    long long last_progress = std::max(last_beat_time, since);
+    std::ostringstream reason;
+    if (now - last_progress > threshold_ms_) {
+      reason << "Ruby made no progress for " << (now - last_progress)
+             << " ms";
+    } else if (now - since > threshold_ms_) {
+      reason << "Ruby has been running for " << (now - since) << " ms";
+    } else {
+      continue;
+    }
+    reported_since = since;
+    lock.unlock();
+    handler_(reason.str());
+    lock.lock();
+  }
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
@@ -0,0 +1,63 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_DEBUGSERVER_WATCHDOG_H_
+#define RDEBUGGER_DEBUGSERVER_WATCHDOG_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Watches the Ruby thread for stalls from a thread of its own. The Ruby
+// thread reports progress through the inline methods below, which only touch
+// atomics. When Ruby has been busy for longer than the threshold, or has made
+// no progress for that long, the stall handler is called on the watchdog
+// thread, once per busy period.
+class Watchdog {
+public:
+  typedef std::function<void(const std::string& reason)> StallHandler;
+
+  Watchdog(unsigned threshold_ms, StallHandler handler);
+  ~Watchdog();
+
+  // Called for every trace event.
+  void Beat() {
+    heartbeat_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Called when control enters Ruby code from SketchUp.
+  void EnterRuby();
+
+  // Called when control goes back to SketchUp.
+  void LeaveRuby() {
+    busy_since_.store(0, std::memory_order_relaxed);
+  }
+
+  unsigned GetThreshold() const { return threshold_ms_; }
+
+private:
+  void ThreadFunc();
+
+  unsigned threshold_ms_;
+  StallHandler handler_;
+  std::atomic<unsigned> heartbeat_;
+  // Time stamp in ms when Ruby code was entered, 0 while idle.
+  std::atomic<long long> busy_since_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stop_cond_;
+  bool stop_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_DEBUGSERVER_WATCHDOG_H_
@@ -0,0 +1,306 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./Analyzer.h"
+#include "./TraceFile.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Durations below this many nanoseconds get a bucket each.
+const uint64_t kLinearLimit = 16;
+
+const int kSubBucketBits = 3;
+
+uint16_t GetBucket(uint64_t ns) {
+  if (ns < kLinearLimit)
+    return static_cast<uint16_t>(ns);
+  int msb = 0;
+  for (uint64_t v = ns; v > 1; v >>= 1)
+    ++msb;
+  uint64_t sub = (ns >> (msb - kSubBucketBits)) & ((1 << kSubBucketBits) - 1);
+  return static_cast<uint16_t>(kLinearLimit +
+      ((msb - 4) << kSubBucketBits) + sub);
+}
+
+// Returns the middle of a bucket.
+uint64_t GetBucketValue(uint16_t bucket) {
+  if (bucket < kLinearLimit)
+    return bucket;
+  int msb = ((bucket - kLinearLimit) >> kSubBucketBits) + 4;
+  uint64_t sub = (bucket - kLinearLimit) & ((1 << kSubBucketBits) - 1);
+  int shift = msb - kSubBucketBits;
+  uint64_t low = ((1ull << kSubBucketBits) + sub) << shift;
+  return low + (1ull << shift) / 2;
+}
+
+uint64_t GetLineKey(const TraceRecord& record) {
+  return (static_cast<uint64_t>(record.file) << 32) | record.line;
+}
+
+void AddLine(std::deque<TraceRecord>& lines, const TraceRecord& record,
+             size_t max_lines) {
+  if (max_lines == 0)
+    return;
+  if (lines.size() == max_lines)
+    lines.pop_front();
+  lines.push_back(record);
+}
+
+} // end anonymous namespace
+
+void LatencyHistogram::Add(uint64_t ns) {
+  ++buckets_[GetBucket(ns)];
+  ++count_;
+  total_ += ns;
+  max_ = std::max(max_, ns);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (auto it = other.buckets_.cbegin(), ite = other.buckets_.cend();
+       it != ite; ++it) {
+    buckets_[it->first] += it->second;
+  }
+  count_ += other.count_;
+  total_ += other.total_;
+  max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetPercentile(double p) const {
+  if (count_ == 0)
+    return 0;
+  uint64_t rank = static_cast<uint64_t>(p * count_ + 0.5);
+  rank = std::max<uint64_t>(1, std::min(rank, count_));
+  uint64_t seen = 0;
+  for (auto it = buckets_.cbegin(), ite = buckets_.cend(); it != ite; ++it) {
+    seen += it->second;
+    if (seen >= rank)
+      return std::min(GetBucketValue(it->first), max_);
+  }
+  return max_;
+}
+
+size_t CallTree::GetChild(size_t node, FrameKey key) {
+  auto it = nodes_[node].children.find(key);
+  if (it != nodes_[node].children.end())
+    return it->second;
+  size_t child = nodes_.size();
+  nodes_.push_back(Node());
+  nodes_[child].key = key;
+  nodes_[node].children.insert(std::make_pair(key, child));
+  return child;
+}
+
+void CallTree::Merge(const CallTree& other) {
+  MergeNode(kRoot, other, kRoot);
+}
+
+void CallTree::MergeNode(size_t node, const CallTree& other,
+                         size_t other_node) {
+  const Node& source = other.nodes_[other_node];
+  nodes_[node].calls += source.calls;
+  nodes_[node].time += source.time;
+  for (auto it = source.children.cbegin(), ite = source.children.cend();
+       it != ite; ++it) {
+    MergeNode(GetChild(node, it->first), other, it->second);
+  }
+}
+
+Analyzer::Analyzer(const TraceFile& trace)
+  : trace_(trace),
+    record_count_(0),
+    first_time_(0),
+    last_time_(0) {
+}
+
+void Analyzer::Run(const AnalysisOptions& options) {
+  options_ = options;
+  const uint64_t first = trace_.first_sequence();
+  const uint64_t chunks = trace_.end_sequence() - first;
+  const size_t ranges = static_cast<size_t>(std::max<uint64_t>(1,
+      std::min<uint64_t>(std::max(options.threads, 1u), chunks)));
+  std::vector<uint64_t> bounds(ranges + 1);
+  for (size_t i = 0; i <= ranges; ++i) {
+    bounds[i] = first + chunks * i / ranges;
+  }
+
+  // First pass, only needed if there is more than one range.
+  std::vector<RangeSummary> summaries(ranges);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < ranges; ++i) {
+    threads.push_back(std::thread([this, i, &bounds, &summaries]() {
+      Summarize(bounds[i - 1], bounds[i], summaries[i - 1]);
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  threads.clear();
+
+  std::vector<std::vector<OpenFrame>> start_stacks(ranges);
+  std::vector<std::deque<TraceRecord>> start_lines(ranges);
+  for (size_t i = 1; i < ranges; ++i) {
+    const RangeSummary& summary = summaries[i - 1];
+    std::vector<OpenFrame>& stack = start_stacks[i];
+    stack = start_stacks[i - 1];
+    stack.resize(stack.size() - std::min(summary.unmatched_returns,
+                                         stack.size()));
+    stack.insert(stack.end(), summary.open_frames.begin(),
+                 summary.open_frames.end());
+    start_lines[i] = start_lines[i - 1];
+    for (auto it = summary.last_lines.cbegin(),
+         ite = summary.last_lines.cend(); it != ite; ++it) {
+      AddLine(start_lines[i], *it, options_.context_lines);
+    }
+  }
+
+  std::vector<RangeResult> results(ranges);
+  for (size_t i = 0; i < ranges; ++i) {
+    threads.push_back(std::thread(
+        [this, i, &bounds, &start_stacks, &start_lines, &summaries,
+         &results]() {
+      Analyze(bounds[i], bounds[i + 1], start_stacks[i], start_lines[i],
+              i == 0 ? nullptr : &summaries[i - 1], results[i]);
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  for (size_t i = 0; i < ranges; ++i) {
+    RangeResult& result = results[i];
+    if (result.records == 0)
+      continue;
+    if (record_count_ == 0)
+      first_time_ = result.first_time;
+    last_time_ = result.last_time;
+    record_count_ += result.records;
+    call_tree_.Merge(result.tree);
+    for (auto it = result.latencies.cbegin(), ite = result.latencies.cend();
+         it != ite; ++it) {
+      latencies_[it->first].Merge(it->second);
+    }
+    for (auto it = result.lines.cbegin(), ite = result.lines.cend();
+         it != ite; ++it) {
+      LineStats& stats = lines_[it->first];
+      stats.hits += it->second.hits;
+      stats.time += it->second.time;
+    }
+    for (auto it = result.target_stacks.cbegin(),
+         ite = result.target_stacks.cend(); it != ite; ++it) {
+      target_stacks_[it->first] += it->second;
+    }
+    if (result.hit)
+      target_context_.swap(result.target_context);
+  }
+}
+
+void Analyzer::Summarize(uint64_t first, uint64_t end,
+                         RangeSummary& summary) const {
+  std::vector<OpenFrame>& stack = summary.open_frames;
+  trace_.ReadChunks(first, end, [&](TraceChunkReader& reader) {
+    TraceRecord record;
+    while (reader.Next(record)) {
+      summary.has_last_record = true;
+      summary.last_record = record;
+      if (IsTraceCall(record.kind)) {
+        OpenFrame frame = { MakeFrameKey(record), record.time };
+        stack.push_back(frame);
+      } else if (IsTraceReturn(record.kind)) {
+        if (stack.empty())
+          ++summary.unmatched_returns;
+        else
+          stack.pop_back();
+      } else if (!options_.target_files.empty()) {
+        AddLine(summary.last_lines, record, options_.context_lines);
+      }
+    }
+  });
+}
+
+void Analyzer::Analyze(uint64_t first, uint64_t end,
+                       const std::vector<OpenFrame>& start_stack,
+                       const std::deque<TraceRecord>& start_lines,
+                       const RangeSummary* previous_range,
+                       RangeResult& result) const {
+  struct Frame {
+    FrameKey key;
+    uint64_t start;
+    size_t node;
+  };
+  std::vector<Frame> stack;
+  size_t node = CallTree::kRoot;
+  for (auto it = start_stack.cbegin(), ite = start_stack.cend(); it != ite;
+       ++it) {
+    node = result.tree.GetChild(node, it->key);
+    Frame frame = { it->key, it->start, node };
+    stack.push_back(frame);
+  }
+  std::deque<TraceRecord> recent_lines(start_lines);
+  const bool has_target = !options_.target_files.empty();
+  TraceRecord previous;
+  bool has_previous = previous_range && previous_range->has_last_record;
+  if (has_previous)
+    previous = previous_range->last_record;
+
+  trace_.ReadChunks(first, end, [&](TraceChunkReader& reader) {
+    TraceRecord record;
+    while (reader.Next(record)) {
+      if (result.records++ == 0)
+        result.first_time = record.time;
+      result.last_time = record.time;
+
+      // Time between two events is charged to the line of the first. Once
+      // a return leaves no frame open, Ruby may be back in SketchUp until
+      // the next event, and that gap is not charged to any line.
+      bool unwound = has_previous && IsTraceReturn(previous.kind) &&
+                     stack.empty();
+      if (has_previous && !unwound && record.time >= previous.time)
+        result.lines[GetLineKey(previous)].time += record.time - previous.time;
+      previous = record;
+      has_previous = true;
+
+      if (IsTraceCall(record.kind)) {
+        FrameKey key = MakeFrameKey(record);
+        size_t parent = stack.empty() ? CallTree::kRoot : stack.back().node;
+        Frame frame = { key, record.time, result.tree.GetChild(parent, key) };
+        stack.push_back(frame);
+      } else if (IsTraceReturn(record.kind)) {
+        if (stack.empty())
+          continue; // Returns from frames entered before the recording
+        const Frame& frame = stack.back();
+        uint64_t duration = record.time - frame.start;
+        CallTree::Node& tree_node = result.tree.GetNode(frame.node);
+        ++tree_node.calls;
+        tree_node.time += duration;
+        result.latencies[frame.key].Add(duration);
+        stack.pop_back();
+      } else {
+        ++result.lines[GetLineKey(record)].hits;
+        if (!has_target)
+          continue;
+        AddLine(recent_lines, record, options_.context_lines);
+        if (record.line == options_.target_line &&
+            options_.target_files.count(record.file) != 0) {
+          std::vector<FrameKey> keys;
+          keys.reserve(stack.size());
+          for (auto it = stack.cbegin(), ite = stack.cend(); it != ite; ++it)
+            keys.push_back(it->key);
+          ++result.target_stacks[keys];
+          result.hit = true;
+          result.target_context.assign(recent_lines.begin(),
+                                       recent_lines.end());
+        }
+      }
+    }
+  });
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
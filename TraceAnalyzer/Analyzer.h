@@ -0,0 +1,212 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_TRACEANALYZER_ANALYZER_H_
+#define RDEBUGGER_TRACEANALYZER_ANALYZER_H_
+
+#include <Common/TraceFormat.h>
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+class TraceFile;
+
+// Identifies a frame by the kind and location of its call event. Ruby
+// methods, blocks and class bodies are located at their definition, C
+// functions at their caller.
+typedef uint64_t FrameKey;
+
+inline FrameKey MakeFrameKey(const TraceRecord& record) {
+  return (static_cast<uint64_t>(record.file) << 32) |
+         (static_cast<uint64_t>(record.line & 0x0fffffff) << 4) |
+         static_cast<uint64_t>(record.kind);
+}
+
+inline uint32_t GetFrameFile(FrameKey key) {
+  return static_cast<uint32_t>(key >> 32);
+}
+
+inline uint32_t GetFrameLine(FrameKey key) {
+  return static_cast<uint32_t>(key >> 4) & 0x0fffffff;
+}
+
+inline TraceEventKind GetFrameKind(FrameKey key) {
+  return static_cast<TraceEventKind>(key & 0xf);
+}
+
+// Distribution of durations in log-linear buckets, 8 per power of two,
+// which bounds the error of a percentile to about 6%.
+class LatencyHistogram {
+public:
+  LatencyHistogram() : count_(0), total_(0), max_(0) {}
+
+  void Add(uint64_t ns);
+
+  void Merge(const LatencyHistogram& other);
+
+  // p in [0, 1].
+  uint64_t GetPercentile(double p) const;
+
+  uint64_t count() const { return count_; }
+  uint64_t total() const { return total_; }
+  uint64_t max() const { return max_; }
+
+private:
+  std::map<uint16_t, uint64_t> buckets_;
+  uint64_t count_;
+  uint64_t total_;
+  uint64_t max_;
+};
+
+// Calls aggregated by call stack.
+class CallTree {
+public:
+  struct Node {
+    Node() : key(0), calls(0), time(0) {}
+    FrameKey key;
+    // Calls that returned, and their total time in nanoseconds.
+    uint64_t calls;
+    uint64_t time;
+    std::map<FrameKey, size_t> children;
+  };
+
+  static const size_t kRoot = 0;
+
+  CallTree() : nodes_(1) {}
+
+  size_t GetChild(size_t node, FrameKey key);
+
+  void Merge(const CallTree& other);
+
+  const Node& GetNode(size_t node) const { return nodes_[node]; }
+  Node& GetNode(size_t node) { return nodes_[node]; }
+
+private:
+  void MergeNode(size_t node, const CallTree& other, size_t other_node);
+
+  std::vector<Node> nodes_;
+};
+
+struct LineStats {
+  LineStats() : hits(0), time(0) {}
+  uint64_t hits;
+  // Time until the next event, in nanoseconds. Not counted after a return
+  // that leaves no frame open, which is idle time between callbacks.
+  uint64_t time;
+};
+
+struct AnalysisOptions {
+  AnalysisOptions() : threads(1), target_line(0), context_lines(20) {}
+  unsigned threads;
+  // Location of the "path to line" query. No query if target_files is
+  // empty.
+  std::set<uint32_t> target_files;
+  uint32_t target_line;
+  // Lines executed before the last hit of the target to report.
+  size_t context_lines;
+};
+
+// Decodes a recording on several threads and aggregates the call tree,
+// per line and per frame statistics, and the paths to a given line.
+//
+// The chunks are split into one contiguous range per thread. Frames can
+// span ranges, so a first pass over each range finds the frames it leaves
+// open and the returns it cannot match. Chaining those gives the call
+// stack at the start of each range, and the second pass analyzes every
+// range with its stack in place. Results of the ranges are then merged.
+class Analyzer {
+public:
+  explicit Analyzer(const TraceFile& trace);
+
+  void Run(const AnalysisOptions& options);
+
+  uint64_t record_count() const { return record_count_; }
+  uint64_t first_time() const { return first_time_; }
+  uint64_t last_time() const { return last_time_; }
+
+  const CallTree& call_tree() const { return call_tree_; }
+
+  const std::unordered_map<FrameKey, LatencyHistogram>& latencies() const {
+    return latencies_;
+  }
+
+  // Keyed by file id in the high and line in the low 32 bits.
+  const std::unordered_map<uint64_t, LineStats>& lines() const {
+    return lines_;
+  }
+
+  // Call stacks at the hits of the target line, outermost frame first.
+  const std::map<std::vector<FrameKey>, uint64_t>& target_stacks() const {
+    return target_stacks_;
+  }
+
+  // Lines executed up to and including the last hit of the target line.
+  const std::vector<TraceRecord>& target_context() const {
+    return target_context_;
+  }
+
+private:
+  struct OpenFrame {
+    FrameKey key;
+    uint64_t start;
+  };
+
+  // What a range does to the call stack, found by the first pass.
+  struct RangeSummary {
+    RangeSummary() : unmatched_returns(0), has_last_record(false) {}
+    size_t unmatched_returns;
+    std::vector<OpenFrame> open_frames;
+    std::deque<TraceRecord> last_lines;
+    bool has_last_record;
+    TraceRecord last_record;
+  };
+
+  struct RangeResult {
+    RangeResult() : records(0), first_time(0), last_time(0), hit(false) {}
+    uint64_t records;
+    uint64_t first_time;
+    uint64_t last_time;
+    CallTree tree;
+    std::unordered_map<FrameKey, LatencyHistogram> latencies;
+    std::unordered_map<uint64_t, LineStats> lines;
+    std::map<std::vector<FrameKey>, uint64_t> target_stacks;
+    bool hit;
+    std::vector<TraceRecord> target_context;
+  };
+
+  Analyzer(const Analyzer&);
+  Analyzer& operator=(const Analyzer&);
+
+  void Summarize(uint64_t first, uint64_t end, RangeSummary& summary) const;
+
+  void Analyze(uint64_t first, uint64_t end,
+               const std::vector<OpenFrame>& start_stack,
+               const std::deque<TraceRecord>& start_lines,
+               const RangeSummary* previous_range,
+               RangeResult& result) const;
+
+  const TraceFile& trace_;
+  AnalysisOptions options_;
+
+  uint64_t record_count_;
+  uint64_t first_time_;
+  uint64_t last_time_;
+  CallTree call_tree_;
+  std::unordered_map<FrameKey, LatencyHistogram> latencies_;
+  std::unordered_map<uint64_t, LineStats> lines_;
+  std::map<std::vector<FrameKey>, uint64_t> target_stacks_;
+  std::vector<TraceRecord> target_context_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_TRACEANALYZER_ANALYZER_H_
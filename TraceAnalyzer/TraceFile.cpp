@@ -0,0 +1,126 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#include "./TraceFile.h"
+
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+namespace {
+
+// Chunks mapped at once by ReadChunks.
+const uint64_t kWindowChunks = 256;
+
+} // end anonymous namespace
+
+TraceFile::TraceFile()
+  : first_sequence_(1),
+    end_sequence_(1) {
+}
+
+TraceFile::~TraceFile() {
+}
+
+bool TraceFile::Open(const std::string& path, std::string& error) {
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  if (!file) {
+    error = "Cannot open " + path;
+    return false;
+  }
+  if (!file.read(reinterpret_cast<char*>(&header_), sizeof(header_)) ||
+      !std::equal(kTraceMagic, kTraceMagic + sizeof(kTraceMagic),
+                  header_.magic)) {
+    error = path + " is not a trace recording";
+    return false;
+  }
+  if (header_.version != kTraceVersion) {
+    error = path + " has an unsupported trace format version";
+    return false;
+  }
+  file.seekg(0, std::ios::end);
+  uint64_t file_size = static_cast<uint64_t>(file.tellg());
+  if (header_.chunk_size <= sizeof(TraceChunkHeader) ||
+      header_.chunk_count == 0 ||
+      header_.names_offset != kTraceHeaderSize +
+                              header_.chunk_count * header_.chunk_size ||
+      header_.names_used > header_.names_size ||
+      file_size < header_.names_offset + header_.names_size) {
+    error = path + " is damaged";
+    return false;
+  }
+
+  // The ring holds the latest chunk_count chunks.
+  end_sequence_ = std::max<uint64_t>(header_.next_sequence, 1);
+  first_sequence_ = end_sequence_ > header_.chunk_count ?
+      end_sequence_ - header_.chunk_count : 1;
+
+  std::vector<uint8_t> names(static_cast<size_t>(header_.names_used));
+  file.seekg(header_.names_offset);
+  if (!names.empty() &&
+      !file.read(reinterpret_cast<char*>(&names[0]), names.size())) {
+    error = "Cannot read the file names of " + path;
+    return false;
+  }
+  const uint8_t* p = names.empty() ? nullptr : &names[0];
+  const uint8_t* end = p + names.size();
+  while (p != end) {
+    uint64_t length;
+    p = ReadTraceVarint(p, end, length);
+    if (p == nullptr || length > static_cast<uint64_t>(end - p))
+      break;
+    names_.push_back(std::string(reinterpret_cast<const char*>(p),
+                                 static_cast<size_t>(length)));
+    p += length;
+  }
+
+  try {
+    mapping_.reset(new boost::interprocess::file_mapping(
+        path.c_str(), boost::interprocess::read_only));
+  } catch (const boost::interprocess::interprocess_exception& e) {
+    error = "Cannot map " + path + ": " + e.what();
+    return false;
+  }
+  return true;
+}
+
+std::string TraceFile::GetName(uint32_t file) const {
+  if (file < names_.size())
+    return names_[file];
+  std::ostringstream os;
+  os << "#" << file;
+  return os.str();
+}
+
+void TraceFile::ReadChunks(uint64_t first, uint64_t end,
+    const std::function<void(TraceChunkReader& reader)>& visit) const {
+  const uint64_t chunk_size = header_.chunk_size;
+  uint64_t sequence = first;
+  while (sequence < end) {
+    // A window never wraps around the end of the ring.
+    uint64_t slot = (sequence - 1) % header_.chunk_count;
+    uint64_t count = std::min(kWindowChunks,
+        std::min(header_.chunk_count - slot, end - sequence));
+    boost::interprocess::mapped_region region(*mapping_,
+        boost::interprocess::read_only, kTraceHeaderSize + slot * chunk_size,
+        static_cast<size_t>(count * chunk_size));
+    const uint8_t* base = static_cast<const uint8_t*>(region.get_address());
+    for (uint64_t i = 0; i < count; ++i) {
+      const uint8_t* chunk = base + i * chunk_size;
+      TraceChunkReader reader(chunk, static_cast<size_t>(chunk_size));
+      if (reader.header().sequence == sequence + i)
+        visit(reader);
+    }
+    sequence += count;
+  }
+}
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
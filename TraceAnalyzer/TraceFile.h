@@ -0,0 +1,64 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+#ifndef RDEBUGGER_TRACEANALYZER_TRACEFILE_H_
+#define RDEBUGGER_TRACEANALYZER_TRACEFILE_H_
+
+#include <Common/TraceFormat.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SketchUp {
+namespace RubyDebugger {
+
+// Read access to an execution trace recorded by the debugger. Chunks are
+// mapped a window at a time, so recordings larger than the address space
+// of the process can be read, from several threads at once.
+class TraceFile {
+public:
+  TraceFile();
+  ~TraceFile();
+
+  // Returns false, with the reason in error, if the file is not a
+  // recording.
+  bool Open(const std::string& path, std::string& error);
+
+  const TraceFileHeader& header() const { return header_; }
+
+  // Sequence numbers of the chunks still in the ring are [first, end).
+  uint64_t first_sequence() const { return first_sequence_; }
+  uint64_t end_sequence() const { return end_sequence_; }
+
+  // Returns the path of a file id, or "#id" if the recording has no name
+  // for it.
+  std::string GetName(uint32_t file) const;
+
+  size_t GetNameCount() const { return names_.size(); }
+
+  // Calls visit for the chunks with sequence numbers [first, end), in
+  // order. Chunks that were being reset when the recording stopped are
+  // skipped. Can be called from several threads.
+  void ReadChunks(uint64_t first, uint64_t end,
+      const std::function<void(TraceChunkReader& reader)>& visit) const;
+
+private:
+  TraceFile(const TraceFile&);
+  TraceFile& operator=(const TraceFile&);
+
+  std::unique_ptr<boost::interprocess::file_mapping> mapping_;
+  TraceFileHeader header_;
+  uint64_t first_sequence_;
+  uint64_t end_sequence_;
+  std::vector<std::string> names_;
+};
+
+} // end namespace RubyDebugger
+} // end namespace SketchUp
+
+#endif // RDEBUGGER_TRACEANALYZER_TRACEFILE_H_
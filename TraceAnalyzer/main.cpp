@@ -0,0 +1,264 @@
+// SketchUp Ruby API Debugger. Copyright 2014 Trimble Navigation Ltd.
+// Authors:
+// - Bugra Barin
+//
+// Command line tool that reads execution traces recorded by the debugger
+// (record=<path>) and reports where the time went.
+
+#include "./Analyzer.h"
+#include "./TraceFile.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SketchUp::RubyDebugger;
+
+namespace {
+
+void PrintUsage() {
+  std::cerr <<
+      "Usage: TraceAnalyzer [-j threads] <trace file> [command]\n"
+      "Commands:\n"
+      "  summary               Records, time span and files (default)\n"
+      "  tree [min_percent]    Call tree, frames above min_percent of the\n"
+      "                        recorded time (default 1)\n"
+      "  hot [count]           Lines with the most time (default 20)\n"
+      "  latency [count]       Frames with the most time, with latency\n"
+      "                        percentiles (default 20)\n"
+      "  path <file:line> [count]\n"
+      "                        Call stacks that led to a line, and the lines\n"
+      "                        run before its last hit (default 20)\n";
+}
+
+double ToMilliseconds(uint64_t ns) {
+  return ns / 1000000.0;
+}
+
+std::string GetFrameName(const TraceFile& trace, FrameKey key) {
+  std::string location = trace.GetName(GetFrameFile(key)) + ":" +
+      boost::lexical_cast<std::string>(GetFrameLine(key));
+  switch (GetFrameKind(key)) {
+  case TRACE_C_CALL:
+    return "C function called at " + location;
+  case TRACE_B_CALL:
+    return "block at " + location;
+  case TRACE_CLASS:
+    return "class body at " + location;
+  default:
+    return "method at " + location;
+  }
+}
+
+template <typename T>
+T ParseArgument(const std::vector<std::string>& args, size_t index,
+                T default_value) {
+  if (index >= args.size())
+    return default_value;
+  try {
+    return boost::lexical_cast<T>(args[index]);
+  } catch (const boost::bad_lexical_cast&) {
+    return default_value;
+  }
+}
+
+void PrintSummary(const TraceFile& trace, const Analyzer& analyzer) {
+  std::cout << "Records: " << analyzer.record_count() << " in "
+            << trace.end_sequence() - trace.first_sequence() << " chunks\n"
+            << "Time span: " << std::fixed << std::setprecision(3)
+            << ToMilliseconds(analyzer.last_time() - analyzer.first_time())
+            << " ms\n"
+            << "Files:\n";
+  for (size_t i = 0; i < trace.GetNameCount(); ++i) {
+    std::cout << "  " << trace.GetName(static_cast<uint32_t>(i)) << "\n";
+  }
+}
+
+void PrintNode(const TraceFile& trace, const CallTree& tree, size_t index,
+               uint64_t min_time, int indent) {
+  const CallTree::Node& node = tree.GetNode(index);
+  std::vector<const CallTree::Node*> children;
+  for (auto it = node.children.cbegin(), ite = node.children.cend();
+       it != ite; ++it) {
+    const CallTree::Node& child = tree.GetNode(it->second);
+    if (child.time >= min_time && child.time != 0)
+      children.push_back(&child);
+  }
+  std::sort(children.begin(), children.end(),
+            [](const CallTree::Node* a, const CallTree::Node* b) {
+              return a->time > b->time;
+            });
+  for (auto it = children.cbegin(), ite = children.cend(); it != ite; ++it) {
+    const CallTree::Node& child = **it;
+    std::cout << std::setw(12) << ToMilliseconds(child.time)
+              << std::setw(10) << child.calls << "  "
+              << std::string(indent * 2, ' ')
+              << GetFrameName(trace, child.key) << "\n";
+    size_t child_index = node.children.find(child.key)->second;
+    PrintNode(trace, tree, child_index, min_time, indent + 1);
+  }
+}
+
+void PrintTree(const TraceFile& trace, const Analyzer& analyzer,
+               double min_percent) {
+  uint64_t span = analyzer.last_time() - analyzer.first_time();
+  uint64_t min_time = static_cast<uint64_t>(span * min_percent / 100);
+  std::cout << std::fixed << std::setprecision(3)
+            << "    Total ms     Calls  Frame\n";
+  PrintNode(trace, analyzer.call_tree(), CallTree::kRoot, min_time, 0);
+}
+
+void PrintHotLines(const TraceFile& trace, const Analyzer& analyzer,
+                   size_t count) {
+  typedef std::pair<uint64_t, LineStats> Line;
+  std::vector<Line> lines(analyzer.lines().begin(), analyzer.lines().end());
+  std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+    return a.second.time > b.second.time;
+  });
+  if (lines.size() > count)
+    lines.resize(count);
+  std::cout << std::fixed << std::setprecision(3)
+            << "     Self ms        Hits  Line\n";
+  for (auto it = lines.cbegin(), ite = lines.cend(); it != ite; ++it) {
+    std::cout << std::setw(12) << ToMilliseconds(it->second.time)
+              << std::setw(12) << it->second.hits << "  "
+              << trace.GetName(static_cast<uint32_t>(it->first >> 32)) << ":"
+              << static_cast<uint32_t>(it->first) << "\n";
+  }
+}
+
+void PrintLatencies(const TraceFile& trace, const Analyzer& analyzer,
+                    size_t count) {
+  typedef std::pair<const FrameKey, LatencyHistogram> Frame;
+  std::vector<const Frame*> frames;
+  for (auto it = analyzer.latencies().cbegin(),
+       ite = analyzer.latencies().cend(); it != ite; ++it) {
+    frames.push_back(&*it);
+  }
+  std::sort(frames.begin(), frames.end(),
+            [](const Frame* a, const Frame* b) {
+              return a->second.total() > b->second.total();
+            });
+  if (frames.size() > count)
+    frames.resize(count);
+  std::cout << std::fixed << std::setprecision(3)
+            << "      Calls    Total ms      p50 ms      p90 ms      p99 ms"
+               "      Max ms  Frame\n";
+  for (auto it = frames.cbegin(), ite = frames.cend(); it != ite; ++it) {
+    const LatencyHistogram& histogram = (*it)->second;
+    std::cout << std::setw(11) << histogram.count()
+              << std::setw(12) << ToMilliseconds(histogram.total())
+              << std::setw(12) << ToMilliseconds(histogram.GetPercentile(0.5))
+              << std::setw(12) << ToMilliseconds(histogram.GetPercentile(0.9))
+              << std::setw(12) << ToMilliseconds(histogram.GetPercentile(0.99))
+              << std::setw(12) << ToMilliseconds(histogram.max()) << "  "
+              << GetFrameName(trace, (*it)->first) << "\n";
+  }
+}
+
+void PrintPaths(const TraceFile& trace, const Analyzer& analyzer,
+                size_t count) {
+  typedef std::pair<const std::vector<FrameKey>, uint64_t> Stack;
+  std::vector<const Stack*> stacks;
+  for (auto it = analyzer.target_stacks().cbegin(),
+       ite = analyzer.target_stacks().cend(); it != ite; ++it) {
+    stacks.push_back(&*it);
+  }
+  if (stacks.empty()) {
+    std::cout << "The line was not reached in the recording\n";
+    return;
+  }
+  std::sort(stacks.begin(), stacks.end(),
+            [](const Stack* a, const Stack* b) {
+              return a->second > b->second;
+            });
+  if (stacks.size() > count)
+    stacks.resize(count);
+  for (auto it = stacks.cbegin(), ite = stacks.cend(); it != ite; ++it) {
+    std::cout << (*it)->second << " hits from:\n";
+    const std::vector<FrameKey>& keys = (*it)->first;
+    for (auto itk = keys.crbegin(), itke = keys.crend(); itk != itke; ++itk)
+      std::cout << "  " << GetFrameName(trace, *itk) << "\n";
+  }
+  std::cout << "Lines run up to the last hit:\n";
+  const std::vector<TraceRecord>& context = analyzer.target_context();
+  for (auto it = context.cbegin(), ite = context.cend(); it != ite; ++it) {
+    std::cout << "  " << trace.GetName(it->file) << ":" << it->line << "\n";
+  }
+}
+
+// Finds the file ids whose path ends with the given one.
+void FindFiles(const TraceFile& trace, const std::string& path,
+               std::set<uint32_t>& files) {
+  std::string suffix = boost::replace_all_copy(path, "\\", "/");
+  for (uint32_t i = 0; i < trace.GetNameCount(); ++i) {
+    if (boost::iends_with(trace.GetName(i), suffix))
+      files.insert(i);
+  }
+}
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  AnalysisOptions options;
+  options.threads = std::max(1u, std::thread::hardware_concurrency());
+  if (args.size() >= 2 && args[0] == "-j") {
+    options.threads = std::max(1u, ParseArgument<unsigned>(args, 1, 1));
+    args.erase(args.begin(), args.begin() + 2);
+  }
+  if (args.empty()) {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+
+  TraceFile trace;
+  std::string error;
+  if (!trace.Open(args[0], error)) {
+    std::cerr << error << "\n";
+    return EXIT_FAILURE;
+  }
+  std::string command = args.size() > 1 ? args[1] : "summary";
+
+  if (command == "path") {
+    std::string location = args.size() > 2 ? args[2] : std::string();
+    size_t colon = location.rfind(':');
+    if (colon == std::string::npos) {
+      PrintUsage();
+      return EXIT_FAILURE;
+    }
+    std::vector<std::string> line(1, location.substr(colon + 1));
+    options.target_line = ParseArgument<uint32_t>(line, 0, 0);
+    FindFiles(trace, location.substr(0, colon), options.target_files);
+    if (options.target_files.empty() || options.target_line == 0) {
+      std::cerr << "No recorded file matches " << location << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  Analyzer analyzer(trace);
+  analyzer.Run(options);
+
+  if (command == "summary") {
+    PrintSummary(trace, analyzer);
+  } else if (command == "tree") {
+    PrintTree(trace, analyzer, ParseArgument<double>(args, 2, 1.0));
+  } else if (command == "hot") {
+    PrintHotLines(trace, analyzer, ParseArgument<size_t>(args, 2, 20));
+  } else if (command == "latency") {
+    PrintLatencies(trace, analyzer, ParseArgument<size_t>(args, 2, 20));
+  } else if (command == "path") {
+    PrintPaths(trace, analyzer, ParseArgument<size_t>(args, 3, 20));
+  } else {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}